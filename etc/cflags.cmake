@@ -6,3 +6,10 @@ set(SANITIZING_FLAGS -fno-sanitize-recover=all -fsanitize=undefined -fsanitize=a
 # ask for more warnings from the compiler
 set (CMAKE_BASE_CXX_FLAGS "${CMAKE_CXX_FLAGS}")
 set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -Wpedantic -Wextra -Weffc++ -Werror -Wshadow -Wpointer-arith -Wcast-qual -Wformat=2 -Wno-unqualified-std-cast-call")
+
+# trace points at or below this level are compiled in: 0 = none, 1 = errors, 2 = info, 3 = debug (see util/trace.hh)
+set (MINNOW_TRACE_LEVEL 0 CACHE STRING "Trace level to compile in (0-3)")
+add_compile_definitions (MINNOW_TRACE_LEVEL=${MINNOW_TRACE_LEVEL})
+
+# flags for the "traced" copies of the libraries, which compile in every trace point whatever the level above
+set(TRACING_FLAGS -UMINNOW_TRACE_LEVEL -DMINNOW_TRACE_LEVEL=3)
@@ -57,6 +57,18 @@ ttest(send_extra)
 ttest(net_interface)
 
 ttest(router)
+ttest(lpm_table)
+ttest(router_parallel)
+ttest(routing_table)
+
+ttest(ip_fragmentation)
+
+ttest(path_mtu)
+
+ttest(io_uring)
+ttest(buffer_pool)
+
+ttest(trace)
 
 add_custom_target (check0 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --stop-on-failure --timeout 12 -R 'webget|^byte_stream_')
 
@@ -90,3 +102,10 @@ set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
 stest(reassembler_speed_test)
+stest(net_interface_speed_test)
+stest(header_speed_test)
+stest(checksum_speed_test)
+stest(lpm_speed_test)
+stest(router_speed_test)
+stest(trace_speed_test)
+stest(ip_fragmentation_speed_test)
@@ -0,0 +1,219 @@
+#include "ip_fragmentation.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+void fragment_datagram( const InternetDatagram& dgram, const size_t mtu, vector<InternetDatagram>& fragments )
+{
+  const size_t header_length = dgram.header.hlen * 4;
+  size_t total = 0;
+  for ( const auto& x : dgram.payload ) {
+    total += x.size();
+  }
+
+  if ( header_length + total <= mtu ) {
+    fragments.push_back( dgram );
+    return;
+  }
+
+  // Offsets count 8-byte units, so every fragment but the last carries a multiple of 8 bytes
+  if ( mtu < header_length + 8 ) {
+    throw runtime_error( "MTU of " + to_string( mtu ) + " bytes is too small to fragment into" );
+  }
+  const size_t chunk = ( mtu - header_length ) / 8 * 8;
+
+  size_t buffer_index = 0;
+  size_t buffer_pos = 0;
+  for ( size_t start = 0; start < total; start += chunk ) {
+    InternetDatagram& fragment = fragments.emplace_back();
+    size_t remaining = min( chunk, total - start );
+    fragment.header = dgram.header;
+    fragment.header.offset = dgram.header.offset + start / 8;
+    fragment.header.mf = dgram.header.mf or start + remaining < total;
+    fragment.header.len = header_length + remaining;
+    fragment.header.compute_checksum();
+
+    // Slice this fragment's share out of the datagram's payload buffers
+    while ( remaining > 0 ) {
+      const Buffer& buffer = dgram.payload[buffer_index];
+      const size_t take = min( remaining, buffer.size() - buffer_pos );
+      fragment.payload.push_back( buffer.substr( buffer_pos, take ) );
+      buffer_pos += take;
+      remaining -= take;
+      if ( buffer_pos == buffer.size() ) {
+        ++buffer_index;
+        buffer_pos = 0;
+      }
+    }
+  }
+}
+
+IPReassembler::IPReassembler( const size_t max_bytes, const uint64_t timeout_ms, const size_t max_datagrams )
+  : max_bytes_( max_bytes ), timeout_ms_( timeout_ms ), max_datagrams_( max_datagrams )
+{}
+
+optional<InternetDatagram> IPReassembler::add( InternetDatagram&& fragment )
+{
+  // A fragment parsed off the wire has its payload in one buffer; anything else is joined into one
+  Buffer data;
+  if ( fragment.payload.size() == 1 ) {
+    data = std::move( fragment.payload.front() );
+  } else {
+    string joined;
+    for ( const auto& x : fragment.payload ) {
+      joined.append( x );
+    }
+    data = Buffer { std::move( joined ) };
+  }
+
+  // How much of the storage this fragment shares it keeps alive, as far as can be told: the bytes in
+  // front of its payload and the payload itself
+  const size_t extent = data.headroom() + data.size();
+
+  const uint32_t first = fragment.header.offset * 8;
+  const uint32_t end = first + data.size();
+  if ( end + fragment.header.hlen * 4 > UINT16_MAX or ( data.empty() and fragment.header.mf )
+       or DATAGRAM_OVERHEAD + PIECE_OVERHEAD + extent > max_bytes_ ) {
+    return {};
+  }
+
+  const Key key { fragment.header.src, fragment.header.dst, fragment.header.id, fragment.header.proto };
+  auto it = partials_.find( key );
+  if ( it == partials_.end() ) {
+    // An empty (last) fragment would only start a datagram that holds nothing
+    if ( data.empty() ) {
+      return {};
+    }
+    if ( partials_.size() >= max_datagrams_ and not evict_oldest( key ) ) {
+      return {};
+    }
+    it = partials_.try_emplace( key ).first;
+    it->second.expires = now_ + timeout_ms_;
+    it->second.charge = DATAGRAM_OVERHEAD;
+    bytes_buffered_ += DATAGRAM_OVERHEAD;
+    expiry_.push_back( { it->second.expires, key } );
+  }
+  Partial& partial = it->second;
+  if ( first == 0 ) {
+    partial.header = fragment.header;
+  }
+
+  // Fill whatever holes this fragment overlaps, keeping the parts of the holes it doesn't cover
+  size_t pieces_added = 0;
+  for ( size_t i = 0; i < partial.holes.size(); ) {
+    const Hole hole = partial.holes[i];
+    if ( end <= hole.first or first >= hole.end ) {
+      ++i;
+      continue;
+    }
+
+    const uint32_t fill_first = max( first, hole.first );
+    const uint32_t fill_end = min( end, hole.end );
+    partial.pieces.push_back( { fill_first, data.substr( fill_first - first, fill_end - fill_first ) } );
+    partial.bytes += fill_end - fill_first;
+    ++pieces_added;
+
+    partial.holes[i] = partial.holes.back();
+    partial.holes.pop_back();
+    if ( hole.first < first ) {
+      partial.holes.push_back( { hole.first, first } );
+    }
+    if ( end < hole.end and fragment.header.mf ) {
+      partial.holes.push_back( { end, hole.end } );
+    }
+  }
+
+  // Charge for the pieces and what they keep alive. Fragments split from one datagram here (rather than
+  // parsed off the wire) share its storage, which is charged once, as far as any of them reaches.
+  if ( pieces_added > 0 ) {
+    size_t charge = pieces_added * PIECE_OVERHEAD;
+    const char* const storage = string_view { data }.data() - data.headroom();
+    const auto shared = ranges::find( partial.storage, storage, &Storage::start );
+    if ( shared == partial.storage.end() ) {
+      partial.storage.push_back( { storage, extent } );
+      charge += extent;
+    } else if ( shared->extent < extent ) {
+      charge += extent - shared->extent;
+      shared->extent = extent;
+    }
+    partial.charge += charge;
+    bytes_buffered_ += charge;
+  }
+
+  // The last fragment says where the datagram ends: nothing beyond it is missing
+  if ( not fragment.header.mf ) {
+    erase_if( partial.holes, [&]( const Hole& hole ) { return hole.first >= end; } );
+    for ( Hole& hole : partial.holes ) {
+      hole.end = min( hole.end, end );
+    }
+  }
+
+  if ( not partial.holes.empty() ) {
+    // Still incomplete: make room for what it holds, giving up on the datagrams that have waited longest
+    while ( bytes_buffered_ > max_bytes_ and evict_oldest( key ) ) {}
+    if ( bytes_buffered_ > max_bytes_ ) {
+      forget( it );
+      ++evicted_;
+    }
+    return {};
+  }
+
+  // Complete: the pieces, in order, are the payload
+  InternetDatagram dgram;
+  dgram.header = partial.header;
+  dgram.header.mf = false;
+  dgram.header.offset = 0;
+  dgram.header.len = dgram.header.hlen * 4 + partial.bytes;
+  dgram.header.compute_checksum();
+  sort( partial.pieces.begin(), partial.pieces.end(), []( const Piece& a, const Piece& b ) {
+    return a.offset < b.offset;
+  } );
+  dgram.payload.reserve( partial.pieces.size() );
+  for ( auto& piece : partial.pieces ) {
+    dgram.payload.push_back( std::move( piece.data ) );
+  }
+  forget( it );
+  return dgram;
+}
+
+void IPReassembler::tick( const uint64_t ms_since_last_tick )
+{
+  now_ += ms_since_last_tick;
+  while ( not expiry_.empty() and expiry_.front().time <= now_ ) {
+    const Expiry expiry = expiry_.front();
+    expiry_.pop_front();
+    const auto it = partials_.find( expiry.key );
+    if ( it != partials_.end() and it->second.expires == expiry.time ) { // (not a later datagram's)
+      forget( it );
+      ++timed_out_;
+    }
+  }
+}
+
+bool IPReassembler::evict_oldest( const Key& keep )
+{
+  for ( auto expiry = expiry_.begin(); expiry != expiry_.end(); ) {
+    const auto it = partials_.find( expiry->key );
+    if ( it == partials_.end() or it->second.expires != expiry->time ) {
+      expiry = expiry_.erase( expiry ); // stale
+    } else if ( expiry->key == keep ) {
+      ++expiry;
+    } else {
+      expiry_.erase( expiry );
+      forget( it );
+      ++evicted_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void IPReassembler::forget( const unordered_map<Key, Partial, KeyHash>::iterator partial )
+{
+  bytes_buffered_ -= partial->second.charge;
+  partials_.erase( partial );
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "ipv4_datagram.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Split a datagram into fragments that each fit in `mtu` bytes (header included), appending them to
+// `fragments` in order. The fragments' payloads are slices of the datagram's, so nothing is copied.
+// A datagram that is itself a fragment is split further, keeping its offset and its "more fragments"
+// flag on the last piece. The caller should check the "don't fragment" flag first.
+void fragment_datagram( const InternetDatagram& dgram, size_t mtu, std::vector<InternetDatagram>& fragments );
+
+// Reassembles fragmented IPv4 datagrams.
+//
+// Fragments are matched by (source, destination, identification, protocol). For each datagram being
+// reassembled, the reassembler keeps the list of holes still to be filled (RFC 815) and the pieces of
+// payload that have filled the others. A piece is a slice of the fragment it came from, trimmed to the
+// holes it fills, so overlapping or duplicate data is dropped as it arrives, fragments may arrive in
+// any order, and no payload is copied: the reassembled datagram's payload is the list of pieces.
+//
+// Memory is bounded. Each datagram being reassembled is charged for the buffers its pieces keep alive
+// (a piece shares the storage of the fragment it came from, so the whole fragment, headers and all,
+// counts as long as any of it is kept, but storage that several fragments share counts once), plus a
+// fixed overhead for the datagram and each piece. If a
+// fragment takes the total over `max_bytes` (and does not complete its datagram), or starts a datagram
+// when `max_datagrams` are already in progress, the datagrams that have waited longest are given up on
+// until it fits. Datagrams not completed within `timeout_ms` of their first fragment are given up on
+// too, as tick() advances the time. An empty fragment is only taken if it is the last of a datagram
+// already in progress, since it can neither start nor fill one.
+class IPReassembler
+{
+public:
+  explicit IPReassembler( size_t max_bytes = 1 << 20, uint64_t timeout_ms = 30000, size_t max_datagrams = 1024 );
+
+  // Charged for each datagram in progress (its bookkeeping here, roughly), and for each piece on top
+  // of the buffer it keeps alive
+  static constexpr size_t DATAGRAM_OVERHEAD = 256;
+  static constexpr size_t PIECE_OVERHEAD = 64;
+
+  static bool is_fragment( const IPv4Header& header ) { return header.mf or header.offset != 0; }
+
+  // Take a fragment, and return the whole datagram if this was its last missing piece
+  std::optional<InternetDatagram> add( InternetDatagram&& fragment );
+
+  void tick( uint64_t ms_since_last_tick );
+
+  // Memory charged to the datagrams in progress (see above)
+  size_t bytes_buffered() const { return bytes_buffered_; }
+  size_t datagrams_in_progress() const { return partials_.size(); }
+
+  // Datagrams given up on because they took too long, or to make room for others
+  uint64_t timed_out() const { return timed_out_; }
+  uint64_t evicted() const { return evicted_; }
+
+private:
+  struct Key
+  {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t id;
+    uint8_t proto;
+
+    bool operator==( const Key& other ) const = default;
+  };
+
+  struct KeyHash
+  {
+    size_t operator()( const Key& key ) const
+    {
+      const uint64_t x = ( uint64_t { key.src } << 32 | key.dst ) ^ ( uint64_t { key.id } << 8 | key.proto );
+      return x * 0x9E3779B97F4A7C15ULL >> 16;
+    }
+  };
+
+  // Payload bytes [first, end) are missing (end is OPEN_END until the final fragment arrives)
+  struct Hole
+  {
+    uint32_t first;
+    uint32_t end;
+  };
+  static constexpr uint32_t OPEN_END = UINT32_MAX;
+
+  struct Piece
+  {
+    uint32_t offset;
+    Buffer data;
+  };
+
+  static_assert( sizeof( Piece ) <= PIECE_OVERHEAD );
+
+  // Storage kept alive by pieces, and how far into it they reach
+  struct Storage
+  {
+    const char* start;
+    size_t extent;
+  };
+
+  struct Partial
+  {
+    IPv4Header header {}; // of the first fragment, once it has arrived
+    std::vector<Hole> holes { { 0, OPEN_END } };
+    std::vector<Piece> pieces {};
+    std::vector<Storage> storage {};
+    size_t bytes {};  // of payload
+    size_t charge {}; // of memory
+    uint64_t expires {};
+  };
+
+  size_t max_bytes_;
+  uint64_t timeout_ms_;
+  size_t max_datagrams_;
+  uint64_t now_ = 0;
+
+  std::unordered_map<Key, Partial, KeyHash> partials_ {};
+  size_t bytes_buffered_ = 0;
+
+  // When each datagram times out, in order (every datagram gets the same time)
+  struct Expiry
+  {
+    uint64_t time;
+    Key key;
+  };
+  std::deque<Expiry> expiry_ {};
+
+  uint64_t timed_out_ = 0;
+  uint64_t evicted_ = 0;
+
+  // Give up on the datagram that has waited longest (other than `keep`). Returns false if there is none.
+  bool evict_oldest( const Key& keep );
+
+  void forget( std::unordered_map<Key, Partial, KeyHash>::iterator partial );
+};
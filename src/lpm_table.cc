@@ -0,0 +1,234 @@
+#include "lpm_table.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t TBL24_SIZE = 1 << 24;
+
+uint32_t mask( uint8_t prefix_length )
+{
+  return prefix_length == 0 ? 0 : 0xffffffffU << ( 32 - prefix_length );
+}
+
+} // namespace
+
+LPMTable::LPMTable()
+  : tbl24_( static_cast<uint32_t*>( calloc( TBL24_SIZE, sizeof( uint32_t ) ) ) ) // NOLINT(*-no-malloc)
+{
+  if ( not tbl24_ ) {
+    throw bad_alloc();
+  }
+}
+
+LPMTable::LPMTable( const LPMTable& other )
+  : LPMTable()
+{
+  *this = other;
+}
+
+LPMTable& LPMTable::operator=( const LPMTable& other )
+{
+  if ( this != &other ) {
+    if ( not tbl24_ ) {
+      *this = LPMTable();
+    }
+    memcpy( tbl24_.get(), other.tbl24_.get(), TBL24_SIZE * sizeof( uint32_t ) );
+    tbl8_ = other.tbl8_;
+    short_prefixes_ = other.short_prefixes_;
+    free_groups_ = other.free_groups_;
+    rules_ = other.rules_;
+    size_ = other.size_;
+  }
+  return *this;
+}
+
+template<typename Predicate>
+void LPMTable::overwrite( const uint32_t prefix,
+                          const uint8_t prefix_length,
+                          const uint32_t entry,
+                          Predicate should_overwrite )
+{
+  const auto update = [&]( uint32_t& e ) {
+    if ( should_overwrite( e ) ) {
+      e = entry;
+    }
+  };
+
+  if ( prefix_length <= SHORT_PREFIX_MAX ) {
+    const size_t first = prefix >> 24;
+    const size_t count = size_t { 1 } << ( SHORT_PREFIX_MAX - prefix_length );
+    for_each( short_prefixes_.begin() + first, short_prefixes_.begin() + first + count, update );
+    return;
+  }
+
+  if ( prefix_length <= 24 ) {
+    const size_t first = prefix >> 8;
+    const size_t count = size_t { 1 } << ( 24 - prefix_length );
+    for ( size_t i = first; i < first + count; ++i ) {
+      if ( tbl24_[i] & EXTENDED ) {
+        const size_t group = ( tbl24_[i] & VALUE_MASK ) * GROUP_SIZE;
+        for_each( tbl8_.begin() + group, tbl8_.begin() + group + GROUP_SIZE, update );
+      } else {
+        update( tbl24_[i] );
+      }
+    }
+    return;
+  }
+
+  // Longer than /24: only part of one group
+  const uint32_t tbl24_entry = tbl24_[prefix >> 8];
+  if ( not( tbl24_entry & EXTENDED ) ) {
+    throw runtime_error( "LPMTable: missing tbl8 group" );
+  }
+  const size_t first = ( tbl24_entry & VALUE_MASK ) * GROUP_SIZE + ( prefix & 0xff );
+  const size_t count = size_t { 1 } << ( 32 - prefix_length );
+  for_each( tbl8_.begin() + first, tbl8_.begin() + first + count, update );
+}
+
+uint32_t LPMTable::allocate_group( const uint32_t initial_entry )
+{
+  uint32_t group {};
+  if ( free_groups_.empty() ) {
+    group = tbl8_.size() / GROUP_SIZE;
+    if ( group > MAX_VALUE ) {
+      throw runtime_error( "LPMTable: out of tbl8 groups" );
+    }
+    tbl8_.resize( tbl8_.size() + GROUP_SIZE );
+  } else {
+    group = free_groups_.back();
+    free_groups_.pop_back();
+  }
+
+  fill_n( tbl8_.begin() + group * GROUP_SIZE, GROUP_SIZE, initial_entry );
+  return group;
+}
+
+// Fold a group back into its tbl24 entry once no prefix longer than /24 is left in it
+void LPMTable::maybe_collapse_group( const uint32_t tbl24_index )
+{
+  const uint32_t group = tbl24_[tbl24_index] & VALUE_MASK;
+  const auto begin = tbl8_.begin() + group * GROUP_SIZE;
+  const uint32_t first = *begin;
+  if ( depth( first ) > 24 or not all_of( begin, begin + GROUP_SIZE, [first]( uint32_t e ) { return e == first; } ) ) {
+    return;
+  }
+
+  tbl24_[tbl24_index] = first;
+  free_groups_.push_back( group );
+}
+
+void LPMTable::insert( uint32_t prefix, const uint8_t prefix_length, const uint32_t value )
+{
+  if ( prefix_length > 32 ) {
+    throw runtime_error( "LPMTable: prefix length must be at most 32" );
+  }
+  if ( value > MAX_VALUE ) {
+    throw runtime_error( "LPMTable: value out of range" );
+  }
+
+  prefix &= mask( prefix_length );
+  const auto [it, inserted] = rules_.at( prefix_length ).insert_or_assign( prefix, value );
+  size_ += inserted;
+
+  if ( prefix_length > 24 and not( tbl24_[prefix >> 8] & EXTENDED ) ) {
+    const uint32_t group = allocate_group( tbl24_[prefix >> 8] );
+    tbl24_[prefix >> 8] = EXTENDED | group;
+  }
+
+  // Take over the entries held by shorter prefixes (or by this one, if it is being replaced)
+  overwrite( prefix, prefix_length, make_entry( prefix_length, value ), [prefix_length]( uint32_t e ) {
+    return not( e & VALID ) or depth( e ) <= prefix_length;
+  } );
+}
+
+bool LPMTable::erase( uint32_t prefix, const uint8_t prefix_length )
+{
+  if ( prefix_length > 32 ) {
+    return false;
+  }
+
+  prefix &= mask( prefix_length );
+  if ( not rules_.at( prefix_length ).erase( prefix ) ) {
+    return false;
+  }
+  --size_;
+
+  // The entries go back to the next-longest prefix that covers this one (or to nothing). Short
+  // prefixes live in a table of their own, so tbl24 entries only ever fall back to a longer one.
+  const int shortest = prefix_length > SHORT_PREFIX_MAX ? SHORT_PREFIX_MAX + 1 : 0;
+  uint32_t fallback = 0;
+  for ( int len = prefix_length - 1; len >= shortest; --len ) {
+    const auto& rules = rules_.at( len );
+    const auto it = rules.find( prefix & mask( len ) );
+    if ( it != rules.end() ) {
+      fallback = make_entry( len, it->second );
+      break;
+    }
+  }
+
+  overwrite( prefix, prefix_length, fallback, [prefix_length]( uint32_t e ) {
+    return ( e & VALID ) and depth( e ) == prefix_length;
+  } );
+
+  if ( prefix_length > 24 ) {
+    maybe_collapse_group( prefix >> 8 );
+  }
+
+  return true;
+}
+
+void LPMTable::lookup( span<const uint32_t> addresses, span<uint32_t> results ) const
+{
+  if ( results.size() < addresses.size() ) {
+    throw runtime_error( "LPMTable: not enough room for lookup results" );
+  }
+
+  constexpr size_t chunk = 32;
+  array<uint32_t, chunk> entries {};
+
+  for ( size_t base = 0; base < addresses.size(); base += chunk ) {
+    const size_t n = min( chunk, addresses.size() - base );
+    const uint32_t* const address = addresses.data() + base;
+
+    for ( size_t i = 0; i < n; ++i ) {
+      __builtin_prefetch( &tbl24_[address[i] >> 8] );
+    }
+
+    for ( size_t i = 0; i < n; ++i ) {
+      entries[i] = tbl24_[address[i] >> 8];
+      if ( entries[i] & EXTENDED ) {
+        __builtin_prefetch( &tbl8_[( entries[i] & VALUE_MASK ) * GROUP_SIZE + ( address[i] & 0xff )] );
+      }
+    }
+
+    for ( size_t i = 0; i < n; ++i ) {
+      uint32_t entry = entries[i];
+      if ( entry & EXTENDED ) {
+        entry = tbl8_[( entry & VALUE_MASK ) * GROUP_SIZE + ( address[i] & 0xff )];
+      }
+      if ( not( entry & VALID ) ) {
+        entry = short_prefixes_[address[i] >> 24];
+      }
+      results[base + i] = entry & VALID ? entry & VALUE_MASK : NO_MATCH;
+    }
+  }
+}
+
+optional<uint32_t> LPMTable::find( uint32_t prefix, const uint8_t prefix_length ) const
+{
+  if ( prefix_length > 32 ) {
+    return {};
+  }
+
+  const auto& rules = rules_.at( prefix_length );
+  const auto it = rules.find( prefix & mask( prefix_length ) );
+  if ( it == rules.end() ) {
+    return {};
+  }
+  return it->second;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// A longest-prefix-match table from IPv4 prefixes to (24-bit) values, in the DIR-24-8 layout
+// (Gupta, Lin and McKeown, "Routing Lookups in Hardware at Memory Access Speeds", 1998).
+//
+// A lookup is one load from a table indexed by the top 24 bits of the address, plus a second load
+// from a 256-entry group when some prefix longer than /24 covers that part of the table. Each entry
+// remembers the length of the prefix that filled it, which is what lets prefixes be added and
+// removed one at a time: a new prefix only overwrites entries that came from a shorter one, and a
+// removed prefix's entries fall back to the next-longest prefix that covers them.
+//
+// Prefixes of /8 or shorter (a default route, say) would each fill at least 2^16 entries of tbl24, and a
+// /0 all 2^24 of them, so they are kept in a separate 256-entry table indexed by the top 8 bits instead.
+// A lookup that finds nothing in tbl24 (or its group) takes its answer from there.
+class LPMTable
+{
+public:
+  static constexpr uint32_t MAX_VALUE = ( 1U << 24 ) - 1;
+
+  LPMTable();
+
+  // Copying duplicates the whole table, including the 64 MiB tbl24
+  LPMTable( const LPMTable& other );
+  LPMTable& operator=( const LPMTable& other );
+  LPMTable( LPMTable&& other ) noexcept = default;
+  LPMTable& operator=( LPMTable&& other ) noexcept = default;
+  ~LPMTable() = default;
+
+  // Add a prefix, or replace its value if it is already present. Bits of `prefix` beyond
+  // `prefix_length` are ignored.
+  void insert( uint32_t prefix, uint8_t prefix_length, uint32_t value );
+
+  // Remove a prefix. Returns false if it was not present.
+  bool erase( uint32_t prefix, uint8_t prefix_length );
+
+  // The value stored for exactly this prefix, if any
+  std::optional<uint32_t> find( uint32_t prefix, uint8_t prefix_length ) const;
+
+  // The value of the longest prefix that matches `address`, if any
+  std::optional<uint32_t> lookup( const uint32_t address ) const
+  {
+    uint32_t entry = tbl24_[address >> 8];
+    if ( entry & EXTENDED ) {
+      entry = tbl8_[( entry & VALUE_MASK ) * GROUP_SIZE + ( address & 0xff )];
+    }
+    if ( not( entry & VALID ) ) {
+      entry = short_prefixes_[address >> 24];
+      if ( not( entry & VALID ) ) {
+        return {};
+      }
+    }
+    return entry & VALUE_MASK;
+  }
+
+  // Look up a burst of addresses at once: results[i] is the value for addresses[i], or NO_MATCH. The
+  // table entries for the whole burst are prefetched before any of them is used, so their cache misses
+  // overlap instead of being taken one after another.
+  static constexpr uint32_t NO_MATCH = 0xffffffff;
+  void lookup( std::span<const uint32_t> addresses, std::span<uint32_t> results ) const;
+
+  // Number of prefixes in the table
+  size_t size() const { return size_; }
+
+  // Number of 256-entry tbl8 groups in use (one for each /24 that some longer prefix falls in)
+  size_t groups() const { return tbl8_.size() / GROUP_SIZE - free_groups_.size(); }
+
+private:
+  // An entry is VALID | depth << DEPTH_SHIFT | value, or EXTENDED | index of a group in tbl8_
+  static constexpr uint32_t VALID = 1U << 31;
+  static constexpr uint32_t EXTENDED = 1U << 30;
+  static constexpr uint32_t DEPTH_SHIFT = 24;
+  static constexpr uint32_t VALUE_MASK = MAX_VALUE;
+  static constexpr size_t GROUP_SIZE = 256;
+  static constexpr uint8_t SHORT_PREFIX_MAX = 8;
+
+  static uint32_t make_entry( uint8_t depth, uint32_t value ) { return VALID | depth << DEPTH_SHIFT | value; }
+  static uint8_t depth( uint32_t entry ) { return entry >> DEPTH_SHIFT & 0x3f; }
+
+  // calloc()'d so that the 64 MiB table is backed by zero pages until first written
+  struct FreeDeleter
+  {
+    void operator()( uint32_t* p ) const { free( p ); } // NOLINT(*-no-malloc)
+  };
+  std::unique_ptr<uint32_t[], FreeDeleter> tbl24_; // NOLINT(*-avoid-c-arrays)
+
+  std::vector<uint32_t> tbl8_ {};
+  std::array<uint32_t, 256> short_prefixes_ {};
+  std::vector<uint32_t> free_groups_ {};
+
+  // The prefixes themselves, by length, for find() and for the fallback when a prefix is removed
+  std::array<std::unordered_map<uint32_t, uint32_t>, 33> rules_ {};
+  size_t size_ {};
+
+  // Set each (non-extended) entry covered by the prefix (in short_prefixes_ if it is /8 or shorter,
+  // otherwise in tbl24 and tbl8) to `entry` if should_overwrite( old entry )
+  template<typename Predicate>
+  void overwrite( uint32_t prefix, uint8_t prefix_length, uint32_t entry, Predicate should_overwrite );
+
+  uint32_t allocate_group( uint32_t initial_entry );
+  void maybe_collapse_group( uint32_t tbl24_index );
+};
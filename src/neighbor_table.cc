@@ -0,0 +1,131 @@
+#include "neighbor_table.hh"
+
+#include <bit>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t INITIAL_CAPACITY = 16;
+
+} // namespace
+
+NeighborTable::NeighborTable()
+  : entries_( INITIAL_CAPACITY ), shift_( 64 - countr_zero( INITIAL_CAPACITY ) )
+{}
+
+NeighborTable::Entry* NeighborTable::find( const uint32_t ip )
+{
+  for ( size_t i = home( ip );; i = ( i + 1 ) & mask() ) {
+    Entry& entry = entries_[i];
+    if ( not entry.occupied ) {
+      return nullptr;
+    }
+    if ( entry.ip == ip ) {
+      return &entry;
+    }
+  }
+}
+
+NeighborTable::Entry& NeighborTable::operator[]( const uint32_t ip )
+{
+  while ( true ) {
+    for ( size_t i = home( ip );; i = ( i + 1 ) & mask() ) {
+      Entry& entry = entries_[i];
+      if ( entry.occupied and entry.ip == ip ) {
+        return entry;
+      }
+      if ( not entry.occupied ) {
+        // Keep the table at most half full, so probe sequences stay short
+        if ( ( size_ + 1 ) * 2 > entries_.size() ) {
+          break;
+        }
+        entry = { ip, true, false, false, false, {}, 0, 0, 0, 0, NONE, NONE, 0, 0 };
+        ++size_;
+        return entry;
+      }
+    }
+    grow();
+  }
+}
+
+void NeighborTable::erase( const uint32_t ip )
+{
+  Entry* const found = find( ip );
+  if ( not found ) {
+    return;
+  }
+  clear_pending( *found );
+  --size_;
+
+  // Backward-shift deletion: move later entries of the same probe run into the hole, as long as that
+  // keeps them at or after their home slot
+  size_t hole = found - entries_.data();
+  for ( size_t i = ( hole + 1 ) & mask();; i = ( i + 1 ) & mask() ) {
+    Entry& entry = entries_[i];
+    if ( not entry.occupied ) {
+      break;
+    }
+    const size_t distance_from_home = ( i - home( entry.ip ) ) & mask();
+    const size_t distance_to_hole = ( i - hole ) & mask();
+    if ( distance_from_home >= distance_to_hole ) {
+      entries_[hole] = entry;
+      hole = i;
+    }
+  }
+  entries_[hole].occupied = false;
+}
+
+void NeighborTable::grow()
+{
+  vector<Entry> old( entries_.size() * 2 );
+  old.swap( entries_ );
+  --shift_;
+
+  for ( const Entry& entry : old ) {
+    if ( entry.occupied ) {
+      size_t i = home( entry.ip );
+      while ( entries_[i].occupied ) {
+        i = ( i + 1 ) & mask();
+      }
+      entries_[i] = entry;
+    }
+  }
+}
+
+void NeighborTable::enqueue( Entry& entry, EthernetFrame&& frame )
+{
+  uint32_t slot {};
+  if ( free_slots_.empty() ) {
+    slot = pool_.size();
+    pool_.emplace_back();
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  pool_[slot] = { std::move( frame ), NONE };
+
+  if ( entry.pending_tail == NONE ) {
+    entry.pending_head = slot;
+  } else {
+    pool_[entry.pending_tail].next = slot;
+  }
+  entry.pending_tail = slot;
+  ++entry.pending_count;
+  ++pending_total_;
+}
+
+void NeighborTable::drop_oldest( Entry& entry )
+{
+  if ( entry.pending_head == NONE ) {
+    return;
+  }
+  const uint32_t slot = entry.pending_head;
+  entry.pending_head = pool_[slot].next;
+  if ( entry.pending_head == NONE ) {
+    entry.pending_tail = NONE;
+  }
+  free_slot( slot );
+  --entry.pending_count;
+  --pending_total_;
+}
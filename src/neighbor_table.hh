@@ -0,0 +1,109 @@
+#pragma once
+
+#include "ethernet_frame.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What a NetworkInterface knows about each of its neighbors (next hops), keyed by IPv4 address: the
+// neighbor's Ethernet address if it has been learned, whether an ARP request for it is outstanding,
+// and the frames waiting for its Ethernet address.
+//
+// The entries live inline in one flat array, found by open addressing with linear probing, so looking
+// up a neighbor is one hash and (almost always) one cache line. Removing an entry shifts the entries
+// after it back into place instead of leaving a tombstone, so probe sequences stay short no matter how
+// many neighbors come and go. The frames waiting for each neighbor form a linked list through a shared
+// pool of slots, of which the entry holds the head and tail.
+class NeighborTable
+{
+public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  struct Entry
+  {
+    uint32_t ip;
+    bool occupied;            // whether this slot holds an entry at all
+    bool resolved;            // whether `eth` is known
+    bool request_outstanding; // whether an ARP request is outstanding
+    bool request_deferred;    // whether an ARP request is waiting for the rate limit to allow it
+    EthernetAddress eth;
+    uint64_t mapping_expires; // when `eth` expires, if resolved
+    uint64_t request_expires; // when the ARP request may be resent, if outstanding
+    uint64_t retry_after;     // after `arp_failures` unanswered requests: when to try again
+    uint64_t failure_expires; // ... and when to forget the failures if nothing has tried again
+    uint32_t pending_head;    // first frame waiting for `eth` (an index into the pool), or NONE
+    uint32_t pending_tail;    // last such frame, or NONE
+    uint32_t pending_count;   // number of such frames
+    uint32_t arp_failures;    // ARP requests in a row that went unanswered (if negatively cached)
+  };
+
+  NeighborTable();
+
+  // The entry for `ip`, or nullptr if there is none
+  Entry* find( uint32_t ip );
+
+  // The entry for `ip`, added (unresolved, with nothing outstanding or pending) if there was none.
+  // Adding may move every entry, so pointers and references to entries are invalidated.
+  Entry& operator[]( uint32_t ip );
+
+  // Remove the entry for `ip` (and drop any frames waiting for it), if there is one. Removing may move
+  // other entries, so pointers and references to entries are invalidated.
+  void erase( uint32_t ip );
+
+  // Queue a frame to wait for the entry's Ethernet address
+  void enqueue( Entry& entry, EthernetFrame&& frame );
+
+  // Drop the oldest of the entry's waiting frames (if any)
+  void drop_oldest( Entry& entry );
+
+  // Hand each of the entry's waiting frames to `release`, in order, and empty its queue
+  template<typename Release>
+  void release_pending( Entry& entry, Release&& release )
+  {
+    while ( entry.pending_head != NONE ) {
+      const uint32_t slot = entry.pending_head;
+      entry.pending_head = pool_[slot].next;
+      release( std::move( pool_[slot].frame ) );
+      free_slot( slot );
+    }
+    entry.pending_tail = NONE;
+    pending_total_ -= entry.pending_count;
+    entry.pending_count = 0;
+  }
+
+  // Drop the entry's waiting frames
+  void clear_pending( Entry& entry )
+  {
+    release_pending( entry, []( EthernetFrame&& /* frame */ ) {} );
+  }
+
+  size_t size() const { return size_; }
+
+  // Number of frames waiting, for all entries together
+  size_t pending_total() const { return pending_total_; }
+
+private:
+  std::vector<Entry> entries_;
+  size_t size_ {};
+  int shift_ {}; // 64 - log2( entries_.size() )
+
+  size_t home( uint32_t ip ) const { return ( ip * 0x9E3779B97F4A7C15ULL ) >> shift_; }
+  size_t mask() const { return entries_.size() - 1; }
+  void grow();
+
+  struct PendingFrame
+  {
+    EthernetFrame frame {};
+    uint32_t next {};
+  };
+  std::vector<PendingFrame> pool_ {};
+  std::vector<uint32_t> free_slots_ {};
+  size_t pending_total_ {};
+
+  void free_slot( uint32_t slot )
+  {
+    pool_[slot].frame = {};
+    free_slots_.push_back( slot );
+  }
+};
@@ -2,16 +2,48 @@
 
 #include "arp_message.hh"
 #include "ethernet_frame.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <iterator>
 
 using namespace std;
 
+namespace {
+
+// An Ethernet address as a number, for trace records
+uint64_t to_number( const EthernetAddress& address )
+{
+  uint64_t number = 0;
+  for ( const uint8_t byte : address ) {
+    number = number << 8 | byte;
+  }
+  return number;
+}
+
+} // namespace
+
 // ethernet_address: Ethernet (what ARP calls "hardware") address of the interface
 // ip_address: IP (what ARP calls "protocol") address of the interface
 NetworkInterface::NetworkInterface( const EthernetAddress& ethernet_address, const Address& ip_address )
-  : ethernet_address_( ethernet_address ), ip_address_( ip_address )
+  : NetworkInterface( ethernet_address, ip_address, {} )
+{}
+
+// config: limits on the frames waiting for ARP replies, and how ARP requests are sent and answered
+NetworkInterface::NetworkInterface( const EthernetAddress& ethernet_address,
+                                    const Address& ip_address,
+                                    const Config& config )
+  : ethernet_address_( ethernet_address )
+  , ip_address_( ip_address )
+  , config_( config )
+  , arp_tokens_( config.arp_request_burst * 1000 )
+  , reassembler_( config.reassembly_max_bytes, config.reassembly_timeout_ms, config.reassembly_max_datagrams )
 {
-  cerr << "DEBUG: Network interface has Ethernet address " << to_string( ethernet_address_ ) << " and IP address "
-       << ip_address.ip() << "\n";
+  MINNOW_TRACE( Info, InterfaceCreated, ip_address_.ipv4_numeric(), to_number( ethernet_address_ ) );
+
+  if ( config_.announce_on_start ) {
+    send_gratuitous_arp();
+  }
 }
 
 // Construct an Ethernet frame
@@ -24,7 +56,7 @@ EthernetFrame NetworkInterface::make_eth_frame( const EthernetAddress& src,
   frame.header.src = src;
   frame.header.dst = dst;
   frame.header.type = type;
-  frame.payload = payload;
+  frame.payload = std::move( payload );
   return frame;
 }
 
@@ -48,32 +80,76 @@ ARPMessage NetworkInterface::make_arp_msg( uint32_t target_ip,
 
 void NetworkInterface::send_datagram( const InternetDatagram& dgram, const Address& next_hop )
 {
-  uint32_t next_hop_numeric = next_hop.ipv4_numeric();
+  if ( dgram.serialized_length() <= config_.mtu ) {
+    send_unfragmented( dgram, next_hop );
+    return;
+  }
 
-  EthernetFrame eth_frame;
-  EthernetFrame request_frame
-    = make_eth_frame( ethernet_address_, ETHERNET_BROADCAST, EthernetHeader::TYPE_IPv4, serialize( dgram ) );
+  // Too big for the link: split it into fragments, unless that isn't allowed
+  if ( dgram.header.df ) {
+    ++oversize_dropped_;
+    MINNOW_TRACE( Info, DatagramTooBig, dgram.header.dst, dgram.serialized_length() );
+    if ( path_mtu_ ) {
+      path_mtu_->too_big( dgram.header.dst, dgram.serialized_length(), config_.mtu );
+    }
+    return;
+  }
+  fragments_.clear();
+  fragment_datagram( dgram, config_.mtu, fragments_ );
+  for ( const auto& fragment : fragments_ ) {
+    send_unfragmented( fragment, next_hop );
+  }
+}
+
+void NetworkInterface::send_unfragmented( const InternetDatagram& dgram, const Address& next_hop )
+{
+  uint32_t next_hop_numeric = next_hop.ipv4_numeric();
+  NeighborTable::Entry& neighbor = neighbors_[next_hop_numeric];
 
   // Check if Ethernet address for next hop is known
-  if ( ethernet_map.find( next_hop_numeric ) != ethernet_map.end() ) {
+  if ( neighbor.resolved ) {
     // If known, create frame and push to send queue
-    eth_frame = make_eth_frame(
-      ethernet_address_, ethernet_map[next_hop_numeric].eth, EthernetHeader::TYPE_IPv4, serialize( dgram ) );
-    send_queue.push_back( eth_frame );
+    send_queue.push_back( make_eth_frame( ethernet_address_,
+                                          neighbor.eth,
+                                          EthernetHeader::TYPE_IPv4,
+                                          { serialize_contiguous( dgram, EthernetHeader::LENGTH ) } ) );
+
+    // If the mapping is about to expire, ask the neighbor directly to refresh it
+    if ( neighbor.mapping_expires - now_ < config_.arp_refresh_window_ms and not neighbor.request_outstanding ) {
+      send_arp_request( neighbor, neighbor.eth );
+    }
   } else {
-    // If unknown, create ARP request for next hop
-    ARPMessage arp_msg = make_arp_msg(
-      next_hop_numeric, ip_address_.ipv4_numeric(), {}, ethernet_address_, ARPMessage::OPCODE_REQUEST );
-    eth_frame
-      = make_eth_frame( ethernet_address_, ETHERNET_BROADCAST, EthernetHeader::TYPE_ARP, serialize( arp_msg ) );
-
-    // If no previous ARP request pending, send request and record in arp_timeout
-    if ( arp_timeout.find( next_hop_numeric ) == arp_timeout.end() ) {
-      send_queue.push_back( eth_frame );
-      arp_timeout[next_hop_numeric] = 0;
+    // If the neighbor recently failed to answer, don't ask again yet
+    if ( neighbor.arp_failures > 0 and now_ < neighbor.retry_after ) {
+      ++unreachable_dropped_;
+      return;
+    }
+
+    // If no previous ARP request pending, send an ARP request for the next hop and record it (or, if
+    // the rate limit does not allow one now, have tick() send it later)
+    if ( not neighbor.request_outstanding and not neighbor.request_deferred
+         and not send_arp_request( neighbor, ETHERNET_BROADCAST ) ) {
+      neighbor.request_deferred = true;
+      deferred_requests_.push_back( neighbor.ip );
+      ++arp_requests_deferred_;
+    }
+    // Make room if too many frames are waiting already (for this neighbor, or in all)
+    if ( neighbor.pending_count >= config_.max_pending_per_neighbor
+         or neighbors_.pending_total() >= config_.max_pending ) {
+      ++pending_dropped_;
+      MINNOW_TRACE( Info, PendingFrameDropped, neighbor.ip, neighbors_.pending_total() );
+      if ( config_.pending_drop_policy == Config::DropPolicy::DropNewest or neighbor.pending_count == 0 ) {
+        return;
+      }
+      neighbors_.drop_oldest( neighbor );
     }
-    // Save the original datagram in arp_waiting queue until ARP reply is received
-    arp_waiting[next_hop_numeric].push_back( request_frame );
+
+    // Save the original datagram until the ARP reply is received
+    EthernetFrame request_frame = make_eth_frame( ethernet_address_,
+                                                  ETHERNET_BROADCAST,
+                                                  EthernetHeader::TYPE_IPv4,
+                                                  { serialize_contiguous( dgram, EthernetHeader::LENGTH ) } );
+    neighbors_.enqueue( neighbor, std::move( request_frame ) );
   }
 }
 
@@ -87,8 +163,12 @@ optional<InternetDatagram> NetworkInterface::recv_frame( const EthernetFrame& fr
   // Try to parse frame payload as an IPv4 datagram
   InternetDatagram ipv4_datagram;
   if ( frame.header.type == EthernetHeader::TYPE_IPv4 && parse( ipv4_datagram, frame.payload ) ) {
+    // If it is a fragment, return the whole datagram once all its fragments have arrived
+    if ( config_.reassemble_fragments and IPReassembler::is_fragment( ipv4_datagram.header ) ) {
+      return reassembler_.add( std::move( ipv4_datagram ) );
+    }
     // If successful, return the parsed datagram
-    return std::optional<InternetDatagram> { ipv4_datagram };
+    return std::optional<InternetDatagram> { std::move( ipv4_datagram ) };
   }
 
   // Try to parse frame payload as an ARP message
@@ -98,23 +178,24 @@ optional<InternetDatagram> NetworkInterface::recv_frame( const EthernetFrame& fr
     return std::nullopt;
   }
 
-  // Update the Ethernet information associated with the sender IP in the Ethernet map
-  EthernetInfo& ethernet_info = ethernet_map[arp_message.sender_ip_address];
-  ethernet_info.eth = arp_message.sender_ethernet_address;
-  ethernet_info.time = 0;
-
-  // If there are any frames waiting for an ARP reply from this sender IP
-  if ( arp_waiting.count( arp_message.sender_ip_address ) ) {
-    // Update destination Ethernet address of all waiting frames to the sender's Ethernet address and push to send
-    // queue
-    for ( EthernetFrame& queued_frame : arp_waiting[arp_message.sender_ip_address] ) {
-      queued_frame.header.dst = ethernet_info.eth;
-      send_queue.push_back( queued_frame );
-    }
-    // Clear the list of waiting frames for this sender IP
-    arp_waiting[arp_message.sender_ip_address].clear();
+  // Gratuitous ARP (an announcement of the sender's own mapping) only updates what is known already,
+  // unless configured to learn new neighbors from it
+  if ( arp_message.sender_ip_address == arp_message.target_ip_address and not config_.accept_gratuitous_arp
+       and not neighbors_.find( arp_message.sender_ip_address ) ) {
+    return std::nullopt;
   }
 
+  // Update the Ethernet information associated with the sender IP
+  NeighborTable::Entry& sender
+    = remember_mapping( arp_message.sender_ip_address, arp_message.sender_ethernet_address );
+
+  // Address any frames waiting for an ARP reply from this sender IP to the sender's Ethernet address,
+  // and push them to the send queue
+  neighbors_.release_pending( sender, [&]( EthernetFrame&& queued_frame ) {
+    queued_frame.header.dst = arp_message.sender_ethernet_address;
+    send_queue.push_back( std::move( queued_frame ) );
+  } );
+
   // If the target IP of the ARP message matches our IP and the opcode indicates an ARP request
   if ( arp_message.target_ip_address == ip_address_.ipv4_numeric()
        && arp_message.opcode == ARPMessage::OPCODE_REQUEST ) {
@@ -124,46 +205,162 @@ optional<InternetDatagram> NetworkInterface::recv_frame( const EthernetFrame& fr
                                                  { frame.header.src },
                                                  ethernet_address_,
                                                  ARPMessage::OPCODE_REPLY );
-    EthernetFrame arp_reply_frame = make_eth_frame( ethernet_address_,
-                                                    arp_message.sender_ethernet_address,
-                                                    EthernetHeader::TYPE_ARP,
-                                                    serialize( arp_reply_message ) );
-    send_queue.push_back( arp_reply_frame );
-    arp_timeout[arp_message.target_ip_address] = 0; // Reset the ARP timeout for the target IP
+    EthernetFrame arp_reply_frame
+      = make_eth_frame( ethernet_address_,
+                        arp_message.sender_ethernet_address,
+                        EthernetHeader::TYPE_ARP,
+                        { serialize_contiguous( arp_reply_message, EthernetHeader::LENGTH ) } );
+    send_queue.push_back( std::move( arp_reply_frame ) );
+    remember_arp_request( neighbors_[arp_message.target_ip_address] ); // Reset the ARP timeout for the target IP
   }
 
   // If we got this far, there's no IPv4 datagram to return, so return nullopt
   return std::nullopt;
 }
 
+NeighborTable::Entry& NetworkInterface::remember_mapping( const uint32_t ip, const EthernetAddress& eth )
+{
+  NeighborTable::Entry& neighbor = neighbors_[ip];
+  neighbor.resolved = true;
+  neighbor.eth = eth;
+  neighbor.arp_failures = 0;
+  neighbor.mapping_expires = now_ + MAPPING_THRESHOLD;
+  MINNOW_TRACE( Debug, ArpMappingLearned, ip, to_number( eth ) );
+  mapping_expiry_.push_back( { neighbor.mapping_expires, ip } );
+  return neighbor;
+}
+
+void NetworkInterface::remember_arp_request( NeighborTable::Entry& neighbor )
+{
+  neighbor.request_outstanding = true;
+  neighbor.request_expires = now_ + RESEND_THRESHOLD;
+  arp_timeout_expiry_.push_back( { neighbor.request_expires, neighbor.ip } );
+}
+
+// Negatively cache a neighbor whose ARP request went unanswered: drop what was waiting for it, and
+// wait before asking again, twice as long as last time. The failures are forgotten if nothing asks
+// again within one more backoff period after that.
+void NetworkInterface::remember_arp_failure( NeighborTable::Entry& neighbor )
+{
+  unreachable_dropped_ += neighbor.pending_count;
+  neighbors_.clear_pending( neighbor );
+
+  const int doublings = static_cast<int>( min( neighbor.arp_failures, 31U ) );
+  const uint64_t backoff = min( config_.arp_negative_cache_ms << doublings, config_.arp_max_backoff_ms );
+  ++neighbor.arp_failures;
+  neighbor.retry_after = now_ + backoff;
+  neighbor.failure_expires = neighbor.retry_after + backoff;
+  failure_expiry_.push( { neighbor.failure_expires, neighbor.ip } );
+  MINNOW_TRACE( Info, ArpRequestFailed, neighbor.ip, neighbor.arp_failures );
+}
+
+bool NetworkInterface::send_arp_request( NeighborTable::Entry& neighbor, const EthernetAddress& destination )
+{
+  if ( config_.arp_requests_per_second > 0 ) {
+    if ( arp_tokens_ < 1000 ) {
+      return false;
+    }
+    arp_tokens_ -= 1000;
+  }
+
+  const optional<EthernetAddress> target_eth
+    = destination == ETHERNET_BROADCAST ? optional<EthernetAddress> {} : destination;
+  ARPMessage arp_msg = make_arp_msg(
+    neighbor.ip, ip_address_.ipv4_numeric(), target_eth, ethernet_address_, ARPMessage::OPCODE_REQUEST );
+  send_queue.push_back( make_eth_frame( ethernet_address_,
+                                        destination,
+                                        EthernetHeader::TYPE_ARP,
+                                        { serialize_contiguous( arp_msg, EthernetHeader::LENGTH ) } ) );
+  remember_arp_request( neighbor );
+  neighbor.request_deferred = false;
+  MINNOW_TRACE( Debug, ArpRequestSent, neighbor.ip, destination != ETHERNET_BROADCAST );
+  return true;
+}
+
+void NetworkInterface::send_gratuitous_arp()
+{
+  const uint32_t ip = ip_address_.ipv4_numeric();
+  const ARPMessage arp_msg = make_arp_msg( ip, ip, {}, ethernet_address_, ARPMessage::OPCODE_REQUEST );
+  send_queue.push_back( make_eth_frame( ethernet_address_,
+                                        ETHERNET_BROADCAST,
+                                        EthernetHeader::TYPE_ARP,
+                                        { serialize_contiguous( arp_msg, EthernetHeader::LENGTH ) } ) );
+}
+
+void NetworkInterface::maybe_forget( const NeighborTable::Entry& neighbor )
+{
+  if ( not neighbor.resolved and not neighbor.request_outstanding and neighbor.pending_head == NeighborTable::NONE
+       and neighbor.arp_failures == 0 ) {
+    neighbors_.erase( neighbor.ip );
+  }
+}
+
 void NetworkInterface::tick( const size_t ms_since_last_tick )
 {
-  if ( !ethernet_map.empty() ) {
-    std::unordered_map<uint32_t, EthernetInfo> temp_map; // Temporary map to hold updated entries
-
-    for ( const auto& pair : ethernet_map ) {
-      // If the current mapping's time is within the 30-second threshold, update and add it to temp_map
-      if ( pair.second.time + ms_since_last_tick <= MAPPING_THRESHOLD ) {
-        EthernetInfo new_info = { pair.second.eth, pair.second.time + ms_since_last_tick };
-        temp_map.insert( { pair.first, new_info } );
-      } else {
-        // If the mapping is older than the threshold, remove it from arp_waiting as we are no longer waiting
-        arp_waiting.erase( pair.first );
+  now_ += ms_since_last_tick;
+  reassembler_.tick( ms_since_last_tick );
+  if ( path_mtu_ ) {
+    path_mtu_->tick( ms_since_last_tick );
+  }
+
+  // Refill the ARP request bucket, and send the requests that were waiting for it
+  if ( config_.arp_requests_per_second > 0 ) {
+    arp_tokens_ = min( arp_tokens_ + ms_since_last_tick * config_.arp_requests_per_second,
+                       config_.arp_request_burst * 1000 );
+    while ( not deferred_requests_.empty() and arp_tokens_ >= 1000 ) {
+      NeighborTable::Entry* neighbor = neighbors_.find( deferred_requests_.front() );
+      deferred_requests_.pop_front();
+      if ( neighbor and neighbor->request_deferred ) {
+        neighbor->request_deferred = false;
+        if ( not neighbor->resolved and not neighbor->request_outstanding ) {
+          send_arp_request( *neighbor, ETHERNET_BROADCAST );
+        }
       }
     }
-    ethernet_map.swap( temp_map ); // Replace ethernet_map with the updated mappings from temp_map
   }
 
-  // If arp_timeout is not empty, update it
-  if ( !arp_timeout.empty() ) {
-    std::unordered_map<uint32_t, size_t> temp_arp; // Temporary map to hold updated entries again
-    for ( auto pair : arp_timeout ) {
-      // If the current mapping's time is within the 5-second threshold, update and add it to temp_arp
-      if ( pair.second + ms_since_last_tick <= RESEND_THRESHOLD ) {
-        temp_arp.insert( { pair.first, pair.second + ms_since_last_tick } );
+  // Remove the mappings that are older than the 30-second threshold
+  while ( not mapping_expiry_.empty() and mapping_expiry_.front().time < now_ ) {
+    const Expiry expiry = mapping_expiry_.front();
+    mapping_expiry_.pop_front();
+    NeighborTable::Entry* neighbor = neighbors_.find( expiry.ip );
+    if ( neighbor and neighbor->resolved and neighbor->mapping_expires == expiry.time ) { // (not refreshed since)
+      neighbor->resolved = false;
+      MINNOW_TRACE( Debug, ArpMappingExpired, expiry.ip );
+      // A request still outstanding was a refresh sent to the old Ethernet address, which the neighbor
+      // has not answered; let the next datagram broadcast a new one
+      neighbor->request_outstanding = false;
+      // We are no longer waiting for this mapping, so drop anything queued for it
+      neighbors_.clear_pending( *neighbor );
+      maybe_forget( *neighbor );
+    }
+  }
+
+  // Forget the ARP requests that are older than the 5-second threshold, so that they may be resent
+  while ( not arp_timeout_expiry_.empty() and arp_timeout_expiry_.front().time < now_ ) {
+    const Expiry expiry = arp_timeout_expiry_.front();
+    arp_timeout_expiry_.pop_front();
+    NeighborTable::Entry* neighbor = neighbors_.find( expiry.ip );
+    if ( neighbor and neighbor->request_outstanding and neighbor->request_expires == expiry.time ) {
+      neighbor->request_outstanding = false;
+      if ( config_.arp_negative_cache_ms > 0 and not neighbor->resolved
+           and neighbor->ip != ip_address_.ipv4_numeric() ) {
+        remember_arp_failure( *neighbor );
       }
+      maybe_forget( *neighbor );
+    }
+  }
+
+  // Forget the failures of negatively cached neighbors that nothing has tried to reach again
+  while ( not failure_expiry_.empty() and failure_expiry_.top().time < now_ ) {
+    const Expiry expiry = failure_expiry_.top();
+    failure_expiry_.pop();
+    NeighborTable::Entry* neighbor = neighbors_.find( expiry.ip );
+    if ( neighbor and neighbor->arp_failures > 0 and not neighbor->request_outstanding
+         and neighbor->failure_expires == expiry.time ) {
+      neighbor->arp_failures = 0;
+      maybe_forget( *neighbor );
     }
-    arp_timeout.swap( temp_arp ); // Replace arp_timeout with the updated mappings from temp_arp again
   }
 }
 
@@ -171,9 +368,18 @@ optional<EthernetFrame> NetworkInterface::maybe_send()
 {
   // If there are frames in the send_queue
   if ( !send_queue.empty() ) {
-    EthernetFrame frame = send_queue.front(); // Get the next frame in the queue
-    send_queue.pop_front();                   // Remove the sent frame from the queue
-    return { frame };
+    EthernetFrame frame = std::move( send_queue.front() ); // Get the next frame in the queue
+    send_queue.pop_front();                                // Remove the sent frame from the queue
+    return frame;
   }
   return {}; // If no frames are ready to be sent, return an empty optional
 }
+
+size_t NetworkInterface::maybe_send( vector<EthernetFrame>& frames, const size_t max_frames )
+{
+  const size_t count = min( max_frames, send_queue.size() );
+  const auto end = send_queue.begin() + static_cast<ptrdiff_t>( count );
+  frames.insert( frames.end(), make_move_iterator( send_queue.begin() ), make_move_iterator( end ) );
+  send_queue.erase( send_queue.begin(), end );
+  return count;
+}
@@ -3,11 +3,16 @@
 #include "address.hh"
 #include "arp_message.hh"
 #include "ethernet_frame.hh"
+#include "ip_fragmentation.hh"
 #include "ipv4_datagram.hh"
+#include "neighbor_table.hh"
+#include "path_mtu_cache.hh"
 
 #include <deque>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <memory>
 #include <optional>
 #include <queue>
 #include <unordered_map>
@@ -38,6 +43,60 @@ using namespace std;
 // and learns or replies as necessary.
 class NetworkInterface
 {
+public:
+  struct Config
+  {
+    // Caps on the number of frames waiting for ARP replies: for any one neighbor, and in all
+    size_t max_pending_per_neighbor = 64;
+    size_t max_pending = 4096;
+
+    // Which frame to drop when a pending queue is full: the new one, or the oldest one waiting for
+    // the same neighbor
+    enum class DropPolicy
+    {
+      DropNewest,
+      DropOldest
+    };
+    DropPolicy pending_drop_policy = DropPolicy::DropOldest;
+
+    // Stale-while-revalidate: once a mapping has less than this many milliseconds left to live, the next
+    // datagram for the neighbor still goes out at once, but also sends an ARP request straight to the
+    // neighbor's Ethernet address, so that the reply refreshes the mapping before it expires. 0 disables.
+    uint64_t arp_refresh_window_ms = 0;
+
+    // Negative caching: when an ARP request goes unanswered, drop the frames waiting for it, and drop
+    // datagrams for the neighbor at once (instead of queueing them and asking again) for this many
+    // milliseconds. The wait doubles with each further failure, up to `arp_max_backoff_ms`. 0 disables,
+    // and an unanswered request may be resent as soon as it expires.
+    uint64_t arp_negative_cache_ms = 0;
+    uint64_t arp_max_backoff_ms = 60000;
+
+    // Gratuitous ARP: announce the interface's own mapping with a broadcast as soon as it is constructed
+    // (see also send_gratuitous_arp()), and learn new neighbors from the announcements of others. If
+    // announcements are not accepted, they still update neighbors that are already known.
+    bool announce_on_start = false;
+    bool accept_gratuitous_arp = true;
+
+    // Token bucket for outgoing ARP requests: up to `arp_request_burst` at once, refilled at
+    // `arp_requests_per_second`. 0 disables. A request that finds the bucket empty is deferred until
+    // tick() has refilled it (or, if it was a refresh, skipped).
+    uint64_t arp_requests_per_second = 0;
+    uint64_t arp_request_burst = 16;
+
+    // Largest datagram (header included) that fits in one frame. Larger datagrams are split into
+    // fragments, or dropped (and counted in oversize_dropped()) if their "don't fragment" flag is set, as
+    // it is by default. There is no limit unless one is configured (e.g. 1500 for Ethernet).
+    size_t mtu = std::numeric_limits<size_t>::max();
+
+    // Whether recv_frame() reassembles fragmented datagrams before returning them (as a host does; a
+    // router forwards fragments as they are), with how much memory and how many datagrams in progress
+    // at most, and how long to wait for the rest of a datagram (see IPReassembler)
+    bool reassemble_fragments = false;
+    size_t reassembly_max_bytes = 1 << 20;
+    size_t reassembly_max_datagrams = 1024;
+    uint64_t reassembly_timeout_ms = 30000;
+  };
+
 private:
   // Ethernet (known as hardware, network-access, or link-layer) address of the interface
   EthernetAddress ethernet_address_;
@@ -45,11 +104,31 @@ private:
   // IP (known as Internet-layer or network-layer) address of the interface
   Address ip_address_;
 
-  struct EthernetInfo
-  {
-    EthernetAddress eth; // The Ethernet address associated with an IP address
-    size_t time;         // The time that has passed since the Ethernet address was mapped
-  };
+  Config config_;
+
+  // Frames dropped because a pending queue was full, or because their neighbor could not be resolved
+  uint64_t pending_dropped_ = 0;
+  uint64_t unreachable_dropped_ = 0;
+
+  // ARP requests the bucket has room for, in thousandths, and the neighbors whose requests are waiting
+  // for room, in order
+  uint64_t arp_tokens_ = 0;
+  deque<uint32_t> deferred_requests_ = {};
+  uint64_t arp_requests_deferred_ = 0;
+
+  // Datagrams dropped because they were too big for the link and could not be fragmented
+  uint64_t oversize_dropped_ = 0;
+
+  IPReassembler reassembler_;
+
+  // Where to report datagrams dropped for being too big for the link, if anywhere
+  std::shared_ptr<PathMTUCache> path_mtu_ = {};
+
+  // Scratch space for the fragments of a datagram being sent
+  vector<InternetDatagram> fragments_ = {};
+
+  // Send a datagram that fits in one frame
+  void send_unfragmented( const InternetDatagram& dgram, const Address& next_hop );
 
   // The maximum time in milliseconds before an ARP request is resent
   const size_t RESEND_THRESHOLD = 5000;
@@ -57,14 +136,44 @@ private:
   // The maximum time in milliseconds before an Ethernet-to-IP mapping is removed
   const size_t MAPPING_THRESHOLD = 30000;
 
-  // Maps an IP address to its corresponding Ethernet information
-  unordered_map<uint32_t, EthernetInfo> ethernet_map = {};
+  // Milliseconds since the interface was constructed (the sum of all ticks)
+  uint64_t now_ = 0;
+
+  // For each neighbor IP address: its Ethernet address (and when that expires), whether an ARP request
+  // for it is outstanding (and when that expires), and the frames waiting for an ARP reply
+  NeighborTable neighbors_ {};
+
+  // Expiry times of the neighbors' mappings and ARP requests, in order. Every mapping (and every ARP
+  // request) lives for the same fixed time, so they expire in the order they were made, and tick()
+  // only has to look at the front of each queue. Refreshing a mapping queues a new expiry time; the old
+  // one no longer matches the neighbor's when it reaches the front, and is skipped.
+  struct Expiry
+  {
+    uint64_t time;
+    uint32_t ip;
+  };
+  deque<Expiry> mapping_expiry_ = {};
+  deque<Expiry> arp_timeout_expiry_ = {};
+
+  // When to forget the failures of negatively cached neighbors. Backoff times vary, so these are kept
+  // in a heap rather than in order of arrival.
+  struct LaterExpiry
+  {
+    bool operator()( const Expiry& a, const Expiry& b ) const { return a.time > b.time; }
+  };
+  priority_queue<Expiry, vector<Expiry>, LaterExpiry> failure_expiry_ = {};
+
+  // Learn (or refresh) a mapping, or record that an ARP request was sent
+  NeighborTable::Entry& remember_mapping( uint32_t ip, const EthernetAddress& eth );
+  void remember_arp_request( NeighborTable::Entry& neighbor );
+  void remember_arp_failure( NeighborTable::Entry& neighbor );
 
-  // Maps an IP address to the time that has passed since an ARP request was sent
-  unordered_map<uint32_t, size_t> arp_timeout = {};
+  // Send an ARP request for the neighbor, broadcast or (to refresh a known mapping) unicast, if the rate
+  // limit allows. Returns whether it was sent.
+  bool send_arp_request( NeighborTable::Entry& neighbor, const EthernetAddress& destination );
 
-  // Maps an IP address to a queue of Ethernet frames waiting for an ARP reply
-  unordered_map<uint32_t, deque<EthernetFrame>> arp_waiting = {};
+  // Forget a neighbor once nothing is known or pending about it
+  void maybe_forget( const NeighborTable::Entry& neighbor );
 
   // Queue of Ethernet frames ready to be sent out
   deque<EthernetFrame> send_queue = {};
@@ -86,10 +195,15 @@ public:
   // Construct a network interface with given Ethernet (network-access-layer) and IP (internet-layer)
   // addresses
   NetworkInterface( const EthernetAddress& ethernet_address, const Address& ip_address );
+  NetworkInterface( const EthernetAddress& ethernet_address, const Address& ip_address, const Config& config );
 
   // Access queue of Ethernet frames awaiting transmission
   optional<EthernetFrame> maybe_send();
 
+  // Move up to `max_frames` frames awaiting transmission onto the end of `frames`, in order, and
+  // return how many were moved. Draining a busy interface this way costs one call per burst.
+  size_t maybe_send( vector<EthernetFrame>& frames, size_t max_frames );
+
   // Sends an IPv4 datagram, encapsulated in an Ethernet frame (if it knows the Ethernet destination
   // address). Will need to use [ARP](\ref rfc::rfc826) to look up the Ethernet destination address
   // for the next hop.
@@ -105,4 +219,33 @@ public:
 
   // Called periodically when time elapses
   void tick( size_t ms_since_last_tick );
+
+  // Frames waiting for ARP replies, and frames dropped because too many were waiting (see Config)
+  size_t pending_frames() const { return neighbors_.pending_total(); }
+  uint64_t pending_dropped() const { return pending_dropped_; }
+
+  // Frames and datagrams dropped because their neighbor did not answer ARP (see Config)
+  uint64_t unreachable_dropped() const { return unreachable_dropped_; }
+
+  // Broadcast the interface's own IP-to-Ethernet mapping, so that neighbors learn it before they need it
+  void send_gratuitous_arp();
+
+  // ARP requests that the rate limit held back (see Config)
+  uint64_t arp_requests_deferred() const { return arp_requests_deferred_; }
+
+  // Datagrams dropped because they were bigger than the MTU and marked "don't fragment"
+  uint64_t oversize_dropped() const { return oversize_dropped_; }
+
+  // Report datagrams dropped for being bigger than the MTU (and marked "don't fragment") to a path MTU
+  // cache, as size errors for their destinations. The interface also keeps the cache's time, through
+  // tick(), so a cache should be attached to one interface: the one whose link it describes.
+  void use_path_mtu_cache( std::shared_ptr<PathMTUCache> cache ) { path_mtu_ = std::move( cache ); }
+
+  // Fragments waiting to be reassembled (see Config)
+  const IPReassembler& reassembler() const { return reassembler_; }
+
+  // Backpressure: true once the frames waiting for ARP replies fill three quarters of
+  // Config::max_pending. A sender (e.g. a router or TCP) that sees this should hold back new
+  // datagrams for unresolved next hops rather than have them dropped.
+  bool congested() const { return neighbors_.pending_total() * 4 >= config_.max_pending * 3; }
 };
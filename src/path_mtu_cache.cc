@@ -0,0 +1,98 @@
+#include "path_mtu_cache.hh"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Common MTUs (RFC 1191's table, plus Ethernet's 1500, IPv6's 1280, and 9000-byte jumbo frames)
+constexpr array<size_t, 15> plateaus { 68, 296, 508, 576, 1006, 1280, 1492, 1500, 2002, 4352, 8166, 9000, 17914,
+                                       32000, 65535 };
+
+} // namespace
+
+PathMTUCache::PathMTUCache( const Config& config ) : config_( config )
+{
+  if ( config_.min_mtu <= TCP_IP_HEADERS_LENGTH or config_.link_mtu < config_.min_mtu ) {
+    throw runtime_error( "PathMTUCache: link MTU must be at least the minimum MTU, which must fit a TCP segment" );
+  }
+}
+
+size_t PathMTUCache::mtu( const uint32_t dst ) const
+{
+  const auto it = entries_.find( dst );
+  return it == entries_.end() ? config_.link_mtu : it->second.mtu;
+}
+
+void PathMTUCache::too_big( const uint32_t dst, const size_t size, const size_t reported_mtu )
+{
+  // Trust the reported MTU only if it explains the error; otherwise guess the next common MTU down
+  size_t estimate = reported_mtu >= plateaus.front() and reported_mtu < size ? reported_mtu : next_smaller( size );
+  estimate = max( estimate, config_.min_mtu );
+  if ( estimate >= mtu( dst ) ) {
+    return; // nothing new (e.g. a probe, or a datagram sent before the estimate was lowered)
+  }
+
+  auto it = entries_.find( dst );
+  if ( it == entries_.end() ) {
+    if ( entries_.size() >= config_.max_entries ) {
+      entries_.erase( entries_.begin() ); // that destination will rediscover its path MTU
+    }
+    it = entries_.emplace( dst, Entry {} ).first;
+  }
+  it->second = { estimate, now_ + config_.probe_interval_ms };
+}
+
+optional<size_t> PathMTUCache::probe_size( const uint32_t dst ) const
+{
+  const auto it = entries_.find( dst );
+  if ( it == entries_.end() or now_ < it->second.next_probe ) {
+    return {};
+  }
+  return next_larger( it->second.mtu );
+}
+
+void PathMTUCache::probe_started( const uint32_t dst, const size_t size )
+{
+  const auto it = entries_.find( dst );
+  if ( it != entries_.end() and size > it->second.mtu ) {
+    it->second.next_probe = now_ + config_.probe_interval_ms;
+  }
+}
+
+void PathMTUCache::probe_succeeded( const uint32_t dst, const size_t size )
+{
+  const auto it = entries_.find( dst );
+  if ( it == entries_.end() or size <= it->second.mtu ) {
+    return;
+  }
+  if ( size >= config_.link_mtu ) {
+    entries_.erase( it );
+    return;
+  }
+  // Keep searching upward straight away, until a probe is lost
+  it->second = { size, now_ };
+}
+
+void PathMTUCache::probe_failed( const uint32_t dst, const size_t size )
+{
+  const auto it = entries_.find( dst );
+  if ( it != entries_.end() and size > it->second.mtu ) {
+    it->second.next_probe = now_ + config_.probe_interval_ms;
+  }
+}
+
+size_t PathMTUCache::next_larger( const size_t mtu ) const
+{
+  const auto it = ranges::upper_bound( plateaus, mtu );
+  return it == plateaus.end() ? config_.link_mtu : min( *it, config_.link_mtu );
+}
+
+size_t PathMTUCache::next_smaller( const size_t mtu ) const
+{
+  const auto it = ranges::lower_bound( plateaus, mtu );
+  return it == plateaus.begin() ? config_.min_mtu : max( *prev( it ), config_.min_mtu );
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ipv4_header.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+// What this host has learned about the path MTU to each destination (path MTU discovery, RFC 1191,
+// with upward probing as in RFC 4821).
+//
+// Datagrams go out with "don't fragment" set (the IPv4Header default), so a path that cannot carry
+// one reports a size error instead of fragmenting it: too_big() lowers the destination's estimate to
+// the MTU reported, or to the next common MTU below the size that failed if none was. A destination
+// starts at the link's MTU, and one whose estimate has been lowered is probed upward again, one
+// common MTU at a time, once `probe_interval_ms` has passed since the last change: the sender asks
+// for probe_size(), sends one segment of that size, and says whether it got through.
+//
+// Only destinations with an estimate below the link's MTU are kept, at most `max_entries` of them.
+//
+// Time passes for the cache only through tick(). A cache attached to a NetworkInterface (see
+// NetworkInterface::use_path_mtu_cache()) is ticked by it; senders that share the cache only read it.
+class PathMTUCache
+{
+public:
+  struct Config
+  {
+    size_t link_mtu = 1500;               // MTU of the first hop, and the highest estimate
+    size_t min_mtu = 576;                 // lowest estimate (every IPv4 host accepts 576-byte datagrams)
+    uint64_t probe_interval_ms = 600'000; // how long an estimate stands before probing above it
+    size_t max_entries = 4096;
+  };
+
+  // Headers in a TCP segment with no options (IPv4 + TCP)
+  static constexpr size_t TCP_IP_HEADERS_LENGTH = IPv4Header::LENGTH + 20;
+
+  PathMTUCache() : PathMTUCache( Config {} ) {}
+  explicit PathMTUCache( const Config& config );
+
+  // Current estimate of the path MTU to `dst`
+  size_t mtu( uint32_t dst ) const;
+
+  // Largest TCP payload that fits in the path MTU to `dst`
+  size_t max_payload_size( uint32_t dst ) const { return mtu( dst ) - TCP_IP_HEADERS_LENGTH; }
+
+  // A datagram of `size` bytes to `dst` was too big for the path. `reported_mtu` is the MTU of the
+  // link it did not fit, or 0 if that isn't known.
+  void too_big( uint32_t dst, size_t size, size_t reported_mtu = 0 );
+
+  // The larger path MTU to try for `dst`, if it is time to probe
+  std::optional<size_t> probe_size( uint32_t dst ) const;
+
+  // A probe of `size` bytes was sent to `dst`: hold off other probes until it is resolved
+  void probe_started( uint32_t dst, size_t size );
+
+  // A probe got through (raising the estimate to its size) or was lost (leaving it alone)
+  void probe_succeeded( uint32_t dst, size_t size );
+  void probe_failed( uint32_t dst, size_t size );
+
+  void tick( uint64_t ms_since_last_tick ) { now_ += ms_since_last_tick; }
+
+  const Config& config() const { return config_; }
+  size_t size() const { return entries_.size(); }
+
+private:
+  struct Entry
+  {
+    size_t mtu;
+    uint64_t next_probe; // when the estimate may be probed above
+  };
+
+  Config config_;
+  uint64_t now_ = 0;
+  std::unordered_map<uint32_t, Entry> entries_ {};
+
+  // The common MTU just above or below `mtu`, within [min_mtu, link_mtu]
+  size_t next_larger( size_t mtu ) const;
+  size_t next_smaller( size_t mtu ) const;
+};
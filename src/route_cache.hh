@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Counters for the route lookups done by a Router
+struct RouteLookupStats
+{
+  uint64_t lookups {};      // destinations looked up
+  uint64_t cache_hits {};   // ... that were answered by the route cache
+  uint64_t cache_misses {}; // ... that went to the routing table while the cache was enabled
+  uint64_t lookup_ns {};    // time spent looking up routes (cache and routing table together)
+
+  double hit_rate() const { return lookups ? static_cast<double>( cache_hits ) / static_cast<double>( lookups ) : 0; }
+  double miss_rate() const
+  {
+    return lookups ? static_cast<double>( cache_misses ) / static_cast<double>( lookups ) : 0;
+  }
+  double ns_per_lookup() const
+  {
+    return lookups ? static_cast<double>( lookup_ns ) / static_cast<double>( lookups ) : 0;
+  }
+
+  RouteLookupStats& operator+=( const RouteLookupStats& other )
+  {
+    lookups += other.lookups;
+    cache_hits += other.cache_hits;
+    cache_misses += other.cache_misses;
+    lookup_ns += other.lookup_ns;
+    return *this;
+  }
+};
+
+// A direct-mapped cache from destination address to route, for traffic where a few destinations
+// account for most datagrams.
+//
+// Each entry is tagged with the generation of the routing table it was looked up in. Changing the
+// table starts a new generation, which invalidates every entry at once without touching any of them.
+class RouteCache
+{
+  struct Entry
+  {
+    uint64_t generation; // 0 for an empty entry
+    uint32_t address;
+    uint32_t route;
+  };
+
+  std::vector<Entry> entries_;
+  int shift_;
+
+  // Fibonacci hashing: the top bits of address * 2^32/phi
+  size_t index( uint32_t address ) const { return static_cast<uint32_t>( address * 2654435769U ) >> shift_; }
+
+public:
+  // A cache with room for `num_entries` destinations (rounded up to a power of two), or a disabled
+  // cache if `num_entries` is zero
+  explicit RouteCache( size_t num_entries = 0 )
+    : entries_( num_entries ? std::bit_ceil( std::max( num_entries, size_t { 2 } ) ) : 0, Entry {} )
+    , shift_( 32 - std::countr_zero( std::max( entries_.size(), size_t { 2 } ) ) )
+  {}
+
+  bool enabled() const { return not entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+
+  // The route cached for `address` in this generation of the routing table, if any
+  std::optional<uint32_t> find( uint32_t address, uint64_t generation ) const
+  {
+    const Entry& entry = entries_[index( address )];
+    if ( entry.generation != generation or entry.address != address ) {
+      return {};
+    }
+    return entry.route;
+  }
+
+  void insert( uint32_t address, uint64_t generation, uint32_t route )
+  {
+    entries_[index( address )] = { generation, address, route };
+  }
+};
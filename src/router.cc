@@ -1,15 +1,19 @@
 #include "router.hh"
 
 #include "address.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <limits>
+#include <stdexcept>
 
 using namespace std;
+using namespace std::chrono;
 
 void Router::process_datagram( InternetDatagram& datagram, const RouteInfo& route_info )
 {
-  datagram.header.ttl--;
-  datagram.header.compute_checksum();
+  datagram.header.decrement_ttl();
 
   if ( route_info.next_hop.has_value() ) {
     // Send the datagram to the specified next hop on the corresponding interface
@@ -21,18 +25,54 @@ void Router::process_datagram( InternetDatagram& datagram, const RouteInfo& rout
   }
 }
 
-bool Router::is_matching_prefix( const InternetDatagram& datagram, const RouteInfo& route_info )
+template<typename Update>
+auto Router::update_routing_table( Update update )
 {
-  // Check if the route prefix length is 0, which means it matches all addresses
-  if ( route_info.prefix_length == 0 )
-    return true;
+  const lock_guard writer_lock { routing_table_writer_mutex_ };
+  {
+    const lock_guard lock { routing_table_mutex_ };
+    if ( routing_table_.use_count() == 1 ) {
+      // Nobody else is reading this version, so change it in place
+      spare_routing_table_.reset();
+      spare_missed_updates_.clear();
+      return update( *routing_table_ );
+    }
+  }
+
+  shared_ptr<RoutingTable> next = std::move( spare_routing_table_ );
+  if ( next ) {
+    // Readers move on to the current version at their next burst; once the last of them has let go of
+    // the spare (the acquire fence pairs with the release in its shared_ptr's destructor), bring it up
+    // to date
+    while ( next.use_count() > 1 ) {
+      this_thread::yield();
+    }
+    atomic_thread_fence( memory_order_acquire );
+    for ( const auto& missed : spare_missed_updates_ ) {
+      missed( *next );
+    }
+  } else {
+    next = make_shared<RoutingTable>( *routing_table_ );
+  }
 
-  // Create a bitmask based on the prefix length
-  uint32_t mask = 0xFFFFFFFF << ( 32 - route_info.prefix_length );
+  // Make the change there and publish it. The version being replaced becomes the spare, and will
+  // have missed this update.
+  auto ret = update( *next );
+  {
+    const lock_guard lock { routing_table_mutex_ };
+    swap( routing_table_, next );
+  }
+  routing_table_version_.fetch_add( 1, memory_order_release );
+  spare_routing_table_ = std::move( next );
+  spare_missed_updates_.clear();
+  spare_missed_updates_.emplace_back( std::move( update ) );
+  return ret;
+}
 
-  // Apply the bitmask to the destination address of the datagram
-  // and compare it with the route prefix to check for a match
-  return ( datagram.header.dst & mask ) == route_info.route_prefix;
+shared_ptr<const RoutingTable> Router::routing_table_snapshot()
+{
+  const lock_guard lock { routing_table_mutex_ };
+  return routing_table_;
 }
 
 void Router::add_route( const uint32_t route_prefix,
@@ -40,33 +80,288 @@ void Router::add_route( const uint32_t route_prefix,
                         const optional<Address> next_hop,
                         const size_t interface_num )
 {
-  // Create a RouteInfo object with the provided parameters
-  RouteInfo route_info = { route_prefix, prefix_length, next_hop, interface_num };
+  update_routing_table( [=]( RoutingTable& table ) {
+    table.add_route( route_prefix, prefix_length, next_hop, interface_num );
+    return true;
+  } );
+}
+
+bool Router::remove_route( const uint32_t route_prefix, const uint8_t prefix_length )
+{
+  return update_routing_table(
+    [=]( RoutingTable& table ) { return table.remove_route( route_prefix, prefix_length ); } );
+}
+
+void Router::install_routing_table( RoutingTable&& table )
+{
+  auto next = make_shared<RoutingTable>( std::move( table ) );
+  {
+    const lock_guard writer_lock { routing_table_writer_mutex_ };
+    const lock_guard lock { routing_table_mutex_ };
+    swap( routing_table_, next );
+    spare_routing_table_.reset(); // it is not worth catching up with a whole new table
+    spare_missed_updates_.clear();
+    MINNOW_TRACE( Info, RoutingTableInstalled, routing_table_->generation(), routing_table_->size() );
+    routing_table_version_.fetch_add( 1, memory_order_release );
+  }
+  // `next` now holds the old table, which is freed here (outside the locks) unless a reader still has it
+}
+
+template<typename Forward>
+bool Router::route_burst( AsyncNetworkInterface& interface,
+                          const RoutingTable& table,
+                          Burst& burst,
+                          Forward&& forward )
+{
+  // Collect a burst of received datagrams
+  bool drained = false;
+  burst.datagrams.clear();
+  while ( burst.datagrams.size() < BURST_SIZE ) {
+    auto maybe_datagram = interface.maybe_receive();
+    if ( not maybe_datagram.has_value() ) {
+      drained = true;
+      break;
+    }
+    burst.destinations[burst.datagrams.size()] = maybe_datagram->header.dst;
+    burst.datagrams.push_back( std::move( maybe_datagram.value() ) );
+  }
+
+  const size_t count = burst.datagrams.size();
+  if ( count == 0 ) {
+    return false;
+  }
 
-  // Add the route_info to the routing_table
-  routing_table.emplace_back( route_info );
+  // Find the route with the longest prefix that matches each destination address: from the cache if
+  // it is there, and otherwise from the routing table, all misses at once
+  const auto lookup_start = steady_clock::now();
+  if ( burst.cache.enabled() ) {
+    size_t num_misses = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+      const auto cached = burst.cache.find( burst.destinations[i], table.generation() );
+      if ( cached.has_value() ) {
+        burst.routes[i] = *cached;
+      } else {
+        burst.misses[num_misses] = i;
+        burst.destinations[num_misses++] = burst.destinations[i]; // compact the misses to the front
+      }
+    }
+    array<uint32_t, BURST_SIZE> miss_routes; // NOLINT(*-member-init)
+    table.lookup( span { burst.destinations }.first( num_misses ), miss_routes );
+    for ( size_t j = 0; j < num_misses; ++j ) {
+      burst.routes[burst.misses[j]] = miss_routes[j];
+      burst.cache.insert( burst.destinations[j], table.generation(), miss_routes[j] );
+    }
+    burst.stats.cache_hits += count - num_misses;
+    burst.stats.cache_misses += num_misses;
+  } else {
+    table.lookup( span { burst.destinations }.first( count ), burst.routes );
+  }
+  burst.stats.lookups += count;
+  burst.stats.lookup_ns += duration_cast<nanoseconds>( steady_clock::now() - lookup_start ).count();
 
-  // Sort the routing_table based on prefix_length in descending order
-  sort( routing_table.begin(), routing_table.end(), compare_routes );
+  for ( size_t i = 0; i < burst.datagrams.size(); ++i ) {
+    InternetDatagram& datagram = burst.datagrams[i];
+    if ( burst.routes[i] != LPMTable::NO_MATCH
+         and datagram.header.ttl > 1 ) { // Check if the TTL of the datagram allows further forwarding
+      forward( datagram, table.route( burst.routes[i] ) );
+    } else {
+      MINNOW_TRACE( Info, DatagramDropped, datagram.header.dst, datagram.header.ttl );
+    }
+  }
+  burst.datagrams.clear();
+  return not drained;
 }
 
 void Router::route()
 {
+  if ( not workers_.empty() ) {
+    throw runtime_error( "Router::route() called while worker threads are running" );
+  }
+
+  const auto forward = [this]( InternetDatagram& datagram, const RouteInfo& route_info ) {
+    if ( route_info.interface_num >= interfaces_.size() ) {
+      dropped_.fetch_add( 1, memory_order_relaxed );
+      return;
+    }
+    process_datagram( datagram, route_info );
+  };
+  const shared_ptr<const RoutingTable> table = routing_table_snapshot();
   for ( AsyncNetworkInterface& interface : interfaces_ ) { // Iterate over each network interface
-    while ( auto maybe_datagram
-            = interface.maybe_receive() ) { // Process received datagrams until there are no more
-      InternetDatagram datagram = maybe_datagram.value();
-
-      // Iterate over each route in the routing table
-      for ( const RouteInfo& route_info : routing_table ) {
-        if ( is_matching_prefix(
-               datagram, route_info ) ) {  // Check if the route matches the destination address of the datagram
-          if ( datagram.header.ttl > 1 ) { // Check if the TTL of the datagram allows further forwarding
-            process_datagram( datagram, route_info ); // Helper function all
-          }
-          break; // Exit the loop after finding a matching route
+    while ( route_burst( interface, *table, burst_, forward ) ) {}
+  }
+}
+
+void Router::tick( const size_t ms_since_last_tick )
+{
+  const lock_guard lock { workers_mutex_ };
+  if ( workers_.empty() ) {
+    for ( AsyncNetworkInterface& interface : interfaces_ ) {
+      interface.tick( ms_since_last_tick );
+    }
+    return;
+  }
+
+  for ( auto& worker : workers_ ) {
+    worker->ms_elapsed.fetch_add( ms_since_last_tick, memory_order_relaxed );
+  }
+}
+
+void Router::set_route_cache_size( const size_t num_entries )
+{
+  route_cache_size_ = num_entries;
+  burst_.cache = RouteCache { num_entries };
+}
+
+RouteLookupStats Router::route_lookup_stats()
+{
+  RouteLookupStats ret = burst_.stats;
+  const lock_guard lock { worker_stats_mutex_ };
+  ret += worker_stats_;
+  return ret;
+}
+
+void Router::start()
+{
+  const lock_guard lock { workers_mutex_ };
+  if ( not workers_.empty() ) {
+    return;
+  }
+
+  stopping_ = false;
+  for ( size_t i = 0; i < interfaces_.size(); ++i ) {
+    workers_.push_back( make_unique<Worker>() );
+  }
+  // Start the threads only once every worker's queues exist
+  for ( size_t i = 0; i < interfaces_.size(); ++i ) {
+    workers_[i]->thread = thread { [this, i] { run_worker( i ); } };
+  }
+}
+
+void Router::stop()
+{
+  const lock_guard lock { workers_mutex_ };
+  stopping_ = true;
+  for ( size_t i = 0; i < workers_.size(); ++i ) {
+    workers_[i]->thread.join();
+    // Time that passed after the worker's last burst still counts
+    if ( const uint64_t ms = workers_[i]->ms_elapsed.load() ) {
+      interfaces_.at( i ).tick( ms );
+    }
+  }
+  workers_.clear();
+}
+
+bool Router::recv_frame( const size_t N, EthernetFrame&& frame )
+{
+  return workers_.at( N )->frames_in.push( std::move( frame ) );
+}
+
+optional<EthernetFrame> Router::maybe_send( const size_t N )
+{
+  return workers_.at( N )->frames_out.pop();
+}
+
+size_t Router::maybe_send( const size_t N, vector<EthernetFrame>& frames, const size_t max_frames )
+{
+  Worker& worker = *workers_.at( N );
+  size_t count = 0;
+  for ( ; count < max_frames; ++count ) {
+    auto frame = worker.frames_out.pop();
+    if ( not frame.has_value() ) {
+      break;
+    }
+    frames.push_back( std::move( *frame ) );
+  }
+  return count;
+}
+
+void Router::run_worker( const size_t interface_num )
+{
+  AsyncNetworkInterface& interface = interfaces_.at( interface_num );
+  Worker& worker = *workers_.at( interface_num );
+
+  Burst burst;
+  burst.cache = RouteCache { route_cache_size_ };
+  vector<EthernetFrame> outgoing;
+  outgoing.reserve( BURST_SIZE );
+  shared_ptr<const RoutingTable> table;
+  uint64_t table_version = 0;
+
+  // Forward on this interface directly, or hand over to the worker that owns the outbound interface
+  const auto forward = [&]( InternetDatagram& datagram, const RouteInfo& route_info ) {
+    if ( route_info.interface_num >= workers_.size() ) {
+      dropped_.fetch_add( 1, memory_order_relaxed );
+      return;
+    }
+    datagram.header.decrement_ttl();
+    const uint32_t next_hop
+      = route_info.next_hop.has_value() ? route_info.next_hop->ipv4_numeric() : datagram.header.dst;
+    if ( route_info.interface_num == interface_num ) {
+      interface.send_datagram( datagram, Address::from_ipv4_numeric( next_hop ) );
+    } else if ( not workers_[route_info.interface_num]->datagrams_out.push( { std::move( datagram ), next_hop } ) ) {
+      dropped_.fetch_add( 1, memory_order_relaxed );
+    }
+  };
+
+  // How long to sleep when there is nothing to do (see below)
+  constexpr size_t spin_rounds = 64;
+  constexpr microseconds max_idle_sleep { 1000 };
+  size_t idle_rounds = 0;
+
+  while ( not stopping_.load( memory_order_relaxed ) ) {
+    // Let the interface know how much time has passed
+    if ( const uint64_t ms = worker.ms_elapsed.exchange( 0, memory_order_relaxed ) ) {
+      interface.tick( ms );
+    }
+
+    // Pick up the latest version of the routing table if it has changed
+    const uint64_t version = routing_table_version_.load( memory_order_acquire );
+    if ( not table or version != table_version ) {
+      table = routing_table_snapshot();
+      table_version = version;
+    }
+
+    bool idle = true;
+
+    // Receive frames from the link, and route the datagrams in them
+    for ( size_t i = 0; i < BURST_SIZE; ++i ) {
+      auto frame = worker.frames_in.pop();
+      if ( not frame.has_value() ) {
+        break;
+      }
+      interface.recv_frame( *frame );
+      idle = false;
+    }
+    while ( route_burst( interface, *table, burst, forward ) ) {}
+
+    // Send the datagrams that other workers have routed to this interface
+    while ( auto handoff = worker.datagrams_out.pop() ) {
+      interface.send_datagram( handoff->datagram, Address::from_ipv4_numeric( handoff->next_hop ) );
+      idle = false;
+    }
+
+    // Pass whatever the interface has sent to the link
+    while ( interface.maybe_send( outgoing, BURST_SIZE ) ) {
+      for ( auto& frame : outgoing ) {
+        if ( not worker.frames_out.push( std::move( frame ) ) ) {
+          dropped_.fetch_add( 1, memory_order_relaxed );
         }
       }
+      outgoing.clear();
+    }
+
+    // Back off when idle: yield for a while, in case more frames are about to arrive, then sleep for
+    // longer and longer, so that an idle router does not keep its cores busy
+    if ( not idle ) {
+      idle_rounds = 0;
+    } else if ( ++idle_rounds <= spin_rounds ) {
+      this_thread::yield();
+    } else {
+      const size_t doublings = min( idle_rounds - spin_rounds, size_t { 10 } );
+      this_thread::sleep_for( min( microseconds { size_t { 1 } << doublings }, max_idle_sleep ) );
     }
   }
+
+  const lock_guard lock { worker_stats_mutex_ };
+  worker_stats_ += burst.stats;
 }
@@ -1,9 +1,20 @@
 #pragma once
 
+#include "lpm_table.hh"
+#include "mpsc_queue.hh"
 #include "network_interface.hh"
-
+#include "route_cache.hh"
+#include "routing_table.hh"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <queue>
+#include <thread>
+#include <vector>
 
 // A wrapper for NetworkInterface that makes the host-side
 // interface asynchronous: instead of returning received datagrams
@@ -56,26 +67,88 @@ private:
   // The router's collection of network interfaces
   std::vector<AsyncNetworkInterface> interfaces_ {};
 
-  // Struct to store information about a route
-  struct RouteInfo
+  using RouteInfo = RoutingTable::Route;
+
+  // The routing table is read-mostly. Readers (route() and the worker threads) hold a snapshot of
+  // it, and an update never touches a table that someone is reading: it changes another version of
+  // the table and publishes that as the new one. Readers pick up the new version between bursts, and
+  // never wait for a writer.
+  //
+  // Copying a table for each update would be expensive (its tbl24 alone is 64 MiB), so there are two
+  // versions, which take turns: the one being read, and a spare (the one before it). An update waits
+  // for the readers to let go of the spare (within a burst), replays on it the updates it has missed,
+  // makes the new change, and publishes it; the old version becomes the spare. Only an update that
+  // finds no spare copies a whole table to make one: the first while the table is being read, or the
+  // first after install_routing_table(). (An update that nobody is reading is made in place, and the
+  // spare is let go.)
+  std::shared_ptr<RoutingTable> routing_table_ = std::make_shared<RoutingTable>();
+  std::shared_ptr<RoutingTable> spare_routing_table_ {};
+  std::vector<std::function<void( RoutingTable& )>> spare_missed_updates_ {};
+  std::mutex routing_table_mutex_ {};        // guards the routing_table_ pointer itself
+  std::mutex routing_table_writer_mutex_ {}; // serializes updates
+  std::atomic<uint64_t> routing_table_version_ {};
+
+  // Apply `update` to the routing table (in place if nobody is reading it, otherwise to the spare,
+  // which is then published). `update` is kept until the spare has caught up, so must not hold
+  // references to the caller's arguments.
+  template<typename Update>
+  auto update_routing_table( Update update );
+
+  // The current version of the routing table
+  std::shared_ptr<const RoutingTable> routing_table_snapshot();
+
+  // Datagrams are routed in bursts of up to BURST_SIZE per interface, looked up together. Each thread
+  // that routes has its own Burst, including its own route cache.
+  static constexpr size_t BURST_SIZE = 32;
+  struct Burst
   {
-    uint32_t route_prefix;
-    uint8_t prefix_length;
-    std::optional<Address> next_hop;
-    size_t interface_num;
+    std::vector<InternetDatagram> datagrams {};
+    std::array<uint32_t, BURST_SIZE> destinations {};
+    std::array<uint32_t, BURST_SIZE> routes {};
+    std::array<uint32_t, BURST_SIZE> misses {}; // indices of the destinations not in the cache
+    RouteCache cache {};
+    RouteLookupStats stats {};
   };
+  Burst burst_ {};
+  size_t route_cache_size_ {};
 
-  // Routing table to store routes
-  std::vector<RouteInfo> routing_table {};
+  // Lookup statistics of worker threads that have exited
+  RouteLookupStats worker_stats_ {};
+  std::mutex worker_stats_mutex_ {};
 
-  // Comparator function to sort routes based on prefix length in descending order
-  static bool compare_routes( const RouteInfo& a, const RouteInfo& b ) { return a.prefix_length > b.prefix_length; }
+  // Route one burst of the datagrams received on `interface`, calling forward( datagram, route ) for
+  // each one that should be forwarded. Returns false once the interface has no more to route.
+  template<typename Forward>
+  static bool route_burst( AsyncNetworkInterface& interface,
+                           const RoutingTable& table,
+                           Burst& burst,
+                           Forward&& forward );
 
   // Process a datagram by forwarding it to the next hop (based on the route)
   void process_datagram( InternetDatagram& datagram, const RouteInfo& route_info );
 
-  // Check if the datagram's destination address matches the route's prefix (involves bitmasking)
-  bool is_matching_prefix( const InternetDatagram& datagram, const RouteInfo& route_info );
+  // Parallel mode: each interface is owned by one worker thread, which receives its frames, routes
+  // the datagrams in them, and sends whatever other workers hand over to it for transmission
+  static constexpr size_t QUEUE_CAPACITY = 1024;
+  struct Handoff
+  {
+    InternetDatagram datagram;
+    uint32_t next_hop;
+  };
+  struct Worker
+  {
+    MPSCQueue<EthernetFrame> frames_in { QUEUE_CAPACITY };  // from the link
+    MPSCQueue<Handoff> datagrams_out { QUEUE_CAPACITY };    // from any worker, to send on this interface
+    MPSCQueue<EthernetFrame> frames_out { QUEUE_CAPACITY }; // to the link
+    std::atomic<uint64_t> ms_elapsed {};                    // from tick(), not yet applied to the interface
+    std::thread thread {};
+  };
+  std::vector<std::unique_ptr<Worker>> workers_ {};
+  std::mutex workers_mutex_ {}; // serializes start(), stop() and tick()
+  std::atomic<bool> stopping_ {};
+  std::atomic<uint64_t> dropped_ {};
+
+  void run_worker( size_t interface_num );
 
 public:
   // Add an interface to the router
@@ -87,15 +160,32 @@ public:
     return interfaces_.size() - 1;
   }
 
+  Router() = default;
+  ~Router() { stop(); }
+  Router( const Router& other ) = delete;
+  Router& operator=( const Router& other ) = delete;
+  Router( Router&& other ) = delete;
+  Router& operator=( Router&& other ) = delete;
+
   // Access an interface by index
   AsyncNetworkInterface& interface( size_t N ) { return interfaces_.at( N ); }
 
-  // Add a route (a forwarding rule)
+  // Add a route (a forwarding rule), replacing any existing route for the same prefix.
+  // Routes may be added and removed from any thread, even while the router is forwarding.
   void add_route( uint32_t route_prefix,
                   uint8_t prefix_length,
                   std::optional<Address> next_hop,
                   size_t interface_num );
 
+  // Remove the route for a prefix. Returns false if there was none.
+  bool remove_route( uint32_t route_prefix, uint8_t prefix_length );
+
+  // Replace the whole routing table at once (e.g. with one loaded from a file by RoutingTable::load).
+  // Safe to call from any thread, even while route() or the worker threads are forwarding: they finish
+  // the datagrams in hand with the old table and use the new one from their next burst. The old table
+  // is freed when the last of them lets go of it.
+  void install_routing_table( RoutingTable&& table );
+
   // Route packets between the interfaces. For each interface, use the
   // maybe_receive() method to consume every incoming datagram and
   // send it on one of interfaces to the correct next hop. The router
@@ -103,4 +193,42 @@ public:
   // route with the longest prefix_length that matches the datagram's
   // destination address.
   void route();
+
+  // Called periodically when time elapses: ticks every interface (in parallel mode, each worker ticks
+  // its own interface before its next burst). May be called from any thread, even while start() or
+  // stop() is running; but while the router is not running in parallel it ticks the interfaces itself,
+  // so it must not overlap a call to route().
+  void tick( size_t ms_since_last_tick );
+
+  // Put a direct-mapped cache of (about) `num_entries` destinations in front of the routing table,
+  // or remove it if `num_entries` is zero. Cached routes are invalidated whenever a route is added or
+  // removed. In parallel mode each worker has a cache of this size; it takes effect on start().
+  void set_route_cache_size( size_t num_entries );
+
+  // Route lookup statistics (including those of worker threads that have been stopped)
+  RouteLookupStats route_lookup_stats();
+
+  // Start routing in parallel, with one worker thread per interface. While the workers are running,
+  // frames are exchanged with the router through recv_frame( N, frame ) and maybe_send( N ) only:
+  // neither route() nor the interfaces themselves may be used until stop() is called.
+  void start();
+
+  // Stop and join the worker threads. Frames still queued for the link are dropped.
+  void stop();
+
+  // Hand a frame received on interface N to its worker. Safe to call from any thread; returns false
+  // (leaving `frame` alone) if the worker's queue is full.
+  bool recv_frame( size_t N, EthernetFrame&& frame );
+
+  // A frame that interface N's worker has sent, if any. Only one thread at a time may call this for
+  // a given interface.
+  std::optional<EthernetFrame> maybe_send( size_t N );
+
+  // Move up to `max_frames` frames that interface N's worker has sent onto the end of `frames`, and
+  // return how many were moved. Same rules as maybe_send( N ).
+  size_t maybe_send( size_t N, std::vector<EthernetFrame>& frames, size_t max_frames );
+
+  // Datagrams or frames dropped in parallel mode because a worker's queue was full, and datagrams
+  // dropped (in either mode) because their route names an interface that the router does not have
+  uint64_t dropped() const { return dropped_.load( std::memory_order_relaxed ); }
 };
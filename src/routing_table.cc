@@ -0,0 +1,110 @@
+#include "routing_table.hh"
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+uint64_t RoutingTable::next_generation()
+{
+  static atomic<uint64_t> generation { 1 };
+  return generation.fetch_add( 1, memory_order_relaxed );
+}
+
+void RoutingTable::add_route( const uint32_t route_prefix,
+                              const uint8_t prefix_length,
+                              const optional<Address> next_hop,
+                              const size_t interface_num )
+{
+  generation_ = next_generation();
+
+  // Create a Route object with the provided parameters
+  Route route = { route_prefix, prefix_length, next_hop, interface_num };
+
+  // Replace the route in place if the prefix already has one
+  if ( const auto existing = prefixes_.find( route_prefix, prefix_length ) ) {
+    routes_.at( *existing ) = route;
+    return;
+  }
+
+  // Otherwise store it (reusing the slot of a removed route if there is one) and add it to the table
+  uint32_t index {};
+  if ( free_routes_.empty() ) {
+    index = routes_.size();
+    routes_.push_back( route );
+  } else {
+    index = free_routes_.back();
+    free_routes_.pop_back();
+    routes_.at( index ) = route;
+  }
+  prefixes_.insert( route_prefix, prefix_length, index );
+}
+
+bool RoutingTable::remove_route( const uint32_t route_prefix, const uint8_t prefix_length )
+{
+  const auto index = prefixes_.find( route_prefix, prefix_length );
+  if ( not index.has_value() ) {
+    return false;
+  }
+
+  generation_ = next_generation();
+  prefixes_.erase( route_prefix, prefix_length );
+  free_routes_.push_back( *index );
+  return true;
+}
+
+RoutingTable RoutingTable::load( istream& input )
+{
+  RoutingTable table;
+  string line;
+  for ( size_t line_num = 1; getline( input, line ); ++line_num ) {
+    if ( line.empty() or line.front() == '#' ) {
+      continue;
+    }
+
+    const auto malformed = [&] {
+      return runtime_error( "RoutingTable: malformed route on line " + to_string( line_num ) + ": " + line );
+    };
+
+    istringstream fields { line };
+    string prefix;
+    string next_hop;
+    string interface;
+    string extra;
+    if ( not( fields >> prefix >> next_hop >> interface ) or fields >> extra
+         or interface.find_first_not_of( "0123456789" ) != string::npos ) {
+      throw malformed();
+    }
+
+    const size_t slash = prefix.find( '/' );
+    if ( slash == string::npos ) {
+      throw malformed();
+    }
+    size_t prefix_length {};
+    try {
+      size_t end {};
+      prefix_length = stoul( prefix.substr( slash + 1 ), &end );
+      if ( end != prefix.size() - slash - 1 or prefix_length > 32 ) {
+        throw malformed();
+      }
+      table.add_route( Address { prefix.substr( 0, slash ) }.ipv4_numeric(),
+                       static_cast<uint8_t>( prefix_length ),
+                       next_hop == "-" ? optional<Address> {} : Address { next_hop },
+                       stoul( interface ) );
+    } catch ( const exception& ) { // from stoul, or an invalid address
+      throw malformed();
+    }
+  }
+  return table;
+}
+
+RoutingTable RoutingTable::load( const string& filename )
+{
+  ifstream input { filename };
+  if ( not input ) {
+    throw runtime_error( "RoutingTable: could not open " + filename );
+  }
+  return load( input );
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "address.hh"
+#include "lpm_table.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// A router's forwarding rules: for each prefix, the interface to send matching datagrams out of and
+// (unless the destination is directly connected) the next hop to send them to.
+//
+// A RoutingTable can be built on its own (e.g. loaded from a file) and then handed to a Router,
+// which swaps it in for its current table in one step (see Router::install_routing_table).
+class RoutingTable
+{
+public:
+  struct Route
+  {
+    uint32_t route_prefix;
+    uint8_t prefix_length;
+    std::optional<Address> next_hop;
+    size_t interface_num;
+  };
+
+  // Add a route, replacing any existing route for the same prefix
+  void add_route( uint32_t route_prefix,
+                  uint8_t prefix_length,
+                  std::optional<Address> next_hop,
+                  size_t interface_num );
+
+  // Remove the route for a prefix. Returns false if there was none.
+  bool remove_route( uint32_t route_prefix, uint8_t prefix_length );
+
+  // Load routes, one per line, in the form
+  //
+  //   <prefix>/<length> <next hop, or "-" if directly connected> <interface number>
+  //
+  // e.g. "143.195.0.0/17 143.195.0.1 5" or "10.0.0.0/8 - 1". Blank lines and lines starting with
+  // '#' are ignored. Throws on a malformed line.
+  static RoutingTable load( std::istream& input );
+  static RoutingTable load( const std::string& filename );
+
+  // Number of routes
+  size_t size() const { return prefixes_.size(); }
+
+  // The index (in routes()) of the route with the longest prefix that matches each address, or
+  // LPMTable::NO_MATCH
+  void lookup( std::span<const uint32_t> addresses, std::span<uint32_t> results ) const
+  {
+    prefixes_.lookup( addresses, results );
+  }
+  const Route& route( uint32_t index ) const { return routes_[index]; }
+
+  // Different for every version of every RoutingTable: changes whenever a route is added or removed,
+  // so that anything cached from a lookup can be tagged with the generation it came from
+  uint64_t generation() const { return generation_; }
+
+private:
+  // Maps each prefix to the index of its route in `routes_`
+  LPMTable prefixes_ {};
+  std::vector<Route> routes_ {};
+  std::vector<uint32_t> free_routes_ {}; // indices of removed routes, for reuse
+
+  uint64_t generation_ = next_generation();
+  static uint64_t next_generation();
+};
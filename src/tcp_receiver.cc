@@ -1,4 +1,5 @@
 #include "tcp_receiver.hh"
+#include "trace.hh"
 #include "wrapping_integers.hh"
 #include <cmath>
 #include <cstdlib>
@@ -16,6 +17,7 @@ void TCPReceiver::receive( TCPSenderMessage message, Reassembler& reassembler, W
 
   // If the ISN has not been set yet, discard the message.
   if ( !isn ) {
+    MINNOW_TRACE( Debug, SegmentIgnored, message.seqno.unwrap( Wrap32 { 0 }, 0 ) );
     return;
   }
 
@@ -30,6 +32,8 @@ void TCPReceiver::receive( TCPSenderMessage message, Reassembler& reassembler, W
     abs_seqno -= 1;
   }
 
+  MINNOW_TRACE( Debug, SegmentReceived, abs_seqno, message.payload.size() );
+
   // Insert the payload into the Reassembler, along with the absolute sequence number and the FIN flag.
   reassembler.insert( abs_seqno, message.payload, message.FIN, inbound_stream );
 }
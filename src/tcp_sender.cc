@@ -1,5 +1,6 @@
 #include "tcp_sender.hh"
 #include "tcp_config.hh"
+#include "trace.hh"
 #include <iostream>
 #include <random>
 
@@ -10,6 +11,19 @@ TCPSender::TCPSender( uint64_t initial_RTO_ms, optional<Wrap32> fixed_isn )
   : isn_( fixed_isn.value_or( Wrap32 { random_device()() } ) ), initial_RTO_ms_( initial_RTO_ms )
 {}
 
+// Takes the maximum payload size from the path MTU to the given destination from now on.
+void TCPSender::use_path_mtu_cache( shared_ptr<PathMTUCache> cache, uint32_t destination )
+{
+  path_mtu_ = std::move( cache );
+  destination_ = destination;
+}
+
+// Returns the largest payload to send in one segment.
+uint64_t TCPSender::max_payload_size() const
+{
+  return path_mtu_ ? path_mtu_->max_payload_size( destination_ ) : TCPConfig::MAX_PAYLOAD_SIZE;
+}
+
 // Calculates the total number of sequence numbers in flight.
 uint64_t TCPSender::sequence_numbers_in_flight() const
 {
@@ -47,7 +61,22 @@ void TCPSender::push( Reader& outbound_stream )
   // Create and store new TCPSenderMessage objects for each segment of data to be sent.
   while ( actual_window && !fin_sent ) {
     TCPSenderMessage msg;
-    uint64_t seg_size = min( actual_window, min( TCPConfig::MAX_PAYLOAD_SIZE, outbound_stream.peek().length() ) );
+    uint64_t max_payload = max_payload_size();
+
+    // Make this segment a path MTU probe if one is due and there is enough data and window to fill it.
+    size_t probe_mtu = 0;
+    if ( path_mtu_ && !probe_mtu_ ) {
+      const optional<size_t> probe_size = path_mtu_->probe_size( destination_ );
+      if ( probe_size ) {
+        const uint64_t probe_payload = *probe_size - PathMTUCache::TCP_IP_HEADERS_LENGTH;
+        if ( probe_payload <= actual_window && probe_payload <= outbound_stream.peek().length() ) {
+          max_payload = probe_payload;
+          probe_mtu = *probe_size;
+        }
+      }
+    }
+
+    uint64_t seg_size = min( actual_window, min( max_payload, outbound_stream.peek().length() ) );
 
     if ( !syn_set ) {
       msg.SYN = true;
@@ -70,6 +99,12 @@ void TCPSender::push( Reader& outbound_stream )
     outstanding_segs.push_back( msg );
     sent_segs.push_back( msg );
     isn_ = isn_ + msg.sequence_length();
+
+    if ( probe_mtu ) {
+      probe_mtu_ = probe_mtu;
+      probe_end_ = isn_.unwrap( zero_point, 0 );
+      path_mtu_->probe_started( destination_, probe_mtu_ );
+    }
   }
 }
 
@@ -98,6 +133,12 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
     acked = true;
   }
 
+  // An acknowledged probe shows that the path carries segments that big.
+  if ( probe_mtu_ && msg.ackno.value().unwrap( zero_point, 0 ) >= probe_end_ ) {
+    path_mtu_->probe_succeeded( destination_, probe_mtu_ );
+    probe_mtu_ = 0;
+  }
+
   // If a new acknowledgment was received, reset the RTO timer and consecutive retransmissions counter.
   if ( acked ) {
     elapsed_time = 0;
@@ -115,15 +156,71 @@ void TCPSender::tick( uint64_t ms_since_last_tick )
 
   // If the RTO timer has reached the alarm threshold, handle timeouts and retransmissions.
   if ( elapsed_time >= alarm ) {
+    // A lost path MTU probe says the path may be too small for it, not that the network is congested: it is
+    // resent (at the size known to work) without backing off or counting as a retransmission.
+    const bool probe_lost
+      = probe_mtu_ && !sent_segs.empty()
+        && sent_segs.front().seqno.unwrap( zero_point, 0 ) + sent_segs.front().sequence_length() == probe_end_;
+
+    // A segment that keeps timing out may be too big for a hop that drops it without saying so. Lowering the
+    // estimate counts as a retransmission, but the timer doesn't back off for it: the next (smaller) attempt
+    // gets the same time as this one.
+    const size_t oldest_size
+      = sent_segs.empty() ? 0 : sent_segs.front().payload.size() + PathMTUCache::TCP_IP_HEADERS_LENGTH;
+    const bool black_hole = path_mtu_ && window > 0 && !probe_lost && retransmissions + 1 >= BLACK_HOLE_TIMEOUTS
+                            && oldest_size > path_mtu_->config().min_mtu;
+    if ( black_hole ) {
+      MINNOW_TRACE( Info, PathMTUBlackHole, destination_, oldest_size );
+      path_mtu_->too_big( destination_, oldest_size );
+    }
+
     // If there are unacknowledged segments and the window size permits, retransmit the oldest unacknowledged
     // segment.
-    if ( window > 0 ) {
+    if ( window > 0 && !probe_lost ) {
       retransmissions++;
-      alarm *= 2;
+      if ( !black_hole ) {
+        alarm *= 2;
+      }
     }
     if ( !sent_segs.empty() ) {
-      outstanding_segs.push_back( sent_segs.front() );
+      MINNOW_TRACE( Info, SegmentRetransmitted, sent_segs.front().seqno.unwrap( zero_point, 0 ), alarm );
+      retransmit_oldest();
     }
     elapsed_time = 0;
   }
 }
+
+void TCPSender::retransmit_oldest()
+{
+  const TCPSenderMessage oldest = sent_segs.front();
+
+  // A lost probe means the path doesn't carry segments that big (or just that it was lost): either way, the
+  // data goes again at the size known to work.
+  if ( probe_mtu_ && oldest.seqno.unwrap( zero_point, 0 ) + oldest.sequence_length() == probe_end_ ) {
+    path_mtu_->probe_failed( destination_, probe_mtu_ );
+    probe_mtu_ = 0;
+  }
+
+  const uint64_t max_payload = max_payload_size();
+  if ( oldest.payload.size() <= max_payload ) {
+    outstanding_segs.push_back( oldest );
+    return;
+  }
+
+  // Too big for the path now (it was a probe, or the path MTU went down): split it into segments that fit,
+  // and resend them all.
+  sent_segs.pop_front();
+  deque<TCPSenderMessage> pieces;
+  Wrap32 seqno = oldest.seqno;
+  for ( size_t start = 0; start < oldest.payload.size(); start += max_payload ) {
+    TCPSenderMessage piece;
+    piece.seqno = seqno;
+    piece.SYN = oldest.SYN && start == 0;
+    piece.payload = oldest.payload.substr( start, max_payload );
+    piece.FIN = oldest.FIN && start + max_payload >= oldest.payload.size();
+    seqno = seqno + piece.sequence_length();
+    pieces.push_back( piece );
+  }
+  sent_segs.insert( sent_segs.begin(), pieces.begin(), pieces.end() );
+  outstanding_segs.insert( outstanding_segs.end(), pieces.begin(), pieces.end() );
+}
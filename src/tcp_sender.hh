@@ -1,9 +1,11 @@
 #pragma once
 
 #include "byte_stream.hh"
+#include "path_mtu_cache.hh"
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 #include <deque>
+#include <memory>
 
 class TCPSender
 {
@@ -21,6 +23,19 @@ protected:
   Wrap32 zero_point = isn_;                         // Reference point for sequence number unwrapping
   bool fin_sent { false };                          // Flag to indicate whether the FIN has been sent
 
+  std::shared_ptr<PathMTUCache> path_mtu_ {}; // Where the maximum payload size comes from, if set
+  uint32_t destination_ { 0 };                // Peer's address, for looking up its path MTU
+  size_t probe_mtu_ { 0 };                    // Size of the path MTU probe in flight (0 if none)
+  uint64_t probe_end_ { 0 };                  // Absolute sequence number just past the probe
+
+  // Black-hole detection (RFC 4821): a hop with a smaller MTU may drop segments for their size without
+  // reporting it. Once a segment bigger than the smallest path MTU has timed out this many times running,
+  // the path MTU estimate is lowered below it, and the segment is resent in pieces that fit.
+  static constexpr uint64_t BLACK_HOLE_TIMEOUTS = 2;
+
+  // Resend the oldest unacknowledged segment, in pieces if it no longer fits the path
+  void retransmit_oldest();
+
 public:
   /* Construct TCP sender with given default Retransmission Timeout and possible ISN */
   TCPSender( uint64_t initial_RTO_ms, std::optional<Wrap32> fixed_isn );
@@ -40,6 +55,13 @@ public:
   /* Time has passed by the given # of milliseconds since the last time the tick() method was called. */
   void tick( uint64_t ms_since_last_tick );
 
+  /* Take the maximum payload size from the path MTU to `destination` (instead of TCPConfig::MAX_PAYLOAD_SIZE),
+     and send path MTU probes when the cache calls for them */
+  void use_path_mtu_cache( std::shared_ptr<PathMTUCache> cache, uint32_t destination );
+
+  /* Largest payload to put in a segment sent now */
+  uint64_t max_payload_size() const;
+
   /* Accessors for use in testing */
   uint64_t sequence_numbers_in_flight() const;  // How many sequence numbers are outstanding?
   uint64_t consecutive_retransmissions() const; // How many consecutive *re*transmissions have happened?
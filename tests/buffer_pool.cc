@@ -0,0 +1,208 @@
+#include "buffer.hh"
+#include "buffer_pool.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Leases are served from the free list once returned, and the pool grows by a slab when it runs out
+void reuse()
+{
+  BufferPool pool { 64, 4 };
+  test_should_be( pool.stats().slabs, uint64_t { 0 } );
+
+  vector<shared_ptr<char>> leases;
+  for ( size_t i = 0; i < 4; ++i ) {
+    leases.push_back( pool.lease() );
+  }
+  test_should_be( pool.stats().misses, uint64_t { 1 } ); // the first lease allocated the first slab
+  test_should_be( pool.stats().hits, uint64_t { 3 } );
+  test_should_be( pool.stats().slabs, uint64_t { 1 } );
+
+  // Exhausted: the next lease falls back to allocating another slab
+  leases.push_back( pool.lease() );
+  test_should_be( pool.stats().misses, uint64_t { 2 } );
+  test_should_be( pool.stats().slabs, uint64_t { 2 } );
+
+  // A returned buffer is the next one handed out
+  const char* const returned = leases.front().get();
+  leases.erase( leases.begin() );
+  const shared_ptr<char> again = pool.lease();
+  test_should_be( again.get() == returned, true );
+  test_should_be( pool.stats().hits, uint64_t { 4 } );
+
+  // Returning everything and leasing it all again needs no new slab
+  leases.clear();
+  for ( size_t i = 0; i < 7; ++i ) {
+    leases.push_back( pool.lease() );
+  }
+  test_should_be( pool.stats().slabs, uint64_t { 2 } );
+  test_should_be( pool.stats().hits, uint64_t { 11 } );
+}
+
+// A Buffer (or any slice of it) keeps its lease out of the pool until the last view is dropped
+void slices_hold_leases()
+{
+  BufferPool pool { 32, 1 };
+  shared_ptr<char> storage = pool.lease();
+  memcpy( storage.get(), "abcdefgh", 8 );
+  const char* const leased = storage.get();
+
+  optional<Buffer> slice;
+  {
+    const Buffer whole { std::move( storage ), 8 };
+    slice = whole.substr( 2, 3 );
+  }
+  test_should_be( string_view { *slice } == "cde", true );
+
+  const shared_ptr<char> other = pool.lease();
+  test_should_be( other.get() == leased, false );
+  test_should_be( pool.stats().slabs, uint64_t { 2 } );
+
+  slice.reset();
+  const shared_ptr<char> recycled = pool.lease();
+  test_should_be( recycled.get() == leased, true );
+}
+
+// Leases (and the control blocks they share) outlive the pool that made them
+void outlive_pool()
+{
+  vector<shared_ptr<char>> leases;
+  {
+    BufferPool pool { 128, 2 };
+    for ( size_t i = 0; i < 3; ++i ) {
+      leases.push_back( pool.lease() );
+    }
+    leases.pop_back(); // goes back to the pool while it is still alive
+  }
+
+  for ( auto& lease : leases ) {
+    memset( lease.get(), 'x', 128 );
+  }
+  const Buffer buffer { leases.front(), 128 };
+  leases.clear();
+  test_should_be( string_view { buffer } == string( 128, 'x' ), true );
+}
+
+// Leases may be dropped on other threads while the owner keeps leasing
+void cross_thread_returns()
+{
+  constexpr size_t per_slab = 8;
+  constexpr size_t batch = 16;
+  BufferPool pool { 64, per_slab };
+  uint64_t leased = 0;
+
+  for ( size_t round = 0; round < 200; ++round ) {
+    vector<shared_ptr<char>> theirs;
+    for ( size_t i = 0; i < batch; ++i ) {
+      theirs.push_back( pool.lease() );
+      memset( theirs.back().get(), 'a', 64 );
+    }
+    thread dropper( [leases = std::move( theirs )]() mutable { leases.clear(); } );
+    for ( size_t i = 0; i < batch; ++i ) {
+      const shared_ptr<char> mine = pool.lease();
+      memset( mine.get(), 'b', 64 );
+    }
+    dropper.join();
+    leased += 2 * batch;
+  }
+  test_should_be( pool.stats().hits + pool.stats().misses, leased );
+
+  // Everything came back: the pool never held more than was leased at once, and can hand it all out again
+  const uint64_t slabs = pool.stats().slabs;
+  test_should_be( slabs <= ( 2 * batch ) / per_slab, true );
+  vector<shared_ptr<char>> all;
+  for ( size_t i = 0; i < slabs * per_slab; ++i ) {
+    all.push_back( pool.lease() );
+  }
+  test_should_be( pool.stats().slabs, slabs );
+}
+
+// The slabs can be handed to the kernel (e.g. io_uring's registered buffers), and every lease lies in one
+void slabs()
+{
+  BufferPool pool { 32, 4 };
+  test_should_be( pool.slabs().empty(), true );
+
+  vector<shared_ptr<char>> leases;
+  for ( size_t i = 0; i < 6; ++i ) {
+    leases.push_back( pool.lease() );
+  }
+  const vector<iovec> slabs = pool.slabs();
+  test_should_be( slabs.size(), size_t { 2 } );
+  for ( const auto& lease : leases ) {
+    size_t containing = 0;
+    for ( const auto& slab : slabs ) {
+      test_should_be( slab.iov_len, size_t { 32 * 4 } );
+      const char* const start = static_cast<const char*>( slab.iov_base );
+      containing += lease.get() >= start and lease.get() + 32 <= start + slab.iov_len;
+    }
+    test_should_be( containing, size_t { 1 } );
+  }
+}
+
+// FileDescriptor reads into leased buffers without copying
+void read_into_pool()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe", ::pipe( fds.data() ) );
+  FileDescriptor read_end { fds[0] };
+  FileDescriptor write_end { fds[1] };
+
+  BufferPool pool { 16, 2 };
+  write_end.write( "hello, pool" );
+  Buffer buffer;
+  read_end.read( buffer, pool );
+  test_should_be( string_view { buffer } == "hello, pool", true );
+  test_should_be( pool.stats().misses, uint64_t { 1 } );
+
+  write_end.close();
+  read_end.read( buffer, pool );
+  test_should_be( buffer.empty() and read_end.eof(), true );
+  test_should_be( pool.stats().hits, uint64_t { 1 } ); // the second read leased the slab's other buffer
+
+  // Reading into a string goes by way of a pool too, and holds only what was read
+  CheckSystemCall( "pipe", ::pipe( fds.data() ) );
+  FileDescriptor other_read { fds[0] };
+  FileDescriptor other_write { fds[1] };
+  other_write.write( "into a string" );
+  string received;
+  other_read.read( received );
+  test_should_be( received == "into a string", true );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    reuse();
+    slices_hold_leases();
+    outlive_pool();
+    cross_thread_returns();
+    slabs();
+    read_into_pool();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
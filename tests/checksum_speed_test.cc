@@ -0,0 +1,109 @@
+#include "checksum.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace std::chrono;
+
+using Implementation = InternetChecksum::Implementation;
+
+string random_bytes( const size_t len, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<char> ud;
+  string ret;
+  for ( size_t i = 0; i < len; ++i ) {
+    ret += ud( rd );
+  }
+  return ret;
+}
+
+// Check that an implementation matches the bytewise one, with the data split into pieces of random
+// (often odd) lengths so that the parity carry between add() calls gets exercised
+void check_exact( const Implementation impl, const string& data, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  for ( size_t trial = 0; trial < 1000; ++trial ) {
+    uniform_int_distribution<size_t> piece_len { 0, trial % 2 ? 70UL : 2000UL };
+    const uint32_t initial_sum = static_cast<uint32_t>( trial ) * 0x9e3779b9U; // exercises wraparound too
+    InternetChecksum expected { initial_sum };
+    InternetChecksum actual { initial_sum };
+    for ( size_t pos = 0; pos < data.size(); ) {
+      const size_t len = min( piece_len( rd ), data.size() - pos );
+      const string_view piece = string_view { data }.substr( pos, len );
+      expected.add( piece, Implementation::Bytewise );
+      actual.add( piece, impl );
+      pos += len;
+    }
+    if ( actual.value() != expected.value() ) {
+      throw runtime_error( "InternetChecksum (" + string( InternetChecksum::name( impl ) )
+                           + ") does not match the bytewise implementation" );
+    }
+  }
+}
+
+void speed_test( const Implementation impl, const string& data, const size_t num_passes )
+{
+  uint16_t result = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_passes; ++i ) {
+    InternetChecksum check;
+    check.add( data, impl );
+    result ^= check.value();
+  }
+  const auto stop_time = steady_clock::now();
+
+  InternetChecksum reference;
+  reference.add( data, Implementation::Bytewise );
+  if ( result != ( num_passes % 2 ? reference.value() : 0 ) ) {
+    throw runtime_error( "InternetChecksum gave an inconsistent result" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double gigabytes_per_second
+    = static_cast<double>( num_passes * data.size() ) / test_duration.count() / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const string name { InternetChecksum::name( impl ) };
+  cout << "InternetChecksum (" << name << ") over " << num_passes << " x " << data.size() << " bytes reached "
+       << fixed << setprecision( 2 ) << gigabytes_per_second << " GB/s.\n";
+
+  debug_output << "             InternetChecksum (" << name << "): " << fixed << setprecision( 2 )
+               << gigabytes_per_second << " GB/s\n";
+
+  if ( gigabytes_per_second < 0.1 ) {
+    throw runtime_error( "InternetChecksum (" + name + ") did not meet minimum speed of 0.1 GB/s." );
+  }
+}
+
+void program_body()
+{
+  const string data = random_bytes( 16384 + 7, 1068 );
+
+  cout << "Fastest supported implementation: " << InternetChecksum::name( InternetChecksum::best_implementation() )
+       << "\n";
+
+  for ( const auto impl : InternetChecksum::supported_implementations() ) {
+    check_exact( impl, data, 1069 );
+    speed_test( impl, data, impl == Implementation::Bytewise ? 8192 : 65536 );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
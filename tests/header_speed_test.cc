@@ -0,0 +1,368 @@
+#include "arp_message.hh"
+#include "checksum.hh"
+#include "ethernet_frame.hh"
+#include "ethernet_header.hh"
+#include "ipv4_datagram.hh"
+#include "ipv4_header.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+// Flatten a serialized header into one contiguous Buffer, as if it had just been read off the wire
+template<class T>
+Buffer wire_bytes( const T& obj )
+{
+  string ret;
+  for ( const auto& x : serialize( obj ) ) {
+    ret.append( x );
+  }
+  return ret;
+}
+
+// The per-field Parser/Serializer code the headers used before their wire formats were described by a
+// HeaderLayout, kept as the baseline the layout-driven code is measured against
+namespace per_field {
+
+void parse( EthernetHeader& header, Parser& parser )
+{
+  for ( auto& b : header.dst ) {
+    parser.integer( b );
+  }
+  for ( auto& b : header.src ) {
+    parser.integer( b );
+  }
+  parser.integer( header.type );
+}
+
+void serialize( const EthernetHeader& header, Serializer& serializer )
+{
+  for ( const auto& b : header.dst ) {
+    serializer.integer( b );
+  }
+  for ( const auto& b : header.src ) {
+    serializer.integer( b );
+  }
+  serializer.integer( header.type );
+}
+
+void serialize( const IPv4Header& header, Serializer& serializer )
+{
+  if ( header.ver != 4 ) {
+    throw runtime_error( "wrong IP version" );
+  }
+
+  const uint8_t first_byte = ( static_cast<uint32_t>( header.ver ) << 4 ) | ( header.hlen & 0xfU );
+  serializer.integer( first_byte );
+  serializer.integer( header.tos );
+  serializer.integer( header.len );
+  serializer.integer( header.id );
+
+  const uint16_t fo_val = ( header.df ? 0x4000U : 0 ) | ( header.mf ? 0x2000U : 0 ) | ( header.offset & 0x1fffU );
+  serializer.integer( fo_val );
+
+  serializer.integer( header.ttl );
+  serializer.integer( header.proto );
+  serializer.integer( header.cksum );
+  serializer.integer( header.src );
+  serializer.integer( header.dst );
+}
+
+void compute_checksum( IPv4Header& header )
+{
+  header.cksum = 0;
+  Serializer s;
+  serialize( header, s );
+
+  InternetChecksum check;
+  check.add( s.output() );
+  header.cksum = check.value();
+}
+
+void parse( IPv4Header& header, Parser& parser )
+{
+  uint8_t first_byte {};
+  parser.integer( first_byte );
+  header.ver = first_byte >> 4;
+  header.hlen = first_byte & 0x0f;
+  parser.integer( header.tos );
+  parser.integer( header.len );
+  parser.integer( header.id );
+
+  uint16_t fo_val {};
+  parser.integer( fo_val );
+  header.df = static_cast<bool>( fo_val & 0x4000 );
+  header.mf = static_cast<bool>( fo_val & 0x2000 );
+  header.offset = fo_val & 0x1fff;
+
+  parser.integer( header.ttl );
+  parser.integer( header.proto );
+  parser.integer( header.cksum );
+  parser.integer( header.src );
+  parser.integer( header.dst );
+
+  if ( header.ver != 4 or header.hlen < 5 ) {
+    parser.set_error();
+  }
+
+  parser.remove_prefix( static_cast<uint64_t>( header.hlen ) * 4 - IPv4Header::LENGTH );
+
+  const uint16_t given_cksum = header.cksum;
+  compute_checksum( header );
+  if ( header.cksum != given_cksum ) {
+    parser.set_error();
+  }
+}
+
+void parse( ARPMessage& arp, Parser& parser )
+{
+  parser.integer( arp.hardware_type );
+  parser.integer( arp.protocol_type );
+  parser.integer( arp.hardware_address_size );
+  parser.integer( arp.protocol_address_size );
+  parser.integer( arp.opcode );
+
+  if ( not arp.supported() ) {
+    parser.set_error();
+    return;
+  }
+
+  for ( auto& b : arp.sender_ethernet_address ) {
+    parser.integer( b );
+  }
+  parser.integer( arp.sender_ip_address );
+
+  for ( auto& b : arp.target_ethernet_address ) {
+    parser.integer( b );
+  }
+  parser.integer( arp.target_ip_address );
+}
+
+void serialize( const ARPMessage& arp, Serializer& serializer )
+{
+  if ( not arp.supported() ) {
+    throw runtime_error( "ARPMessage: unsupported field combination (must be Ethernet/IP, and request or reply)" );
+  }
+
+  serializer.integer( arp.hardware_type );
+  serializer.integer( arp.protocol_type );
+  serializer.integer( arp.hardware_address_size );
+  serializer.integer( arp.protocol_address_size );
+  serializer.integer( arp.opcode );
+
+  for ( const auto& b : arp.sender_ethernet_address ) {
+    serializer.integer( b );
+  }
+  serializer.integer( arp.sender_ip_address );
+
+  for ( const auto& b : arp.target_ethernet_address ) {
+    serializer.integer( b );
+  }
+  serializer.integer( arp.target_ip_address );
+}
+
+} // namespace per_field
+
+double report( const string& name,
+             const string& what,
+             const size_t num_ops,
+             const duration<double> elapsed,
+             const string& unit = "header" )
+{
+  const double ns_per_op = elapsed.count() * 1e9 / static_cast<double>( num_ops );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << name << " " << what << " reached " << fixed << setprecision( 2 ) << 1e3 / ns_per_op << " M" << what
+       << "s/s (" << ns_per_op << " ns/" << unit << ").\n";
+
+  debug_output << "             " << name << " " << what << ": " << fixed << setprecision( 2 ) << ns_per_op
+               << " ns/" << unit << "\n";
+
+  if ( ns_per_op > 10000 ) {
+    throw runtime_error( name + " " + what + " did not meet minimum speed of 0.1 M" + what + "s/s." );
+  }
+
+  return ns_per_op;
+}
+
+// How the layout-driven code compares with the per-field baseline
+void report_ratio( const string& name, const string& what, const double layout_ns, const double per_field_ns )
+{
+  cout << name << " " << what << " is " << fixed << setprecision( 2 ) << per_field_ns / layout_ns
+       << "x as fast as per-field " << what << " (" << per_field_ns << " -> " << layout_ns << " ns/header).\n";
+}
+
+template<class T, class ParseFunction>
+double parse_speed_test( const string& name,
+                         const T& original,
+                         const size_t num_parses,
+                         const ParseFunction& parse_one )
+{
+  const vector<Buffer> wire { wire_bytes( original ) };
+
+  size_t errors = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_parses; ++i ) {
+    T obj;
+    Parser p { wire };
+    parse_one( obj, p );
+    errors += p.has_error();
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( errors ) {
+    throw runtime_error( name + " failed to parse" );
+  }
+
+  return report( name, "parse", num_parses, stop_time - start_time );
+}
+
+template<class T, class SerializeFunction>
+double serialize_speed_test( const string& name,
+                             const T& original,
+                             const size_t num_serializations,
+                             const SerializeFunction& serialize_one )
+{
+  size_t bytes_written = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_serializations; ++i ) {
+    Serializer s;
+    serialize_one( original, s );
+    for ( const auto& x : s.output() ) {
+      bytes_written += x.size();
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_written != num_serializations * T::LENGTH ) {
+    throw runtime_error( name + " serialized to the wrong length" );
+  }
+
+  return report( name, "serialize", num_serializations, stop_time - start_time );
+}
+
+// Time the header's own parse and serialize against the per-field baseline
+template<class T>
+void header_speed_test( const string& name, const T& original, const size_t num_ops )
+{
+  const double layout_parse
+    = parse_speed_test( name, original, num_ops, []( T& obj, Parser& p ) { obj.parse( p ); } );
+  const double per_field_parse = parse_speed_test(
+    name + " (per-field)", original, num_ops, []( T& obj, Parser& p ) { per_field::parse( obj, p ); } );
+  report_ratio( name, "parse", layout_parse, per_field_parse );
+
+  const double layout_serialize = serialize_speed_test(
+    name, original, num_ops, []( const T& obj, Serializer& s ) { obj.serialize( s ); } );
+  const double per_field_serialize
+    = serialize_speed_test( name + " (per-field)", original, num_ops, []( const T& obj, Serializer& s ) {
+        per_field::serialize( obj, s );
+      } );
+  report_ratio( name, "serialize", layout_serialize, per_field_serialize );
+}
+
+// The per-packet header work of forwarding: decrement the TTL and fix up the checksum
+void ttl_speed_test( const string& name, IPv4Header header, const bool incremental, const size_t num_packets )
+{
+  const IPv4Header original = header;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_packets; ++i ) {
+    if ( header.ttl <= 1 ) {
+      header.ttl = original.ttl + 1;
+      header.compute_checksum();
+    }
+    if ( incremental ) {
+      header.decrement_ttl();
+    } else {
+      header.ttl--;
+      header.compute_checksum();
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  const uint16_t cksum = header.cksum;
+  header.compute_checksum();
+  if ( header.cksum != cksum ) {
+    throw runtime_error( name + " left a wrong checksum" );
+  }
+
+  report( name, "TTL decrement", num_packets, stop_time - start_time );
+}
+
+// Frame a datagram and serialize the frame, as a NetworkInterface and the link below it would
+void frame_speed_test( const string& name,
+                       const InternetDatagram& dgram,
+                       const size_t headroom,
+                       const size_t num_frames )
+{
+  EthernetFrame frame;
+  frame.header = { { 0x02, 0, 0, 0, 0, 0x02 }, { 0x02, 0, 0, 0, 0, 0x01 }, EthernetHeader::TYPE_IPv4 };
+
+  size_t bytes_written = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_frames; ++i ) {
+    if ( headroom ) {
+      frame.payload = { serialize_contiguous( dgram, headroom ) };
+    } else {
+      frame.payload = serialize( dgram );
+    }
+    for ( const auto& x : serialize( frame ) ) {
+      bytes_written += x.size();
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_written != num_frames * ( EthernetHeader::LENGTH + dgram.serialized_length() ) ) {
+    throw runtime_error( name + " serialized to the wrong length" );
+  }
+
+  report( name, "frame", num_frames, stop_time - start_time, "frame" );
+}
+
+void program_body()
+{
+  constexpr size_t num_parses = 2'000'000;
+
+  EthernetHeader eth { { 0x02, 0, 0, 0, 0, 0x01 }, { 0x02, 0, 0, 0, 0, 0x02 }, EthernetHeader::TYPE_IPv4 };
+  header_speed_test( "EthernetHeader", eth, num_parses );
+
+  IPv4Header ip;
+  ip.src = 0x0a000002;
+  ip.dst = 0x0a000102;
+  ip.len = 1420;
+  ip.compute_checksum();
+  header_speed_test( "IPv4Header", ip, num_parses );
+  ttl_speed_test( "IPv4Header (recompute)", ip, false, num_parses );
+  ttl_speed_test( "IPv4Header (incremental)", ip, true, num_parses );
+
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REQUEST;
+  arp.sender_ethernet_address = eth.src;
+  arp.sender_ip_address = ip.src;
+  arp.target_ip_address = ip.dst;
+  header_speed_test( "ARPMessage", arp, num_parses );
+
+  InternetDatagram dgram;
+  dgram.header = ip;
+  dgram.payload.emplace_back( string( ip.len - IPv4Header::LENGTH, 'x' ) );
+  frame_speed_test( "EthernetFrame (scattered)", dgram, 0, num_parses );
+  frame_speed_test( "EthernetFrame (contiguous)", dgram, EthernetHeader::LENGTH, num_parses );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
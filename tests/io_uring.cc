@@ -0,0 +1,252 @@
+#include "buffer_pool.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "io_uring.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <span>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe", ::pipe( fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// Batch two writes and then two reads on a pipe, one submit() each
+void ring_round_trip()
+{
+  auto [read_end, write_end] = make_pipe();
+  IOUring ring { 8 };
+
+  string hello = "hello, ";
+  string world = "world";
+  const vector<iovec> first { { hello.data(), hello.size() } };
+  const vector<iovec> second { { world.data(), world.size() } };
+  ring.prepare_writev( write_end, first, 1 );
+  ring.prepare_writev( write_end, second, 2 );
+  test_should_be( ring.unsubmitted(), 2U );
+  test_should_be( ring.submit( 2 ), 2U );
+  test_should_be( ring.unsubmitted(), 0U );
+
+  vector<IOUring::Completion> completions;
+  while ( completions.size() < 2 ) {
+    ring.reap( completions );
+  }
+  test_should_be( completions.size(), size_t { 2 } );
+  for ( const auto& completion : completions ) {
+    const size_t expected = completion.user_data == 1 ? hello.size() : world.size();
+    test_should_be( completion.result, static_cast<int32_t>( expected ) );
+  }
+
+  string head( 5, 0 );
+  string tail( 7, 0 );
+  const vector<iovec> scatter { { head.data(), head.size() }, { tail.data(), tail.size() } };
+  ring.prepare_readv( read_end, scatter, 3 );
+  ring.submit( 1 );
+  completions.clear();
+  while ( ring.reap( completions ) == 0 ) {
+    ring.submit( 1 );
+  }
+  test_should_be( completions.front().user_data, uint64_t { 3 } );
+  test_should_be( completions.front().result, int32_t { 12 } );
+  test_should_be( head + tail == "hello, world", true );
+}
+
+// A failed operation completes with -errno rather than throwing
+void ring_error()
+{
+  auto [read_end, write_end] = make_pipe();
+  IOUring ring { 4 };
+
+  string buffer( 16, 0 );
+  const vector<iovec> iov { { buffer.data(), buffer.size() } };
+  ring.prepare_readv( write_end, iov, 7 ); // reading from the write end of a pipe
+  ring.submit( 1 );
+  vector<IOUring::Completion> completions;
+  while ( ring.reap( completions ) == 0 ) {
+    ring.submit( 1 );
+  }
+  test_should_be( completions.front().user_data, uint64_t { 7 } );
+  test_should_be( completions.front().result, int32_t { -EBADF } );
+}
+
+// Many operations, on many descriptors, cost one io_uring_enter(2) per batch rather than one each
+void batched_enters()
+{
+  constexpr size_t N = 16;
+  vector<pair<FileDescriptor, FileDescriptor>> pipes;
+  vector<string> messages;
+  for ( size_t i = 0; i < N; ++i ) {
+    pipes.push_back( make_pipe() );
+    messages.push_back( "message " + to_string( i ) );
+  }
+
+  IOUring ring { N };
+  const uint64_t before = ring.enters();
+  for ( size_t i = 0; i < N; ++i ) {
+    ring.prepare_write( pipes[i].second, messages[i], i );
+  }
+  vector<IOUring::Completion> completions;
+  test_should_be( ring.submit_and_reap( completions, N ), N );
+  test_should_be( ring.enters() - before, uint64_t { 1 } );
+
+  vector<string> received( N, string( 32, 0 ) );
+  for ( size_t i = 0; i < N; ++i ) {
+    ring.prepare_read( pipes[i].first, received[i], i );
+  }
+  completions.clear();
+  test_should_be( ring.submit_and_reap( completions, N ), N );
+  test_should_be( ring.enters() - before, uint64_t { 2 } ); // 2 * N operations
+
+  for ( const auto& completion : completions ) {
+    const string& message = messages.at( completion.user_data );
+    test_should_be( completion.result, static_cast<int32_t>( message.size() ) );
+    test_should_be( received[completion.user_data].substr( 0, message.size() ) == message, true );
+  }
+}
+
+// Reads into registered (pinned) buffers
+void fixed_buffers()
+{
+  auto [read_end, write_end] = make_pipe();
+  IOUring ring { 4 };
+
+  string region( 4096, 0 );
+  const vector<iovec> registered { { region.data(), region.size() } };
+  ring.register_buffers( registered );
+
+  write_end.write( "pinned" );
+  ring.prepare_read_fixed( read_end, span<char> { region }.subspan( 100, 64 ), 0, 5 );
+  vector<IOUring::Completion> completions;
+  ring.submit_and_reap( completions, 1 );
+  test_should_be( completions.front().user_data, uint64_t { 5 } );
+  test_should_be( completions.front().result, int32_t { 6 } );
+  test_should_be( region.substr( 100, 6 ) == "pinned", true );
+
+  ring.unregister_buffers();
+}
+
+// A BufferPool's slabs registered with the ring: leases are read into as fixed buffers
+void pool_fixed_buffers()
+{
+  auto [read_end, write_end] = make_pipe();
+  IOUring ring { 4 };
+  BufferPool pool { 256, 8 };
+  const shared_ptr<char> lease = pool.lease();
+  ring.register_buffers( pool.slabs() );
+
+  write_end.write( "from the pool" );
+  ring.prepare_read_fixed( read_end, { lease.get(), pool.buffer_size() }, 0, 6 );
+  vector<IOUring::Completion> completions;
+  ring.submit_and_reap( completions, 1 );
+  test_should_be( completions.front().result, int32_t { 13 } );
+  test_should_be( ( string_view { lease.get(), 13 } == "from the pool" ), true );
+
+  ring.unregister_buffers();
+}
+
+// One multishot receive stays armed for many datagrams, each landing in a buffer the kernel picks
+void multishot_recv()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  FileDescriptor a { fds[0] };
+  FileDescriptor b { fds[1] };
+
+  IOUring ring { 4 };
+  ring.add_buffer_ring( 1, 4, 64 );
+  ring.prepare_recv_multishot( b, 1, 9 );
+  ring.submit();
+
+  const vector<string> datagrams { "one", "two", "three", "four", "five", "six" };
+  vector<string> received;
+  vector<IOUring::Completion> completions;
+  for ( const auto& datagram : datagrams ) {
+    a.write( datagram );
+    completions.clear();
+    ring.submit_and_reap( completions, 1 );
+    test_should_be( completions.size(), size_t { 1 } );
+    const IOUring::Completion& completion = completions.front();
+    test_should_be( completion.user_data, uint64_t { 9 } );
+    test_should_be( completion.more(), true );
+    received.emplace_back( ring.provided_buffer( 1, completion ) );
+    ring.recycle_buffer( 1, completion.buffer_id().value() );
+  }
+  test_should_be( received == datagrams, true ); // more datagrams than buffers: recycled ones were reused
+}
+
+// FileDescriptor's reads and writes go through the ring, including a scatter write and an error
+void file_descriptor_backend()
+{
+  test_should_be( FileDescriptor::set_io_backend( FileDescriptor::IOBackend::IOUring )
+                    == FileDescriptor::IOBackend::IOUring,
+                  true );
+
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM, 0, fds.data() ) );
+  FileDescriptor a { fds[0] };
+  FileDescriptor b { fds[1] };
+
+  test_should_be( a.write( vector<string_view> { "ping", " ", "pong" } ), size_t { 9 } );
+  string received;
+  b.read( received );
+  test_should_be( received == "ping pong", true );
+  test_should_be( b.read_count(), 1U );
+  test_should_be( a.write_count(), 1U );
+
+  a.close();
+  b.read( received );
+  test_should_be( received.empty() and b.eof(), true );
+
+  auto [read_end, write_end] = make_pipe();
+  bool threw = false;
+  try {
+    write_end.read( received );
+  } catch ( const unix_error& ) {
+    threw = true;
+  }
+  test_should_be( threw, true );
+
+  FileDescriptor::set_io_backend( FileDescriptor::IOBackend::Syscall );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    if ( not IOUring::supported() ) {
+      cerr << "io_uring is not available here; skipping.\n";
+      return EXIT_SUCCESS;
+    }
+    ring_round_trip();
+    ring_error();
+    batched_enters();
+    fixed_buffers();
+    pool_fixed_buffers();
+    multishot_recv();
+    file_descriptor_backend();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
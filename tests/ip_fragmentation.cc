@@ -0,0 +1,405 @@
+#include "ip_fragmentation.hh"
+
+#include "arp_message.hh"
+#include "ethernet_frame.hh"
+#include "network_interface_test_harness.hh"
+#include "random.hh"
+#include "test_should_be.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+string random_payload( const size_t length, default_random_engine& rd )
+{
+  string ret( length, 0 );
+  ranges::generate( ret, [&] { return static_cast<char>( rd() ); } );
+  return ret;
+}
+
+InternetDatagram make_datagram( const string& payload, const uint16_t id )
+{
+  InternetDatagram dgram;
+  dgram.header.src = Address( "10.0.0.1" ).ipv4_numeric();
+  dgram.header.dst = Address( "10.0.0.2" ).ipv4_numeric();
+  dgram.header.id = id;
+  dgram.header.df = false;
+  dgram.header.len = IPv4Header::LENGTH + payload.size();
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( payload );
+  return dgram;
+}
+
+// A fragment carrying (a copy of) payload bytes [first, first + length) of a datagram
+InternetDatagram make_fragment( const InternetDatagram& dgram, const size_t first, const size_t length, bool mf )
+{
+  InternetDatagram fragment;
+  fragment.header = dgram.header;
+  fragment.header.offset = first / 8;
+  fragment.header.mf = mf;
+  fragment.header.len = IPv4Header::LENGTH + length;
+  fragment.header.compute_checksum();
+  fragment.payload.emplace_back( string { string_view { dgram.payload.front() }.substr( first, length ) } );
+  return fragment;
+}
+
+string payload_of( const InternetDatagram& dgram )
+{
+  string ret;
+  for ( const auto& x : dgram.payload ) {
+    ret.append( x );
+  }
+  return ret;
+}
+
+// What the reassembler charges for a datagram in progress whose pieces keep `retained` bytes of
+// buffers alive
+size_t charge( const size_t retained, const size_t pieces )
+{
+  return IPReassembler::DATAGRAM_OVERHEAD + retained + pieces * IPReassembler::PIECE_OVERHEAD;
+}
+
+// A reassembled datagram matches the original
+void expect_same( const optional<InternetDatagram>& reassembled, const InternetDatagram& original )
+{
+  test_should_be( reassembled.has_value(), true );
+  test_should_be( reassembled->header.len, original.header.len );
+  test_should_be( reassembled->header.id, original.header.id );
+  test_should_be( reassembled->header.mf, false );
+  test_should_be( reassembled->header.offset, uint16_t { 0 } );
+  test_should_be( payload_of( *reassembled ) == payload_of( original ), true );
+
+  IPv4Header header = reassembled->header;
+  header.compute_checksum();
+  test_should_be( header.cksum, reassembled->header.cksum );
+}
+
+void fragment_test( default_random_engine& rd )
+{
+  const InternetDatagram dgram = make_datagram( random_payload( 4000, rd ), 1 );
+  vector<InternetDatagram> fragments;
+  fragment_datagram( dgram, 1500, fragments );
+
+  test_should_be( fragments.size(), size_t { 3 } );
+  const vector<size_t> lengths { 1480, 1480, 1040 };
+  for ( size_t i = 0; i < fragments.size(); ++i ) {
+    const IPv4Header& header = fragments[i].header;
+    test_should_be( size_t { header.len }, IPv4Header::LENGTH + lengths[i] );
+    test_should_be( size_t { header.offset }, i * 1480 / 8 );
+    test_should_be( header.mf, i + 1 < fragments.size() );
+    test_should_be( fragments[i].serialized_length() <= 1500, true );
+  }
+
+  // Fragmenting a fragment keeps its place in the original datagram
+  vector<InternetDatagram> refragments;
+  fragment_datagram( fragments[1], 576, refragments );
+  test_should_be( refragments.size(), size_t { 3 } );
+  test_should_be( refragments.front().header.offset, fragments[1].header.offset );
+  test_should_be( refragments.back().header.mf, true );
+
+  // Small datagrams pass through whole
+  vector<InternetDatagram> whole;
+  fragment_datagram( make_datagram( "hello", 2 ), 1500, whole );
+  test_should_be( whole.size(), size_t { 1 } );
+  test_should_be( whole.front().header.mf, false );
+}
+
+void reassembly_test( default_random_engine& rd )
+{
+  const InternetDatagram dgram = make_datagram( random_payload( 10000, rd ), 3 );
+  vector<InternetDatagram> fragments;
+  fragment_datagram( dgram, 576, fragments );
+
+  // In order, reversed, shuffled, and shuffled with every fragment arriving twice
+  for ( size_t round = 0; round < 4; ++round ) {
+    vector<InternetDatagram> order = fragments;
+    if ( round == 1 ) {
+      ranges::reverse( order );
+    } else if ( round >= 2 ) {
+      ranges::shuffle( order, rd );
+    }
+    if ( round == 3 ) {
+      vector<InternetDatagram> twice;
+      for ( const auto& fragment : order ) {
+        twice.push_back( fragment );
+        twice.push_back( fragment );
+      }
+      order = std::move( twice );
+    }
+
+    IPReassembler reassembler;
+    optional<InternetDatagram> result;
+    for ( const auto& fragment : order ) {
+      auto reassembled = reassembler.add( InternetDatagram { fragment } );
+      if ( reassembled.has_value() ) {
+        test_should_be( result.has_value(), false ); // reassembled only once
+        result = std::move( reassembled );
+      }
+    }
+    expect_same( result, dgram );
+    if ( round < 3 ) {
+      test_should_be( reassembler.bytes_buffered(), size_t { 0 } );
+      test_should_be( reassembler.datagrams_in_progress(), size_t { 0 } );
+    }
+  }
+
+  // Overlapping fragments: each byte is taken from the first fragment that carries it, and a fragment
+  // is charged once however many holes it fills
+  IPReassembler reassembler;
+  test_should_be( reassembler.add( make_fragment( dgram, 800, 400, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( dgram, 1000, 9000, false ) ).has_value(), false );
+  test_should_be( reassembler.bytes_buffered(), charge( 400 + 9000, 2 ) );
+  test_should_be( reassembler.add( make_fragment( dgram, 8, 1600, true ) ).has_value(), false );
+  test_should_be( reassembler.bytes_buffered(), charge( 400 + 9000 + 1600, 3 ) );
+  test_should_be( reassembler.add( make_fragment( dgram, 800, 400, true ) ).has_value(), false ); // again
+  test_should_be( reassembler.bytes_buffered(), charge( 400 + 9000 + 1600, 3 ) );
+  expect_same( reassembler.add( make_fragment( dgram, 0, 16, true ) ), dgram );
+  test_should_be( reassembler.bytes_buffered(), size_t { 0 } );
+
+  // Fragments of different datagrams don't mix
+  const InternetDatagram other = make_datagram( random_payload( 2000, rd ), 4 );
+  test_should_be( reassembler.add( make_fragment( dgram, 0, 5000, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( other, 1000, 1000, false ) ).has_value(), false );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 2 } );
+  expect_same( reassembler.add( make_fragment( other, 0, 1000, true ) ), other );
+  expect_same( reassembler.add( make_fragment( dgram, 5000, 5000, false ) ), dgram );
+}
+
+void limits_test( default_random_engine& rd )
+{
+  const InternetDatagram a = make_datagram( random_payload( 3000, rd ), 5 );
+  const InternetDatagram b = make_datagram( random_payload( 3000, rd ), 6 );
+  const InternetDatagram c = make_datagram( random_payload( 3000, rd ), 7 );
+
+  // Incomplete datagrams time out
+  IPReassembler reassembler { 4000, 1000 };
+  test_should_be( reassembler.add( make_fragment( a, 0, 1000, true ) ).has_value(), false );
+  reassembler.tick( 999 );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 1 } );
+  reassembler.tick( 1 );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 0 } );
+  test_should_be( reassembler.timed_out(), uint64_t { 1 } );
+  test_should_be( reassembler.bytes_buffered(), size_t { 0 } );
+
+  // Memory is bounded: the oldest datagram makes room for the newest
+  test_should_be( reassembler.add( make_fragment( a, 0, 1496, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( b, 0, 1496, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( c, 0, 1496, true ) ).has_value(), false );
+  test_should_be( reassembler.evicted(), uint64_t { 1 } );
+  test_should_be( reassembler.bytes_buffered(), 2 * charge( 1496, 1 ) );
+  expect_same( reassembler.add( make_fragment( b, 1496, 1504, false ) ), b );
+  expect_same( reassembler.add( make_fragment( c, 1496, 1504, false ) ), c );
+  test_should_be( reassembler.add( make_fragment( a, 1496, 1504, false ) ).has_value(), false ); // too late
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 1 } );                           // a started over
+
+  // A fragment that could never fit is not taken at all
+  const InternetDatagram d = make_datagram( random_payload( 4000, rd ), 9 );
+  test_should_be( reassembler.add( make_fragment( d, 0, 4000, true ) ).has_value(), false );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 1 } );
+  test_should_be( reassembler.evicted(), uint64_t { 1 } );
+}
+
+// A fragment is charged for all the storage it shares, not just the slice it carries
+void retained_test( default_random_engine& rd )
+{
+  const InternetDatagram dgram = make_datagram( random_payload( 3000, rd ), 8 );
+
+  // A fragment whose payload is the last 1000 bytes of a 5000-byte buffer (as a fragment parsed off the
+  // wire shares its frame's buffer)
+  InternetDatagram fragment = make_fragment( dgram, 2000, 1000, false );
+  const string storage = string( 4000, 'x' ) + payload_of( fragment );
+  fragment.payload = { Buffer { storage }.substr( 4000, 1000 ) };
+
+  IPReassembler reassembler;
+  test_should_be( reassembler.add( std::move( fragment ) ).has_value(), false );
+  test_should_be( reassembler.bytes_buffered(), charge( 5000, 1 ) );
+
+  // Slices of one buffer (as when fragment_datagram() splits a datagram) share it: it is charged once,
+  // as far as any of them reaches
+  const InternetDatagram other = make_datagram( random_payload( 3000, rd ), 9 );
+  const Buffer shared { payload_of( other ) };
+  InternetDatagram second = make_fragment( other, 1000, 1000, true );
+  second.payload = { shared.substr( 1000, 1000 ) };
+  InternetDatagram first = make_fragment( other, 0, 1000, true );
+  first.payload = { shared.substr( 0, 1000 ) };
+  test_should_be( reassembler.add( std::move( second ) ).has_value(), false );
+  test_should_be( reassembler.add( std::move( first ) ).has_value(), false );
+  test_should_be( reassembler.bytes_buffered(), charge( 5000, 1 ) + charge( 2000, 2 ) );
+
+  // Too much of that to fit in the reassembler's memory: not taken
+  IPReassembler small { 4000, 1000 };
+  InternetDatagram big = make_fragment( dgram, 2000, 1000, false );
+  big.payload = { Buffer { storage }.substr( 4000, 1000 ) };
+  test_should_be( small.add( std::move( big ) ).has_value(), false );
+  test_should_be( small.datagrams_in_progress(), size_t { 0 } );
+  test_should_be( small.bytes_buffered(), size_t { 0 } );
+}
+
+// No more than max_datagrams are in progress at once: the oldest makes room for the newest
+void datagram_limit_test( default_random_engine& rd )
+{
+  IPReassembler reassembler { 1 << 20, 1000, 2 };
+  vector<InternetDatagram> dgrams;
+  for ( uint16_t id = 10; id < 13; ++id ) {
+    dgrams.push_back( make_datagram( random_payload( 100, rd ), id ) );
+  }
+
+  test_should_be( reassembler.add( make_fragment( dgrams[0], 0, 8, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( dgrams[1], 0, 8, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( dgrams[2], 0, 8, true ) ).has_value(), false );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 2 } );
+  test_should_be( reassembler.evicted(), uint64_t { 1 } );
+  test_should_be( reassembler.bytes_buffered(), 2 * charge( 8, 1 ) );
+
+  // More of a datagram already in progress doesn't count against the limit
+  test_should_be( reassembler.add( make_fragment( dgrams[1], 8, 8, true ) ).has_value(), false );
+  test_should_be( reassembler.evicted(), uint64_t { 1 } );
+  expect_same( reassembler.add( make_fragment( dgrams[2], 8, 92, false ) ), dgrams[2] );
+  expect_same( reassembler.add( make_fragment( dgrams[1], 16, 84, false ) ), dgrams[1] );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 0 } );
+}
+
+// Empty fragments are taken only to finish a datagram in progress
+void empty_fragment_test( default_random_engine& rd )
+{
+  const InternetDatagram dgram = make_datagram( random_payload( 1000, rd ), 14 );
+  IPReassembler reassembler;
+
+  // An empty last fragment with nothing before it would start a datagram holding nothing
+  test_should_be( reassembler.add( make_fragment( dgram, 1000, 0, false ) ).has_value(), false );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 0 } );
+  test_should_be( reassembler.bytes_buffered(), size_t { 0 } );
+
+  // An empty fragment with more to come says nothing at all
+  test_should_be( reassembler.add( make_fragment( dgram, 1000, 0, true ) ).has_value(), false );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 0 } );
+
+  // But it does say where a datagram in progress ends
+  test_should_be( reassembler.add( make_fragment( dgram, 0, 1000, true ) ).has_value(), false );
+  test_should_be( reassembler.add( make_fragment( dgram, 1000, 0, true ) ).has_value(), false );
+  test_should_be( reassembler.bytes_buffered(), charge( 1000, 1 ) );
+  expect_same( reassembler.add( make_fragment( dgram, 1000, 0, false ) ), dgram );
+  test_should_be( reassembler.datagrams_in_progress(), size_t { 0 } );
+  test_should_be( reassembler.bytes_buffered(), size_t { 0 } );
+}
+
+EthernetFrame make_frame( const EthernetAddress& src,
+                          const EthernetAddress& dst,
+                          const uint16_t type,
+                          vector<Buffer> payload )
+{
+  EthernetFrame frame;
+  frame.header.src = src;
+  frame.header.dst = dst;
+  frame.header.type = type;
+  frame.payload = std::move( payload );
+  return frame;
+}
+
+void interface_test( default_random_engine& rd )
+{
+  const EthernetAddress local_eth { 0x02, 0, 0, 0, 0, 1 };
+  const EthernetAddress remote_eth { 0x02, 0, 0, 0, 0, 2 };
+
+  NetworkInterface::Config config;
+  config.mtu = 1000;
+  config.reassemble_fragments = true;
+
+  // A datagram that may be fragmented goes out as fragments that each fit in the MTU
+  const InternetDatagram dgram = make_datagram( random_payload( 2500, rd ), 15 );
+  vector<InternetDatagram> fragments;
+  fragment_datagram( dgram, config.mtu, fragments );
+  test_should_be( fragments.size(), size_t { 3 } );
+  vector<EthernetFrame> frames;
+  for ( const auto& fragment : fragments ) {
+    frames.push_back( make_frame( local_eth, remote_eth, EthernetHeader::TYPE_IPv4, serialize( fragment ) ) );
+  }
+
+  {
+    NetworkInterfaceTestHarness test { "fragments on the way out", local_eth, Address( "10.0.0.1" ), config };
+
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = remote_eth;
+    arp.sender_ip_address = Address( "10.0.0.2" ).ipv4_numeric();
+    arp.target_ethernet_address = local_eth;
+    arp.target_ip_address = Address( "10.0.0.1" ).ipv4_numeric();
+    test.execute(
+      ReceiveFrame { make_frame( remote_eth, local_eth, EthernetHeader::TYPE_ARP, serialize( arp ) ), {} } );
+
+    test.execute( SendDatagram { dgram, Address( "10.0.0.2" ) } );
+    for ( const auto& frame : frames ) {
+      test.execute( ExpectFrame { frame } );
+    }
+    test.execute( ExpectNoFrame {} );
+    test.execute( ExpectOversizeDropped { 0 } );
+
+    // One that may not be fragmented is dropped
+    InternetDatagram df = dgram;
+    df.header.df = true;
+    df.header.compute_checksum();
+    test.execute( SendDatagram { df, Address( "10.0.0.2" ) } );
+    test.execute( ExpectNoFrame {} );
+    test.execute( ExpectOversizeDropped { 1 } );
+  }
+
+  {
+    // ... and arrives whole at the other end, in whatever order
+    NetworkInterfaceTestHarness test { "reassembly on the way in", remote_eth, Address( "10.0.0.2" ), config };
+    test.execute( ReceiveFrame { frames[2], {} } );
+    test.execute( ReceiveFrame { frames[0], {} } );
+    test.execute( ReceiveFrame { frames[1], dgram } );
+  }
+
+  {
+    // Without a configured MTU, nothing is too big for the link: the datagram goes out whole
+    NetworkInterfaceTestHarness test { "no MTU by default", local_eth, Address( "10.0.0.1" ) };
+
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = remote_eth;
+    arp.sender_ip_address = Address( "10.0.0.2" ).ipv4_numeric();
+    arp.target_ethernet_address = local_eth;
+    arp.target_ip_address = Address( "10.0.0.1" ).ipv4_numeric();
+    test.execute(
+      ReceiveFrame { make_frame( remote_eth, local_eth, EthernetHeader::TYPE_ARP, serialize( arp ) ), {} } );
+
+    InternetDatagram df = dgram;
+    df.header.df = true;
+    df.header.compute_checksum();
+    test.execute( SendDatagram { df, Address( "10.0.0.2" ) } );
+    test.execute(
+      ExpectFrame { make_frame( local_eth, remote_eth, EthernetHeader::TYPE_IPv4, serialize( df ) ) } );
+    test.execute( ExpectOversizeDropped { 0 } );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+    fragment_test( rd );
+    reassembly_test( rd );
+    limits_test( rd );
+    retained_test( rd );
+    datagram_limit_test( rd );
+    empty_fragment_test( rd );
+    interface_test( rd );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
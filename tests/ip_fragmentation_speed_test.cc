@@ -0,0 +1,119 @@
+#include "ip_fragmentation.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Fragment `num_datagrams` datagrams of `num_fragments` fragments each and reassemble them again, with
+// the fragments of each datagram arriving in order or reversed, and report fragments per second.
+double fragmentation_speed_test( const size_t num_fragments, // NOLINT(bugprone-easily-swappable-parameters)
+                                 const size_t num_datagrams, // NOLINT(bugprone-easily-swappable-parameters)
+                                 const bool reversed )
+{
+  constexpr size_t mtu = 1500;
+  constexpr size_t fragment_payload = ( mtu - IPv4Header::LENGTH ) / 8 * 8;
+  const size_t payload_length = min( num_fragments * fragment_payload, size_t { 65535 } - IPv4Header::LENGTH );
+
+  const string payload = [&] {
+    default_random_engine rd { 9 };
+    uniform_int_distribution<char> ud;
+    string ret( payload_length, 0 );
+    ranges::generate( ret, [&] { return ud( rd ); } );
+    return ret;
+  }();
+
+  InternetDatagram dgram;
+  dgram.header.src = 0x0A000001;
+  dgram.header.dst = 0x0A000002;
+  dgram.header.df = false;
+  dgram.header.len = IPv4Header::LENGTH + payload.size();
+  dgram.payload.emplace_back( payload );
+
+  IPReassembler reassembler;
+  vector<InternetDatagram> fragments;
+  size_t fragments_sent = 0;
+  size_t bytes_reassembled = 0;
+
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_datagrams; ++i ) {
+    dgram.header.id = static_cast<uint16_t>( i );
+    dgram.header.compute_checksum();
+
+    fragments.clear();
+    fragment_datagram( dgram, mtu, fragments );
+    if ( reversed ) {
+      ranges::reverse( fragments );
+    }
+    fragments_sent += fragments.size();
+
+    for ( auto& fragment : fragments ) {
+      if ( auto result = reassembler.add( std::move( fragment ) ) ) {
+        bytes_reassembled += result->header.len - IPv4Header::LENGTH;
+      }
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( fragments_sent != num_fragments * num_datagrams ) {
+    throw runtime_error( "Datagrams were split into " + to_string( fragments_sent ) + " fragments, expected "
+                         + to_string( num_fragments * num_datagrams ) );
+  }
+
+  if ( bytes_reassembled != payload_length * num_datagrams or reassembler.datagrams_in_progress() != 0 ) {
+    throw runtime_error( "Not every datagram was reassembled" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double fragments_per_second = static_cast<double>( fragments_sent ) / test_duration.count();
+  const double gigabits_per_second
+    = 8 * static_cast<double>( bytes_reassembled ) / test_duration.count() / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Fragmenting and reassembling " << num_fragments << " fragments per datagram"
+       << ( reversed ? " (reversed)" : "" ) << " reached " << fixed << setprecision( 2 )
+       << fragments_per_second / 1e6 << " M fragments/s (" << gigabits_per_second << " Gbit/s).\n";
+
+  debug_output << "             IP fragmentation (" << setw( 2 ) << num_fragments << " fragments"
+               << ( reversed ? ", reversed" : "" ) << "): " << fixed << setprecision( 2 )
+               << fragments_per_second / 1e6 << " M fragments/s\n";
+
+  if ( fragments_per_second < 100'000 ) {
+    throw runtime_error( "IP fragmentation did not meet minimum speed of 100,000 fragments/s." );
+  }
+
+  return fragments_per_second;
+}
+
+void program_body()
+{
+  for ( const size_t num_fragments : { 2, 8, 44 } ) {
+    const size_t num_datagrams = 800'000 / num_fragments;
+    fragmentation_speed_test( num_fragments, num_datagrams, false );
+    fragmentation_speed_test( num_fragments, num_datagrams, true );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+#include "lpm_table.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+struct Prefix
+{
+  uint32_t prefix;
+  uint8_t length;
+};
+
+uint32_t mask( uint8_t prefix_length )
+{
+  return prefix_length == 0 ? 0 : 0xffffffffU << ( 32 - prefix_length );
+}
+
+// A synthetic table with roughly the prefix-length distribution of the IPv4 default-free zone
+vector<Prefix> bgp_table( const size_t num_prefixes, default_random_engine& rd )
+{
+  // weights for lengths /8 through /28 (per mille)
+  const vector<double> weights { 0.1, 0.1, 0.2, 0.3, 0.6, 1,  1.5, 3,   15,  8,   13, 25,
+                                 45,  50,  120, 100, 600, 0.5, 0.5, 0.5, 0.5 };
+  discrete_distribution<uint8_t> length_dist { weights.begin(), weights.end() };
+  uniform_int_distribution<uint32_t> address_dist { 0x01000000, 0xdfffffff }; // unicast space
+
+  vector<Prefix> ret;
+  ret.reserve( num_prefixes );
+  vector<unordered_set<uint32_t>> seen( 33 );
+  while ( ret.size() < num_prefixes ) {
+    const uint8_t length = length_dist( rd ) + 8;
+    const uint32_t prefix = address_dist( rd ) & mask( length );
+    if ( seen.at( length ).insert( prefix ).second ) {
+      ret.push_back( { prefix, length } );
+    }
+  }
+  return ret;
+}
+
+// Reference longest-prefix match: try every length, longest first
+class ReferenceTable
+{
+  vector<unordered_map<uint32_t, uint32_t>> rules_ = vector<unordered_map<uint32_t, uint32_t>>( 33 );
+
+public:
+  void insert( const Prefix& p, uint32_t value ) { rules_.at( p.length )[p.prefix] = value; }
+  void erase( const Prefix& p ) { rules_.at( p.length ).erase( p.prefix ); }
+
+  optional<uint32_t> lookup( uint32_t address ) const
+  {
+    for ( int len = 32; len >= 0; --len ) {
+      const auto it = rules_.at( len ).find( address & mask( len ) );
+      if ( it != rules_.at( len ).end() ) {
+        return it->second;
+      }
+    }
+    return {};
+  }
+};
+
+void check( const LPMTable& table, const ReferenceTable& reference, default_random_engine& rd )
+{
+  uniform_int_distribution<uint32_t> address_dist;
+  for ( size_t i = 0; i < 200'000; ++i ) {
+    const uint32_t address = address_dist( rd );
+    if ( table.lookup( address ) != reference.lookup( address ) ) {
+      throw runtime_error( "LPMTable lookup does not match the reference" );
+    }
+  }
+}
+
+// Stand-in for the rest of the per-packet work of forwarding, which depends on the route found
+uint64_t forward( uint64_t state, const uint32_t route )
+{
+  state += route;
+  for ( size_t i = 0; i < 50; ++i ) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return state;
+}
+
+void speed_test( const size_t num_prefixes, const size_t num_lookups, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  const vector<Prefix> prefixes = bgp_table( num_prefixes, rd );
+
+  // Build
+  LPMTable table;
+  const auto build_start = steady_clock::now();
+  for ( size_t i = 0; i < prefixes.size(); ++i ) {
+    table.insert( prefixes[i].prefix, prefixes[i].length, i );
+  }
+  const auto build_stop = steady_clock::now();
+
+  ReferenceTable reference;
+  for ( size_t i = 0; i < prefixes.size(); ++i ) {
+    reference.insert( prefixes[i], i );
+  }
+  check( table, reference, rd );
+
+  // Lookups
+  vector<uint32_t> addresses( 1 << 20 );
+  uniform_int_distribution<uint32_t> address_dist;
+  for ( auto& a : addresses ) {
+    a = address_dist( rd );
+  }
+
+  size_t matched = 0;
+  const auto lookup_start = steady_clock::now();
+  for ( size_t i = 0; i < num_lookups; ++i ) {
+    matched += table.lookup( addresses[i & ( addresses.size() - 1 )] ).has_value();
+  }
+  const auto lookup_stop = steady_clock::now();
+
+  constexpr size_t burst = 32;
+  array<uint32_t, burst> results {};
+  size_t batch_matched = 0;
+  const auto batch_start = steady_clock::now();
+  for ( size_t i = 0; i < num_lookups; i += burst ) {
+    table.lookup( span { addresses }.subspan( i & ( addresses.size() - 1 ), burst ), results );
+    for ( const auto& r : results ) {
+      batch_matched += r != LPMTable::NO_MATCH;
+    }
+  }
+  const auto batch_stop = steady_clock::now();
+
+  if ( matched == 0 or batch_matched != matched ) {
+    throw runtime_error( "LPMTable batch lookups do not match scalar lookups" );
+  }
+
+  // The same, with each lookup followed by work that depends on its result (as in a router)
+  const size_t num_packets = num_lookups / 10;
+  uint64_t scalar_state = 0;
+  const auto scalar_forward_start = steady_clock::now();
+  for ( size_t i = 0; i < num_packets; ++i ) {
+    const auto route = table.lookup( addresses[i & ( addresses.size() - 1 )] );
+    scalar_state = forward( scalar_state, route.value_or( LPMTable::NO_MATCH ) );
+  }
+  const auto scalar_forward_stop = steady_clock::now();
+
+  uint64_t batch_state = 0;
+  const auto batch_forward_start = steady_clock::now();
+  for ( size_t i = 0; i < num_packets; i += burst ) {
+    table.lookup( span { addresses }.subspan( i & ( addresses.size() - 1 ), burst ), results );
+    for ( const auto& r : results ) {
+      batch_state = forward( batch_state, r );
+    }
+  }
+  const auto batch_forward_stop = steady_clock::now();
+
+  if ( scalar_state != batch_state ) {
+    throw runtime_error( "LPMTable batch lookups do not match scalar lookups" );
+  }
+
+  // Incremental updates: withdraw a tenth of the prefixes, then announce them again
+  const size_t num_updates = prefixes.size() / 10;
+  const auto update_start = steady_clock::now();
+  for ( size_t i = 0; i < num_updates; ++i ) {
+    table.erase( prefixes[i * 10].prefix, prefixes[i * 10].length );
+  }
+  const auto update_mid = steady_clock::now();
+  for ( size_t i = 0; i < num_updates; ++i ) {
+    reference.erase( prefixes[i * 10] );
+  }
+  check( table, reference, rd );
+  const auto readd_start = steady_clock::now();
+  for ( size_t i = 0; i < num_updates; ++i ) {
+    table.insert( prefixes[i * 10].prefix, prefixes[i * 10].length, i * 10 );
+  }
+  const auto update_stop = steady_clock::now();
+
+  if ( table.size() != prefixes.size() ) {
+    throw runtime_error( "LPMTable has the wrong number of prefixes" );
+  }
+
+  const double build_seconds = duration<double>( build_stop - build_start ).count();
+  const double ns_per_lookup
+    = duration<double>( lookup_stop - lookup_start ).count() * 1e9 / static_cast<double>( num_lookups );
+  const double ns_per_batch_lookup
+    = duration<double>( batch_stop - batch_start ).count() * 1e9 / static_cast<double>( num_lookups );
+  const double scalar_forward_ns = duration<double>( scalar_forward_stop - scalar_forward_start ).count() * 1e9
+                                   / static_cast<double>( num_packets );
+  const double batch_forward_ns = duration<double>( batch_forward_stop - batch_forward_start ).count() * 1e9
+                                  / static_cast<double>( num_packets );
+  const double us_per_update
+    = ( duration<double>( update_mid - update_start ) + duration<double>( update_stop - readd_start ) ).count()
+      * 1e6 / static_cast<double>( 2 * num_updates );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "LPMTable with " << prefixes.size() << " prefixes: built in " << fixed << setprecision( 2 )
+       << build_seconds << " s, " << 1e3 / ns_per_lookup << " Mlookups/s (" << ns_per_lookup << " ns/lookup), "
+       << us_per_update << " us/update.\n";
+  cout << "LPMTable batch lookup (" << burst << " at a time): " << 1e3 / ns_per_batch_lookup << " Mlookups/s ("
+       << ns_per_batch_lookup << " ns/lookup), " << ns_per_lookup / ns_per_batch_lookup << "x scalar.\n";
+  cout << "With per-packet work: scalar " << scalar_forward_ns << " ns/packet, batch " << batch_forward_ns
+       << " ns/packet, " << scalar_forward_ns / batch_forward_ns << "x speedup.\n";
+
+  debug_output << "             LPMTable lookup: " << fixed << setprecision( 2 ) << 1e3 / ns_per_lookup
+               << " Mlookups/s (batch: " << 1e3 / ns_per_batch_lookup << " Mlookups/s)\n";
+
+  if ( ns_per_lookup > 1000 ) {
+    throw runtime_error( "LPMTable lookup did not meet minimum speed of 1 Mlookups/s." );
+  }
+}
+
+void program_body()
+{
+  speed_test( 900'000, 20'000'000, 1070 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+#include "lpm_table.hh"
+#include "address.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+uint32_t ip( const string& str )
+{
+  return Address { str }.ipv4_numeric();
+}
+
+uint32_t lookup( const LPMTable& table, const string& address )
+{
+  return table.lookup( ip( address ) ).value_or( LPMTable::NO_MATCH );
+}
+
+// Nested prefixes, each matching only where nothing longer does
+void overlapping()
+{
+  LPMTable table;
+  test_should_be( lookup( table, "1.2.3.4" ), LPMTable::NO_MATCH );
+
+  table.insert( ip( "10.0.0.0" ), 8, 8 );
+  table.insert( ip( "10.1.0.0" ), 16, 16 );
+  table.insert( ip( "10.1.2.0" ), 24, 24 );
+  table.insert( ip( "10.1.2.128" ), 25, 25 );
+  test_should_be( table.size(), size_t { 4 } );
+
+  test_should_be( lookup( table, "10.200.0.1" ), 8U );
+  test_should_be( lookup( table, "10.1.200.1" ), 16U );
+  test_should_be( lookup( table, "10.1.2.1" ), 24U );
+  test_should_be( lookup( table, "10.1.2.200" ), 25U );
+  test_should_be( lookup( table, "11.1.2.200" ), LPMTable::NO_MATCH );
+
+  // Inserting in the other order gives the same answers
+  LPMTable reversed;
+  reversed.insert( ip( "10.1.2.128" ), 25, 25 );
+  reversed.insert( ip( "10.1.2.0" ), 24, 24 );
+  reversed.insert( ip( "10.1.0.0" ), 16, 16 );
+  reversed.insert( ip( "10.0.0.0" ), 8, 8 );
+  for ( const auto* address : { "10.200.0.1", "10.1.200.1", "10.1.2.1", "10.1.2.200", "11.1.2.200" } ) {
+    test_should_be( lookup( reversed, address ), lookup( table, address ) );
+  }
+
+  // Replacing a prefix's value leaves the longer ones inside it alone
+  table.insert( ip( "10.1.0.0" ), 16, 1600 );
+  test_should_be( table.size(), size_t { 4 } );
+  test_should_be( lookup( table, "10.1.200.1" ), 1600U );
+  test_should_be( lookup( table, "10.1.2.1" ), 24U );
+  test_should_be( table.find( ip( "10.1.0.0" ), 16 ).value_or( LPMTable::NO_MATCH ), 1600U );
+  test_should_be( table.find( ip( "10.1.0.0" ), 17 ).value_or( LPMTable::NO_MATCH ), LPMTable::NO_MATCH );
+}
+
+// Prefixes at the edges of tbl24 (/24) and of the tbl8 groups (/25, /32), and bits past the prefix length
+void boundaries()
+{
+  LPMTable table;
+  table.insert( ip( "192.168.1.77" ), 24, 1 ); // host bits are ignored
+  table.insert( ip( "192.168.1.77" ), 32, 2 );
+  table.insert( ip( "192.168.1.255" ), 32, 3 );
+
+  test_should_be( lookup( table, "192.168.1.0" ), 1U );
+  test_should_be( lookup( table, "192.168.1.76" ), 1U );
+  test_should_be( lookup( table, "192.168.1.77" ), 2U );
+  test_should_be( lookup( table, "192.168.1.78" ), 1U );
+  test_should_be( lookup( table, "192.168.1.255" ), 3U );
+  test_should_be( lookup( table, "192.168.0.255" ), LPMTable::NO_MATCH );
+  test_should_be( lookup( table, "192.168.2.0" ), LPMTable::NO_MATCH );
+  test_should_be( table.find( ip( "192.168.1.0" ), 24 ).value_or( LPMTable::NO_MATCH ), 1U );
+  test_should_be( table.groups(), size_t { 1 } );
+
+  // A /32 with nothing around it
+  table.insert( ip( "8.8.8.8" ), 32, 4 );
+  test_should_be( lookup( table, "8.8.8.8" ), 4U );
+  test_should_be( lookup( table, "8.8.8.9" ), LPMTable::NO_MATCH );
+  test_should_be( table.groups(), size_t { 2 } );
+
+  // Batch lookups agree with single ones
+  const array<uint32_t, 5> addresses {
+    ip( "192.168.1.77" ), ip( "192.168.1.78" ), ip( "8.8.8.8" ), ip( "8.8.8.9" ), ip( "192.168.1.255" ) };
+  array<uint32_t, 5> results {};
+  table.lookup( addresses, results );
+  test_should_be( results[0], 2U );
+  test_should_be( results[1], 1U );
+  test_should_be( results[2], 4U );
+  test_should_be( results[3], LPMTable::NO_MATCH );
+  test_should_be( results[4], 3U );
+}
+
+// The default route and other short prefixes, which live outside tbl24
+void short_prefixes()
+{
+  LPMTable table;
+  table.insert( 0, 0, 100 );
+  test_should_be( lookup( table, "0.0.0.0" ), 100U );
+  test_should_be( lookup( table, "255.255.255.255" ), 100U );
+
+  table.insert( ip( "128.0.0.0" ), 1, 101 );
+  table.insert( ip( "10.0.0.0" ), 8, 108 );
+  table.insert( ip( "10.0.0.0" ), 9, 109 );
+  table.insert( ip( "10.0.0.1" ), 32, 132 );
+  test_should_be( lookup( table, "1.2.3.4" ), 100U );
+  test_should_be( lookup( table, "200.1.2.3" ), 101U );
+  test_should_be( lookup( table, "10.200.0.0" ), 108U );
+  test_should_be( lookup( table, "10.0.0.2" ), 109U );
+  test_should_be( lookup( table, "10.0.0.1" ), 132U );
+
+  // Removing a longer prefix uncovers the short ones behind it
+  test_should_be( table.erase( ip( "10.0.0.0" ), 9 ), true );
+  test_should_be( lookup( table, "10.0.0.2" ), 108U );
+  test_should_be( lookup( table, "10.0.0.1" ), 132U );
+  test_should_be( table.erase( ip( "10.0.0.1" ), 32 ), true );
+  test_should_be( lookup( table, "10.0.0.1" ), 108U );
+  test_should_be( table.erase( ip( "10.0.0.0" ), 8 ), true );
+  test_should_be( lookup( table, "10.0.0.1" ), 100U );
+  test_should_be( table.erase( 0, 0 ), true );
+  test_should_be( lookup( table, "10.0.0.1" ), LPMTable::NO_MATCH );
+  test_should_be( lookup( table, "200.1.2.3" ), 101U );
+  test_should_be( table.size(), size_t { 1 } );
+}
+
+// Erasing a prefix gives its addresses back to the next-longest one, and folds tbl8 groups back into
+// tbl24 once nothing longer than /24 is left in them
+void erase()
+{
+  LPMTable table;
+  table.insert( ip( "172.16.0.0" ), 12, 12 );
+  table.insert( ip( "172.16.5.0" ), 24, 24 );
+  table.insert( ip( "172.16.5.0" ), 26, 26 );
+  table.insert( ip( "172.16.5.5" ), 32, 32 );
+  test_should_be( table.groups(), size_t { 1 } );
+
+  test_should_be( table.erase( ip( "172.16.5.0" ), 25 ), false );
+  test_should_be( table.erase( ip( "172.16.5.5" ), 32 ), true );
+  test_should_be( table.erase( ip( "172.16.5.5" ), 32 ), false );
+  test_should_be( lookup( table, "172.16.5.5" ), 26U );
+  test_should_be( table.groups(), size_t { 1 } );
+
+  test_should_be( table.erase( ip( "172.16.5.0" ), 26 ), true );
+  test_should_be( lookup( table, "172.16.5.5" ), 24U );
+  test_should_be( table.groups(), size_t { 0 } );
+
+  test_should_be( table.erase( ip( "172.16.5.0" ), 24 ), true );
+  test_should_be( lookup( table, "172.16.5.5" ), 12U );
+  test_should_be( table.erase( ip( "172.16.0.0" ), 12 ), true );
+  test_should_be( lookup( table, "172.16.5.5" ), LPMTable::NO_MATCH );
+  test_should_be( table.size(), size_t { 0 } );
+
+  // A /32 on its own is folded away too, and its group reused by the next one
+  table.insert( ip( "1.1.1.1" ), 32, 1 );
+  test_should_be( table.erase( ip( "1.1.1.1" ), 32 ), true );
+  test_should_be( table.groups(), size_t { 0 } );
+  test_should_be( lookup( table, "1.1.1.1" ), LPMTable::NO_MATCH );
+  table.insert( ip( "2.2.2.2" ), 32, 2 );
+  test_should_be( table.groups(), size_t { 1 } );
+  test_should_be( lookup( table, "2.2.2.2" ), 2U );
+
+  // A copy is independent of the original
+  LPMTable copy { table };
+  copy.insert( ip( "2.2.2.0" ), 24, 3 );
+  test_should_be( lookup( copy, "2.2.2.3" ), 3U );
+  test_should_be( lookup( table, "2.2.2.3" ), LPMTable::NO_MATCH );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    overlapping();
+    boundaries();
+    short_prefixes();
+    erase();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
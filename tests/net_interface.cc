@@ -320,6 +320,363 @@ int main()
         serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5" ) ) ) } );
       test.execute( ExpectNoFrame {} );
     }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      NetworkInterface::Config config;
+      config.max_pending_per_neighbor = 2;
+      config.max_pending = 4;
+      NetworkInterfaceTestHarness test {
+        "pending frames are bounded (drop oldest)", local_eth, Address( "1.2.3.4", 0 ), config };
+
+      const auto datagram1 = make_datagram( "5.6.7.8", "13.12.11.10" );
+      const auto datagram2 = make_datagram( "5.6.7.8", "13.12.11.11" );
+      const auto datagram3 = make_datagram( "5.6.7.8", "13.12.11.12" );
+      test.execute( SendDatagram { datagram1, Address( "10.0.0.1", 0 ) } );
+      test.execute( SendDatagram { datagram2, Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectPendingFrames { 2 } );
+      test.execute( ExpectPendingDropped { 0 } );
+
+      // a third frame for the same neighbor pushes out the oldest
+      test.execute( SendDatagram { datagram3, Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectPendingFrames { 2 } );
+      test.execute( ExpectPendingDropped { 1 } );
+      test.execute( ExpectCongested { false } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "1.2.3.4", {}, "10.0.0.1" ) ) ) } );
+      test.execute( ExpectNoFrame {} );
+
+      // three of the four pending slots in use: senders should hold back
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.13" ), Address( "10.0.0.2", 0 ) } );
+      test.execute( ExpectPendingFrames { 3 } );
+      test.execute( ExpectCongested { true } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "1.2.3.4", {}, "10.0.0.2" ) ) ) } );
+
+      // the ARP reply releases the frames that survived, in order
+      const EthernetAddress target_eth = random_private_ethernet_address();
+      test.execute( ReceiveFrame {
+        make_frame(
+          target_eth,
+          local_eth,
+          EthernetHeader::TYPE_ARP, // NOLINTNEXTLINE(*-suspicious-*)
+          serialize( make_arp( ARPMessage::OPCODE_REPLY, target_eth, "10.0.0.1", local_eth, "1.2.3.4" ) ) ),
+        {} } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram2 ) ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram3 ) ) } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectPendingFrames { 1 } );
+      test.execute( ExpectCongested { false } );
+    }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      NetworkInterface::Config config;
+      config.max_pending_per_neighbor = 2;
+      config.max_pending = 3;
+      config.pending_drop_policy = NetworkInterface::Config::DropPolicy::DropNewest;
+      NetworkInterfaceTestHarness test {
+        "pending frames are bounded (drop newest)", local_eth, Address( "1.2.3.4", 0 ), config };
+
+      const auto datagram1 = make_datagram( "5.6.7.8", "13.12.11.10" );
+      const auto datagram2 = make_datagram( "5.6.7.8", "13.12.11.11" );
+      test.execute( SendDatagram { datagram1, Address( "10.0.0.1", 0 ) } );
+      test.execute( SendDatagram { datagram2, Address( "10.0.0.1", 0 ) } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.12" ), Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectPendingFrames { 2 } );
+      test.execute( ExpectPendingDropped { 1 } );
+
+      // the global cap applies across neighbors
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.13" ), Address( "10.0.0.2", 0 ) } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.14" ), Address( "10.0.0.3", 0 ) } );
+      test.execute( ExpectPendingFrames { 3 } );
+      test.execute( ExpectPendingDropped { 2 } );
+      test.execute( ExpectCongested { true } );
+
+      // the ARP reply releases the first frames, which were kept
+      const EthernetAddress target_eth = random_private_ethernet_address();
+      test.execute( ExpectFrame {
+        make_frame( local_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "1.2.3.4", {}, "10.0.0.1" ) ) ) } );
+      test.execute( ReceiveFrame {
+        make_frame(
+          target_eth,
+          local_eth,
+          EthernetHeader::TYPE_ARP, // NOLINTNEXTLINE(*-suspicious-*)
+          serialize( make_arp( ARPMessage::OPCODE_REPLY, target_eth, "10.0.0.1", local_eth, "1.2.3.4" ) ) ),
+        {} } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "1.2.3.4", {}, "10.0.0.2" ) ) ) } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "1.2.3.4", {}, "10.0.0.3" ) ) ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram1 ) ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram2 ) ) } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectPendingFrames { 1 } );
+    }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      NetworkInterface::Config config;
+      config.arp_refresh_window_ms = 5000;
+      NetworkInterfaceTestHarness test {
+        "mappings are refreshed before they expire", local_eth, Address( "4.3.2.1", 0 ), config };
+
+      const EthernetAddress target_eth = random_private_ethernet_address();
+      test.execute( ReceiveFrame {
+        make_frame( target_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    serialize( make_arp( ARPMessage::OPCODE_REQUEST, target_eth, "192.168.0.1", {}, "4.3.2.1" ) ) ),
+        {} } );
+      test.execute( ExpectFrame { make_frame(
+        local_eth,
+        target_eth,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REPLY, local_eth, "4.3.2.1", target_eth, "192.168.0.1" ) ) ) } );
+
+      // plenty of time left: no refresh
+      test.execute( Tick { 20000 } );
+      const auto datagram = make_datagram( "5.6.7.8", "13.12.11.10" );
+      test.execute( SendDatagram { datagram, Address( "192.168.0.1", 0 ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram ) ) } );
+      test.execute( ExpectNoFrame {} );
+
+      // about to expire: the datagram still goes out, followed by a unicast ARP request (only one)
+      test.execute( Tick { 6000 } );
+      const auto datagram2 = make_datagram( "5.6.7.8", "13.12.11.11" );
+      test.execute( SendDatagram { datagram2, Address( "192.168.0.1", 0 ) } );
+      test.execute( SendDatagram { datagram2, Address( "192.168.0.1", 0 ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram2 ) ) } );
+      test.execute( ExpectFrame { make_frame(
+        local_eth,
+        target_eth,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", target_eth, "192.168.0.1" ) ) ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram2 ) ) } );
+      test.execute( ExpectNoFrame {} );
+
+      // the reply refreshes the mapping, so it outlives the original 30 seconds
+      test.execute( ReceiveFrame {
+        make_frame(
+          target_eth,
+          local_eth,
+          EthernetHeader::TYPE_ARP, // NOLINTNEXTLINE(*-suspicious-*)
+          serialize( make_arp( ARPMessage::OPCODE_REPLY, target_eth, "192.168.0.1", local_eth, "4.3.2.1" ) ) ),
+        {} } );
+      test.execute( Tick { 10000 } );
+      const auto datagram3 = make_datagram( "5.6.7.8", "13.12.11.12" );
+      test.execute( SendDatagram { datagram3, Address( "192.168.0.1", 0 ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram3 ) ) } );
+      test.execute( ExpectNoFrame {} );
+    }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      NetworkInterface::Config config;
+      config.arp_negative_cache_ms = 1000;
+      config.arp_max_backoff_ms = 1500;
+      NetworkInterfaceTestHarness test {
+        "unanswered ARP requests are negatively cached", local_eth, Address( "1.2.3.4", 0 ), config };
+
+      const auto arp_request = make_frame(
+        local_eth,
+        ETHERNET_BROADCAST,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "1.2.3.4", {}, "10.0.0.1" ) ) );
+
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.10" ), Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectFrame { arp_request } );
+
+      // no reply: the waiting datagram is dropped, and so are new ones for the next second
+      test.execute( Tick { 5001 } );
+      test.execute( ExpectUnreachableDropped { 1 } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.11" ), Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectUnreachableDropped { 2 } );
+      test.execute( ExpectPendingFrames { 0 } );
+
+      // then one more try
+      test.execute( Tick { 1000 } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.12" ), Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectFrame { arp_request } );
+      test.execute( ExpectNoFrame {} );
+
+      // which also fails: now wait 1.5 seconds (twice as long, but capped)
+      test.execute( Tick { 5001 } );
+      test.execute( ExpectUnreachableDropped { 3 } );
+      test.execute( Tick { 1000 } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.13" ), Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectUnreachableDropped { 4 } );
+      test.execute( Tick { 500 } );
+
+      // this time the neighbor answers
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.14" ), Address( "10.0.0.1", 0 ) } );
+      test.execute( ExpectFrame { arp_request } );
+      const EthernetAddress target_eth = random_private_ethernet_address();
+      const auto datagram = make_datagram( "5.6.7.8", "13.12.11.15" );
+      test.execute( SendDatagram { datagram, Address( "10.0.0.1", 0 ) } );
+      test.execute( ReceiveFrame {
+        make_frame(
+          target_eth,
+          local_eth,
+          EthernetHeader::TYPE_ARP, // NOLINTNEXTLINE(*-suspicious-*)
+          serialize( make_arp( ARPMessage::OPCODE_REPLY, target_eth, "10.0.0.1", local_eth, "1.2.3.4" ) ) ),
+        {} } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth,
+                    target_eth,
+                    EthernetHeader::TYPE_IPv4,
+                    serialize( make_datagram( "5.6.7.8", "13.12.11.14" ) ) ) } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram ) ) } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectUnreachableDropped { 4 } );
+    }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      NetworkInterface::Config config;
+      config.announce_on_start = true;
+      config.accept_gratuitous_arp = false;
+      NetworkInterfaceTestHarness test { "gratuitous ARP", local_eth, Address( "10.0.0.1", 0 ), config };
+
+      // the interface announces itself
+      test.execute( ExpectFrame { make_frame(
+        local_eth,
+        ETHERNET_BROADCAST,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.1" ) ) ) } );
+      test.execute( ExpectNoFrame {} );
+
+      // an announcement from an unknown neighbor is ignored...
+      const EthernetAddress remote_eth = random_private_ethernet_address();
+      const auto announcement = make_frame(
+        remote_eth,
+        ETHERNET_BROADCAST,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REQUEST, remote_eth, "10.0.0.5", {}, "10.0.0.5" ) ) );
+      test.execute( ReceiveFrame { announcement, {} } );
+      const auto datagram = make_datagram( "5.6.7.8", "13.12.11.10" );
+      test.execute( SendDatagram { datagram, Address( "10.0.0.5", 0 ) } );
+      test.execute( ExpectFrame { make_frame(
+        local_eth,
+        ETHERNET_BROADCAST,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5" ) ) ) } );
+      test.execute( ExpectNoFrame {} );
+
+      // ... but updates a neighbor that is already known
+      test.execute( ReceiveFrame { announcement, {} } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, remote_eth, EthernetHeader::TYPE_IPv4, serialize( datagram ) ) } );
+      test.execute( ExpectNoFrame {} );
+    }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      NetworkInterface::Config config;
+      config.arp_requests_per_second = 10;
+      config.arp_request_burst = 2;
+      NetworkInterfaceTestHarness test {
+        "ARP requests are rate limited", local_eth, Address( "10.0.0.1", 0 ), config };
+
+      const auto arp_request = [&]( const string& target_ip ) {
+        return make_frame(
+          local_eth,
+          ETHERNET_BROADCAST,
+          EthernetHeader::TYPE_ARP,
+          serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, target_ip ) ) );
+      };
+
+      // a burst of two goes out at once; the third waits for the bucket to refill
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.10" ), Address( "10.0.0.2", 0 ) } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.10" ), Address( "10.0.0.3", 0 ) } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.10" ), Address( "10.0.0.4", 0 ) } );
+      test.execute( SendDatagram { make_datagram( "5.6.7.8", "13.12.11.11" ), Address( "10.0.0.4", 0 ) } );
+      test.execute( ExpectFrame { arp_request( "10.0.0.2" ) } );
+      test.execute( ExpectFrame { arp_request( "10.0.0.3" ) } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectARPRequestsDeferred { 1 } );
+      test.execute( ExpectPendingFrames { 4 } );
+
+      test.execute( Tick { 99 } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( Tick { 1 } );
+      test.execute( ExpectFrame { arp_request( "10.0.0.4" ) } );
+      test.execute( ExpectNoFrame {} );
+    }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      const EthernetAddress remote_eth = random_private_ethernet_address();
+      NetworkInterfaceTestHarness test { "batched maybe_send", local_eth, Address( "10.0.0.1", 0 ) };
+
+      vector<InternetDatagram> datagrams;
+      vector<EthernetFrame> frames;
+      for ( size_t i = 0; i < 6; ++i ) {
+        datagrams.push_back( make_datagram( "5.6.7.8", "13.12.11." + to_string( i ) ) );
+        frames.push_back( make_frame( local_eth, remote_eth, EthernetHeader::TYPE_IPv4, serialize( datagrams[i] ) ) );
+      }
+      const auto arp_request = make_frame(
+        local_eth,
+        ETHERNET_BROADCAST,
+        EthernetHeader::TYPE_ARP,
+        serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.2" ) ) );
+
+      // nothing to send
+      test.execute( ExpectFrames { {}, 8 } );
+
+      // the ARP request, then (once the reply arrives) the frames that were waiting for it, in order
+      test.execute( SendDatagram { datagrams[0], Address( "10.0.0.2", 0 ) } );
+      test.execute( SendDatagram { datagrams[1], Address( "10.0.0.2", 0 ) } );
+      test.execute( ExpectFrames { { arp_request }, 8 } );
+      test.execute( ReceiveFrame {
+        make_frame(
+          remote_eth,
+          local_eth,
+          EthernetHeader::TYPE_ARP, // NOLINTNEXTLINE(*-suspicious-*)
+          serialize( make_arp( ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.2", local_eth, "10.0.0.1" ) ) ),
+        {} } );
+      test.execute( ExpectFrames { { frames[0], frames[1] }, 8 } );
+      test.execute( ExpectFrames { {}, 8 } );
+
+      // no more than max_frames at a time, in the order maybe_send() would give them one by one
+      for ( size_t i = 0; i < 6; ++i ) {
+        test.execute( SendDatagram { datagrams[i], Address( "10.0.0.2", 0 ) } );
+      }
+      test.execute( ExpectFrames { {}, 0 } );
+      test.execute( ExpectFrames { { frames[0], frames[1] }, 2 } );
+      test.execute( ExpectFrame { frames[2] } );
+      test.execute( ExpectFrames { { frames[3] }, 1 } );
+      test.execute( ExpectFrame { frames[4] } );
+      test.execute( ExpectFrames { { frames[5] }, 8 } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( ExpectFrames { {}, 8 } );
+    }
   } catch ( const exception& e ) {
     cerr << e.what() << endl;
     return EXIT_FAILURE;
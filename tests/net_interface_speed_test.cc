@@ -0,0 +1,441 @@
+#include "network_interface.hh"
+
+#include "arp_message.hh"
+#include "buffer_pool.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "router.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr EthernetAddress local_eth { 0x02, 0, 0, 0, 0, 0x01 };
+constexpr EthernetAddress remote_eth { 0x02, 0, 0, 0, 0, 0x02 };
+
+// Flatten a serialized object into one contiguous Buffer, as if it had just been read off the wire
+template<class T>
+Buffer wire_bytes( const T& obj )
+{
+  string ret;
+  for ( const auto& x : serialize( obj ) ) {
+    ret.append( x );
+  }
+  return ret;
+}
+
+Buffer ipv4_frame( const size_t payload_len, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<char> ud;
+  string payload;
+  for ( size_t i = 0; i < payload_len; ++i ) {
+    payload += ud( rd );
+  }
+
+  InternetDatagram dgram;
+  dgram.header.src = Address( "10.0.0.2" ).ipv4_numeric();
+  dgram.header.dst = Address( "10.0.1.2" ).ipv4_numeric();
+  dgram.header.len = dgram.header.hlen * 4 + payload.size();
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( move( payload ) );
+
+  EthernetFrame frame;
+  frame.header = { local_eth, remote_eth, EthernetHeader::TYPE_IPv4 };
+  frame.payload = serialize( dgram );
+  return wire_bytes( frame );
+}
+
+EthernetFrame arp_reply()
+{
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REPLY;
+  arp.sender_ethernet_address = remote_eth;
+  arp.sender_ip_address = Address( "10.0.1.1" ).ipv4_numeric();
+  arp.target_ethernet_address = local_eth;
+  arp.target_ip_address = Address( "10.0.1.254" ).ipv4_numeric();
+
+  EthernetFrame frame;
+  frame.header = { local_eth, remote_eth, EthernetHeader::TYPE_ARP };
+  frame.payload = serialize( arp );
+  return frame;
+}
+
+void report( const string& what, const size_t num_frames, const size_t frame_len, const duration<double> elapsed )
+{
+  const double frames_per_second = static_cast<double>( num_frames ) / elapsed.count();
+  const double gigabits_per_second = frames_per_second * static_cast<double>( frame_len ) * 8 / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "NetworkInterface " << what << " of " << num_frames << " frames (" << frame_len << " bytes) reached "
+       << fixed << setprecision( 2 ) << frames_per_second / 1e6 << " Mframes/s (" << gigabits_per_second
+       << " Gbit/s).\n";
+
+  debug_output << "             NetworkInterface " << what << ": " << fixed << setprecision( 2 )
+               << frames_per_second / 1e6 << " Mframes/s\n";
+
+  if ( frames_per_second < 1e5 ) {
+    throw runtime_error( "NetworkInterface " + what + " did not meet minimum speed of 0.1 Mframes/s." );
+  }
+}
+
+// Parse raw frames and hand them to recv_frame() (Ethernet and IPv4 header stripping)
+void receive_speed_test( const size_t num_frames,  // NOLINT(bugprone-easily-swappable-parameters)
+                         const size_t payload_len, // NOLINT(bugprone-easily-swappable-parameters)
+                         const size_t random_seed )
+{
+  const Buffer wire = ipv4_frame( payload_len, random_seed );
+  NetworkInterface interface { local_eth, Address( "10.0.0.1" ) };
+
+  size_t bytes_received = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_frames; ++i ) {
+    EthernetFrame frame;
+    if ( not parse( frame, { wire } ) ) {
+      throw runtime_error( "failed to parse Ethernet frame" );
+    }
+    const auto dgram = interface.recv_frame( frame );
+    if ( not dgram.has_value() ) {
+      throw runtime_error( "NetworkInterface did not pass up an IPv4 datagram" );
+    }
+    bytes_received += dgram->header.payload_length();
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_received != num_frames * payload_len ) {
+    throw runtime_error( "Mismatch between data sent and received" );
+  }
+
+  report( "receive", num_frames, wire.size(), stop_time - start_time );
+}
+
+// Receive on one interface and send out of another to an already-resolved next hop, as a router would
+void forward_speed_test( const size_t num_frames,  // NOLINT(bugprone-easily-swappable-parameters)
+                         const size_t payload_len, // NOLINT(bugprone-easily-swappable-parameters)
+                         const size_t random_seed )
+{
+  const Buffer wire = ipv4_frame( payload_len, random_seed );
+  NetworkInterface ingress { local_eth, Address( "10.0.0.1" ) };
+  NetworkInterface egress { local_eth, Address( "10.0.1.254" ) };
+  const Address next_hop { "10.0.1.1" };
+  BufferPool pool { 2048 };
+
+  egress.recv_frame( arp_reply() );
+
+  size_t bytes_sent = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_frames; ++i ) {
+    // Copy the frame into a pooled buffer, as a read from the network device would
+    shared_ptr<char> storage = pool.lease();
+    memcpy( storage.get(), string_view { wire }.data(), wire.size() );
+
+    optional<InternetDatagram> dgram;
+    {
+      EthernetFrame frame;
+      parse( frame, { Buffer { move( storage ), wire.size() } } );
+      dgram = ingress.recv_frame( frame );
+    }
+    if ( not dgram.has_value() ) {
+      throw runtime_error( "NetworkInterface did not pass up an IPv4 datagram" );
+    }
+    dgram->header.decrement_ttl();
+    egress.send_datagram( *dgram, next_hop );
+    dgram.reset();
+
+    while ( auto frame = egress.maybe_send() ) {
+      for ( const auto& x : serialize( *frame ) ) {
+        bytes_sent += x.size();
+      }
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_sent != num_frames * wire.size() ) {
+    throw runtime_error( "Mismatch between frames received and forwarded" );
+  }
+
+  report( "forward", num_frames, wire.size(), stop_time - start_time );
+}
+
+// The same, but through a Router: recv_frame() on the ingress interface, route() (longest-prefix match
+// and TTL decrement), and maybe_send() on the egress interface
+void router_speed_test( const size_t num_frames,  // NOLINT(bugprone-easily-swappable-parameters)
+                        const size_t payload_len, // NOLINT(bugprone-easily-swappable-parameters)
+                        const size_t random_seed )
+{
+  const Buffer wire = ipv4_frame( payload_len, random_seed );
+  Router router;
+  const size_t ingress = router.add_interface( { local_eth, Address( "10.0.0.1" ) } );
+  const size_t egress = router.add_interface( { local_eth, Address( "10.0.1.254" ) } );
+  router.add_route( Address( "10.0.0.0" ).ipv4_numeric(), 24, {}, ingress );
+  router.add_route( Address( "10.0.1.0" ).ipv4_numeric(), 24, Address( "10.0.1.1" ), egress );
+  BufferPool pool { 2048 };
+
+  router.interface( egress ).recv_frame( arp_reply() );
+
+  size_t bytes_sent = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_frames; ++i ) {
+    shared_ptr<char> storage = pool.lease();
+    memcpy( storage.get(), string_view { wire }.data(), wire.size() );
+    {
+      EthernetFrame frame;
+      parse( frame, { Buffer { move( storage ), wire.size() } } );
+      router.interface( ingress ).recv_frame( frame );
+    }
+    router.route();
+
+    while ( auto frame = router.interface( egress ).maybe_send() ) {
+      for ( const auto& x : serialize( *frame ) ) {
+        bytes_sent += x.size();
+      }
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_sent != num_frames * wire.size() ) {
+    throw runtime_error( "Mismatch between frames received and routed" );
+  }
+
+  report( "forward (through Router)", num_frames, wire.size(), stop_time - start_time );
+}
+
+// Send datagrams to an already-resolved next hop and take the frames from maybe_send(), as a host's
+// IP layer (or a router's egress) would. Each datagram is in a buffer of its own, with headroom for
+// the Ethernet header. Datagrams are sent `burst` at a time, and each burst is drained either a frame at
+// a time or (if `batched`) with maybe_send( frames, max_frames ).
+void send_speed_test( const size_t num_frames, const size_t payload_len, const size_t burst, const bool batched )
+{
+  NetworkInterface interface { local_eth, Address( "10.0.1.254" ) };
+  const Address next_hop { "10.0.1.1" };
+  interface.recv_frame( arp_reply() );
+
+  InternetDatagram dgram;
+  dgram.header.src = Address( "10.0.1.254" ).ipv4_numeric();
+  dgram.header.dst = Address( "10.0.2.2" ).ipv4_numeric();
+  dgram.header.len = dgram.header.hlen * 4 + payload_len;
+  dgram.header.compute_checksum();
+  const string payload( payload_len, 'x' );
+
+  vector<EthernetFrame> frames;
+  frames.reserve( burst );
+
+  size_t bytes_sent = 0;
+  duration<double> elapsed {};
+  for ( size_t i = 0; i < num_frames; i += burst ) {
+    const auto start_time = steady_clock::now();
+    for ( size_t j = 0; j < burst; ++j ) {
+      dgram.payload.clear();
+      dgram.payload.emplace_back( payload );
+      interface.send_datagram( dgram, next_hop );
+    }
+    if ( not batched ) {
+      while ( auto frame = interface.maybe_send() ) {
+        for ( const auto& x : frame->payload ) {
+          bytes_sent += x.size();
+        }
+      }
+    } else {
+      while ( interface.maybe_send( frames, burst ) ) {
+        for ( const auto& frame : frames ) {
+          for ( const auto& x : frame.payload ) {
+            bytes_sent += x.size();
+          }
+        }
+        frames.clear();
+      }
+    }
+    elapsed += steady_clock::now() - start_time;
+  }
+
+  const size_t num_sent = ( num_frames + burst - 1 ) / burst * burst;
+  if ( bytes_sent != num_sent * ( dgram.header.hlen * 4 + payload_len ) ) {
+    throw runtime_error( "Mismatch between datagrams and frames sent" );
+  }
+
+  report( "send (resolved next hop, bursts of " + to_string( burst ) + ( batched ? ", batched" : "" ) + ")",
+          num_sent,
+          EthernetHeader::LENGTH + dgram.header.len,
+          elapsed );
+}
+
+// Age an ARP cache of `num_neighbors` mappings with 1 ms ticks, then let every mapping expire
+void tick_speed_test( const size_t num_neighbors, const size_t num_ticks )
+{
+  NetworkInterface interface { local_eth, Address( "10.0.1.254" ) };
+  for ( size_t i = 0; i < num_neighbors; ++i ) {
+    EthernetFrame frame = arp_reply();
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = remote_eth;
+    arp.sender_ip_address = Address( "10.0.0.0" ).ipv4_numeric() + i + 1;
+    arp.target_ethernet_address = local_eth;
+    arp.target_ip_address = Address( "10.0.1.254" ).ipv4_numeric();
+    frame.payload = serialize( arp );
+    interface.recv_frame( frame );
+  }
+
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_ticks; ++i ) {
+    interface.tick( 1 );
+  }
+  const auto stop_time = steady_clock::now();
+
+  // Every mapping expires at once
+  const auto expire_start = steady_clock::now();
+  interface.tick( 30'000 );
+  const auto expire_stop = steady_clock::now();
+
+  // ... so sending to one of them needs a new ARP request
+  InternetDatagram dgram;
+  interface.send_datagram( dgram, Address( "10.0.0.1" ) );
+  const auto frame = interface.maybe_send();
+  if ( not frame.has_value() or frame->header.type != EthernetHeader::TYPE_ARP ) {
+    throw runtime_error( "ARP mapping did not expire" );
+  }
+
+  const double ns_per_tick
+    = duration<double>( stop_time - start_time ).count() * 1e9 / static_cast<double>( num_ticks );
+  const double expire_ns_per_neighbor
+    = duration<double>( expire_stop - expire_start ).count() * 1e9 / static_cast<double>( num_neighbors );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "NetworkInterface tick with " << num_neighbors << " ARP mappings: " << fixed << setprecision( 2 )
+       << ns_per_tick << " ns/tick, and " << expire_ns_per_neighbor << " ns per mapping to expire them all.\n";
+
+  debug_output << "             NetworkInterface tick: " << fixed << setprecision( 2 ) << ns_per_tick
+               << " ns/tick (" << num_neighbors << " mappings)\n";
+
+  if ( ns_per_tick > 100'000 ) {
+    throw runtime_error( "NetworkInterface tick did not meet maximum time of 100 us per tick." );
+  }
+}
+
+EthernetAddress neighbor_eth( const uint32_t ip )
+{
+  return { 0x02, 0, static_cast<uint8_t>( ip >> 24 ), static_cast<uint8_t>( ip >> 16 ), static_cast<uint8_t>( ip >> 8 ),
+           static_cast<uint8_t>( ip ) };
+}
+
+void learn( NetworkInterface& interface, const uint32_t ip )
+{
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REPLY;
+  arp.sender_ethernet_address = neighbor_eth( ip );
+  arp.sender_ip_address = ip;
+  arp.target_ethernet_address = local_eth;
+  arp.target_ip_address = Address( "10.0.0.1" ).ipv4_numeric();
+
+  EthernetFrame frame;
+  frame.header = { local_eth, neighbor_eth( ip ), EthernetHeader::TYPE_ARP };
+  frame.payload = serialize( arp );
+  interface.recv_frame( frame );
+}
+
+// Send (small) datagrams to random neighbors out of `num_neighbors` known ones: the cost of resolving
+// the next hop's Ethernet address, plus a constant cost to make and send the frame. The first half of
+// the neighbors is learned (and expires) before the second, so half of the table has been removed
+// and the rest must still be found.
+void resolve_speed_test( const size_t num_neighbors, const size_t num_datagrams, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  NetworkInterface interface { local_eth, Address( "10.0.0.1" ) };
+  const uint32_t base = Address( "10.0.0.0" ).ipv4_numeric() + 2;
+
+  for ( size_t i = 0; i < num_neighbors; ++i ) {
+    learn( interface, base + i );
+    if ( i == num_neighbors / 2 - 1 ) {
+      interface.tick( 15'000 );
+    }
+  }
+  interface.tick( 15'001 );
+
+  // Neighbors from the first half are gone ...
+  InternetDatagram dgram;
+  dgram.header.len = dgram.header.hlen * 4;
+  dgram.header.compute_checksum();
+  interface.send_datagram( dgram, Address::from_ipv4_numeric( base ) );
+  auto frame = interface.maybe_send();
+  if ( not frame.has_value() or frame->header.type != EthernetHeader::TYPE_ARP ) {
+    throw runtime_error( "ARP mapping did not expire" );
+  }
+  interface.tick( 5'001 );
+
+  // ... and the second half is not
+  const size_t first = num_neighbors / 2;
+  const size_t count = num_neighbors - first;
+  vector<Address> next_hops;
+  uniform_int_distribution<size_t> neighbor_dist { first, num_neighbors - 1 };
+  for ( size_t i = 0; i < min( count, size_t { 65'536 } ); ++i ) {
+    next_hops.push_back( Address::from_ipv4_numeric( base + neighbor_dist( rd ) ) );
+  }
+  vector<uint32_t> order( num_datagrams );
+  for ( auto& x : order ) {
+    x = neighbor_dist( rd ) % next_hops.size();
+  }
+
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_datagrams; ++i ) {
+    const Address& next_hop = next_hops[order[i]];
+    interface.send_datagram( dgram, next_hop );
+    frame = interface.maybe_send();
+    if ( not frame.has_value() or frame->header.dst != neighbor_eth( next_hop.ipv4_numeric() ) ) {
+      throw runtime_error( "NetworkInterface sent to the wrong Ethernet address" );
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  const double ns_per_datagram
+    = duration<double>( stop_time - start_time ).count() * 1e9 / static_cast<double>( num_datagrams );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "NetworkInterface resolve and send with " << count << " neighbors: " << fixed << setprecision( 2 )
+       << ns_per_datagram << " ns/datagram.\n";
+
+  debug_output << "             NetworkInterface resolve (" << count << " neighbors): " << fixed
+               << setprecision( 2 ) << ns_per_datagram << " ns/datagram\n";
+
+  if ( ns_per_datagram > 10'000 ) {
+    throw runtime_error( "NetworkInterface resolve did not meet minimum speed of 0.1 Mdatagrams/s." );
+  }
+}
+
+void program_body()
+{
+  receive_speed_test( 2'000'000, 1400, 1066 );
+  forward_speed_test( 1'000'000, 1400, 1067 );
+  router_speed_test( 1'000'000, 1400, 1067 );
+  send_speed_test( 1'000'000, 1400, 1, false );
+  send_speed_test( 1'000'000, 1400, 32, false );
+  send_speed_test( 1'000'000, 1400, 32, true );
+  tick_speed_test( 65'536, 1'000 );
+  resolve_speed_test( 2 * 1'000, 2'000'000, 1068 );
+  resolve_speed_test( 2 * 65'536, 2'000'000, 1069 );
+  resolve_speed_test( 2 * 1'000'000, 2'000'000, 1070 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
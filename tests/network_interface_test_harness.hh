@@ -1,6 +1,7 @@
 #pragma once
 
 #include <compare>
+#include <memory>
 #include <optional>
 #include <utility>
 
@@ -13,10 +14,11 @@ class NetworkInterfaceTestHarness : public TestHarness<NetworkInterface>
 public:
   NetworkInterfaceTestHarness( std::string test_name,
                                const EthernetAddress& ethernet_address,
-                               const Address& ip_address )
+                               const Address& ip_address,
+                               const NetworkInterface::Config& config = {} )
     : TestHarness( move( test_name ),
                    "eth=" + to_string( ethernet_address ) + ", ip=" + ip_address.ip(),
-                   NetworkInterface { ethernet_address, ip_address } )
+                   NetworkInterface { ethernet_address, ip_address, config } )
   {}
 };
 
@@ -125,6 +127,92 @@ struct ExpectNoFrame : public Expectation<NetworkInterface>
   }
 };
 
+struct ExpectFrames : public Expectation<NetworkInterface>
+{
+  std::vector<EthernetFrame> expected;
+  size_t max_frames;
+
+  std::string description() const override
+  {
+    return to_string( expected.size() ) + " frame(s) transmitted in one batch of at most " + to_string( max_frames );
+  }
+  void execute( NetworkInterface& interface ) const override
+  {
+    std::vector<EthernetFrame> frames( 1 ); // the batch goes after whatever is already there
+    const size_t count = interface.maybe_send( frames, max_frames );
+    if ( count != expected.size() or frames.size() != expected.size() + 1 ) {
+      throw ExpectationViolation( "NetworkInterface was expected to send " + to_string( expected.size() )
+                                  + " Ethernet frame(s), but sent " + to_string( count ) + " (and appended "
+                                  + to_string( frames.size() - 1 ) + ")" );
+    }
+
+    for ( size_t i = 0; i < expected.size(); ++i ) {
+      if ( not equal( frames[i + 1], expected[i] ) ) {
+        throw ExpectationViolation( "NetworkInterface sent a different Ethernet frame than was expected (at "
+                                    + to_string( i ) + " in the batch): actual={" + summary( frames[i + 1] )
+                                    + "}" );
+      }
+    }
+  }
+
+  ExpectFrames( std::vector<EthernetFrame> e, const size_t m ) : expected( std::move( e ) ), max_frames( m ) {}
+};
+
+struct ExpectPendingFrames : public ExpectNumber<NetworkInterface, size_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "pending_frames"; }
+  size_t value( NetworkInterface& interface ) const override { return interface.pending_frames(); }
+};
+
+struct ExpectPendingDropped : public ExpectNumber<NetworkInterface, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "pending_dropped"; }
+  uint64_t value( NetworkInterface& interface ) const override { return interface.pending_dropped(); }
+};
+
+struct ExpectUnreachableDropped : public ExpectNumber<NetworkInterface, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "unreachable_dropped"; }
+  uint64_t value( NetworkInterface& interface ) const override { return interface.unreachable_dropped(); }
+};
+
+struct ExpectARPRequestsDeferred : public ExpectNumber<NetworkInterface, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "arp_requests_deferred"; }
+  uint64_t value( NetworkInterface& interface ) const override { return interface.arp_requests_deferred(); }
+};
+
+struct ExpectOversizeDropped : public ExpectNumber<NetworkInterface, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "oversize_dropped"; }
+  uint64_t value( NetworkInterface& interface ) const override { return interface.oversize_dropped(); }
+};
+
+struct ExpectCongested : public ExpectBool<NetworkInterface>
+{
+  using ExpectBool::ExpectBool;
+  std::string name() const override { return "congested"; }
+  bool value( NetworkInterface& interface ) const override { return interface.congested(); }
+};
+
+struct UsePathMTUCache : public Action<NetworkInterface>
+{
+  std::shared_ptr<PathMTUCache> cache;
+
+  std::string description() const override
+  {
+    return "attach path MTU cache (link MTU " + to_string( cache->config().link_mtu ) + ")";
+  }
+  void execute( NetworkInterface& interface ) const override { interface.use_path_mtu_cache( cache ); }
+
+  explicit UsePathMTUCache( std::shared_ptr<PathMTUCache> c ) : cache( std::move( c ) ) {}
+};
+
 struct Tick : public Action<NetworkInterface>
 {
   size_t _ms;
@@ -0,0 +1,260 @@
+#include "network_interface_test_harness.hh"
+#include "path_mtu_cache.hh"
+#include "reassembler.hh"
+#include "tcp_config.hh"
+#include "tcp_receiver.hh"
+#include "tcp_sender.hh"
+#include "test_should_be.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const uint32_t destination = Address( "10.0.0.2" ).ipv4_numeric();
+const uint32_t other = Address( "10.0.0.3" ).ipv4_numeric();
+
+void cache_test()
+{
+  PathMTUCache cache { { .link_mtu = 9000, .min_mtu = 576, .probe_interval_ms = 1000, .max_entries = 16 } };
+  test_should_be( cache.mtu( destination ), size_t { 9000 } ); // unknown destinations start at the link MTU
+  test_should_be( cache.max_payload_size( destination ), size_t { 8960 } );
+  test_should_be( cache.probe_size( destination ).has_value(), false );
+
+  // Size errors lower the estimate, to the reported MTU or else the next common MTU down
+  cache.too_big( destination, 9000, 1500 );
+  test_should_be( cache.mtu( destination ), size_t { 1500 } );
+  test_should_be( cache.mtu( other ), size_t { 9000 } );
+  cache.too_big( destination, 9000, 1400 );
+  test_should_be( cache.mtu( destination ), size_t { 1400 } );
+  cache.too_big( destination, 9000, 4000 ); // above the estimate (from an older datagram): ignored
+  test_should_be( cache.mtu( destination ), size_t { 1400 } );
+  cache.too_big( other, 9000 );
+  test_should_be( cache.mtu( other ), size_t { 8166 } );
+  cache.too_big( other, 800, 100 ); // never below the minimum MTU
+  test_should_be( cache.mtu( other ), size_t { 576 } );
+  test_should_be( cache.size(), size_t { 2 } );
+
+  // After the probe interval, probe upward one common MTU at a time
+  cache.tick( 999 );
+  test_should_be( cache.probe_size( destination ).has_value(), false );
+  cache.tick( 1 );
+  test_should_be( cache.probe_size( destination ).value_or( 0 ), size_t { 1492 } );
+  cache.probe_started( destination, 1492 );
+  test_should_be( cache.probe_size( destination ).has_value(), false ); // one probe at a time
+  cache.probe_succeeded( destination, 1492 );
+  test_should_be( cache.mtu( destination ), size_t { 1492 } );
+  test_should_be( cache.probe_size( destination ).value_or( 0 ), size_t { 1500 } ); // and on straight away
+  cache.probe_started( destination, 1500 );
+  cache.probe_failed( destination, 1500 );
+  test_should_be( cache.mtu( destination ), size_t { 1492 } );
+  test_should_be( cache.probe_size( destination ).has_value(), false ); // until the interval has passed again
+  cache.tick( 1000 );
+  test_should_be( cache.probe_size( destination ).value_or( 0 ), size_t { 1500 } );
+  cache.probe_succeeded( destination, 1500 );
+  for ( const size_t size : { 2002, 4352, 8166, 9000 } ) {
+    test_should_be( cache.probe_size( destination ).value_or( 0 ), size );
+    cache.probe_succeeded( destination, size );
+  }
+  test_should_be( cache.size(), size_t { 1 } ); // a destination back at the link MTU is forgotten
+}
+
+// Send whatever the sender has queued, and return the payload sizes
+vector<size_t> sent_sizes( TCPSender& sender, Wrap32& next_seqno )
+{
+  vector<size_t> sizes;
+  while ( auto msg = sender.maybe_send() ) {
+    test_should_be( msg->seqno == next_seqno, true ); // segments are contiguous
+    next_seqno = next_seqno + msg->sequence_length();
+    sizes.push_back( msg->payload.size() );
+  }
+  return sizes;
+}
+
+void sender_test()
+{
+  auto cache = make_shared<PathMTUCache>(
+    PathMTUCache::Config { .link_mtu = 9000, .min_mtu = 576, .probe_interval_ms = 10000, .max_entries = 16 } );
+  const Wrap32 isn { 0 };
+  ByteStream stream { 100'000 };
+  TCPSender sender { 1000, isn };
+  sender.use_path_mtu_cache( cache, destination );
+
+  Wrap32 next_seqno = isn;
+  sender.push( stream.reader() );
+  test_should_be( ( sent_sizes( sender, next_seqno ) == vector<size_t> { 0 } ), true ); // SYN
+  sender.receive( { next_seqno, 60000 } );
+
+  // Segments are sized to the path MTU
+  stream.writer().push( string( 20000, 'x' ) );
+  sender.push( stream.reader() );
+  test_should_be( ( sent_sizes( sender, next_seqno ) == vector<size_t> { 8960, 8960, 2080 } ), true );
+
+  // The path turns out to be smaller: the lost segment is resent in pieces that fit (an ordinary
+  // retransmission, backing off)
+  cache->too_big( destination, 9000, 1500 );
+  test_should_be( sender.max_payload_size(), uint64_t { 1460 } );
+  sender.tick( 1000 );
+  Wrap32 resent_seqno = isn + 1;
+  const vector<size_t> pieces { 1460, 1460, 1460, 1460, 1460, 1460, 200 };
+  test_should_be( sent_sizes( sender, resent_seqno ) == pieces, true );
+  test_should_be( sender.consecutive_retransmissions(), uint64_t { 1 } );
+  test_should_be( sender.sequence_numbers_in_flight(), uint64_t { 20000 } );
+  sender.receive( { next_seqno, 60000 } );
+  test_should_be( sender.sequence_numbers_in_flight(), uint64_t { 0 } );
+
+  // Once it is time, one segment probes for a larger path MTU, and its acknowledgment raises the estimate
+  // (the cache's owner keeps its time)
+  cache->tick( 10000 );
+  stream.writer().push( string( 5000, 'x' ) );
+  sender.push( stream.reader() );
+  test_should_be( ( sent_sizes( sender, next_seqno ) == vector<size_t> { 1962, 1460, 1460, 118 } ), true );
+  sender.receive( { next_seqno, 60000 } );
+  test_should_be( cache->mtu( destination ), size_t { 2002 } );
+
+  // A lost probe is resent at the size known to work, and the estimate stays put
+  stream.writer().push( string( 5000, 'x' ) );
+  const Wrap32 probe_seqno = next_seqno;
+  sender.push( stream.reader() );
+  test_should_be( ( sent_sizes( sender, next_seqno ) == vector<size_t> { 4312, 688 } ), true ); // probe of 4352
+  sender.tick( 1000 );
+  Wrap32 reprobe_seqno = probe_seqno;
+  test_should_be( ( sent_sizes( sender, reprobe_seqno ) == vector<size_t> { 1962, 1962, 388 } ), true );
+
+  // ... without backing off or counting a retransmission: the next timeout is as soon as ever
+  test_should_be( sender.consecutive_retransmissions(), uint64_t { 0 } );
+  sender.tick( 999 );
+  test_should_be( sender.maybe_send().has_value(), false );
+  sender.tick( 1 );
+  reprobe_seqno = probe_seqno;
+  test_should_be( ( sent_sizes( sender, reprobe_seqno ) == vector<size_t> { 1962 } ), true );
+  test_should_be( sender.consecutive_retransmissions(), uint64_t { 1 } ); // not a probe any more
+
+  sender.receive( { next_seqno, 60000 } );
+  test_should_be( sender.consecutive_retransmissions(), uint64_t { 0 } );
+  test_should_be( cache->mtu( destination ), size_t { 2002 } );
+  test_should_be( cache->probe_size( destination ).has_value(), false ); // nor probe again straight away
+
+  // Without a cache, the payload size is the conservative default
+  TCPSender plain { 1000, isn };
+  test_should_be( plain.max_payload_size(), uint64_t { TCPConfig::MAX_PAYLOAD_SIZE } );
+}
+
+// A 9000-byte host behind a hop that carries only 1500-byte datagrams, and drops bigger ones without a
+// word: nothing reports a size error, so the sender has to work it out from the timeouts
+void black_hole_test()
+{
+  auto cache = make_shared<PathMTUCache>( PathMTUCache::Config { .link_mtu = 9000, .probe_interval_ms = 600'000 } );
+  constexpr size_t hop_mtu = 1500;
+  const Wrap32 isn { 0 };
+  ByteStream outbound { 100'000 };
+  TCPSender sender { 1000, isn };
+  sender.use_path_mtu_cache( cache, destination );
+
+  ByteStream inbound { 100'000 };
+  Reassembler reassembler;
+  TCPReceiver receiver;
+
+  // Carry whatever the sender has to send across the small hop, and the receiver's acknowledgment back
+  const auto exchange = [&] {
+    sender.push( outbound.reader() );
+    while ( auto msg = sender.maybe_send() ) {
+      if ( msg->payload.size() + PathMTUCache::TCP_IP_HEADERS_LENGTH <= hop_mtu ) {
+        receiver.receive( std::move( *msg ), reassembler, inbound.writer() );
+      }
+    }
+    sender.receive( receiver.send( inbound.writer() ) );
+  };
+
+  exchange(); // SYN
+  outbound.writer().push( string( 20000, 'x' ) );
+  exchange();
+  test_should_be( inbound.writer().bytes_pushed(), uint64_t { 0 } ); // every segment was too big for the hop
+
+  // After a segment has timed out twice, each further timeout lowers the estimate a step (9000, 8166,
+  // 4352, 2002, 1500) without backing off, and once the pieces fit the hop the data gets through
+  uint64_t elapsed = 0;
+  while ( inbound.writer().bytes_pushed() < 20000 and elapsed < 60'000 ) {
+    sender.tick( 100 );
+    elapsed += 100;
+    exchange();
+  }
+  test_should_be( inbound.writer().bytes_pushed(), uint64_t { 20000 } );
+  test_should_be( cache->mtu( destination ), hop_mtu );
+  test_should_be( elapsed <= 15'000, true ); // backing off each time, the timer would make it take 35 s
+  test_should_be( sender.sequence_numbers_in_flight(), uint64_t { 0 } );
+
+  // A small segment that keeps timing out is just lost: the estimate stays, and the timer backs off as usual
+  auto other_cache = make_shared<PathMTUCache>( PathMTUCache::Config { .link_mtu = 9000 } );
+  ByteStream stream { 1000 };
+  TCPSender small { 1000, isn };
+  small.use_path_mtu_cache( other_cache, destination );
+  Wrap32 next_seqno = isn;
+  small.push( stream.reader() );
+  sent_sizes( small, next_seqno );
+  small.receive( { next_seqno, 60000 } );
+  stream.writer().push( string( 500, 'x' ) );
+  small.push( stream.reader() );
+  sent_sizes( small, next_seqno );
+  for ( const uint64_t rto : { 1000, 2000, 4000, 8000 } ) {
+    small.tick( rto - 1 );
+    test_should_be( small.maybe_send().has_value(), false );
+    small.tick( 1 );
+    test_should_be( small.maybe_send().value_or( TCPSenderMessage {} ).payload.size(), size_t { 500 } );
+  }
+  test_should_be( other_cache->mtu( destination ), size_t { 9000 } );
+}
+
+void interface_test()
+{
+  const EthernetAddress local_eth { 0x02, 0, 0, 0, 0, 1 };
+
+  // The route to the destination leaves by a link with a smaller MTU than the cache assumes
+  auto cache = make_shared<PathMTUCache>( PathMTUCache::Config { .link_mtu = 9000, .probe_interval_ms = 1000 } );
+  NetworkInterface::Config config;
+  config.mtu = 1500;
+  NetworkInterfaceTestHarness test { "path MTU from oversize datagrams", local_eth, Address( "10.0.0.1" ), config };
+  test.execute( UsePathMTUCache { cache } );
+
+  InternetDatagram dgram;
+  dgram.header.src = Address( "10.0.0.1" ).ipv4_numeric();
+  dgram.header.dst = destination;
+  dgram.header.len = IPv4Header::LENGTH + 3000;
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( string( 3000, 'x' ) );
+  test_should_be( dgram.header.df, true ); // datagrams are sent with "don't fragment" by default
+
+  test.execute( SendDatagram { dgram, Address( "10.0.0.2" ) } );
+  test.execute( ExpectNoFrame {} );
+  test.execute( ExpectOversizeDropped { 1 } );
+  test_should_be( cache->mtu( destination ), size_t { 1500 } ); // reported with the link's MTU
+
+  // The interface keeps the cache's time
+  test.execute( Tick { 999 } );
+  test_should_be( cache->probe_size( destination ).has_value(), false );
+  test.execute( Tick { 1 } );
+  test_should_be( cache->probe_size( destination ).value_or( 0 ), size_t { 2002 } );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    cache_test();
+    sender_test();
+    black_hole_test();
+    interface_test();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+#include "router.hh"
+
+#include "arp_message.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "test_should_be.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr EthernetAddress router_eth0 { 0x02, 0, 0, 0, 0, 0x01 };
+constexpr EthernetAddress router_eth1 { 0x02, 0, 0, 0, 0, 0x02 };
+constexpr EthernetAddress host_a_eth { 0x02, 0, 0, 0, 1, 0x01 };
+constexpr EthernetAddress host_b_eth { 0x02, 0, 0, 0, 1, 0x02 };
+
+uint32_t ip( const string& str )
+{
+  return Address { str }.ipv4_numeric();
+}
+
+// A frame from host A (10.0.0.2, on interface 0) to `destination`
+EthernetFrame datagram_from_a( const string& destination, const string& payload )
+{
+  InternetDatagram dgram;
+  dgram.header.src = ip( "10.0.0.2" );
+  dgram.header.dst = ip( destination );
+  dgram.header.ttl = 64;
+  dgram.header.len = dgram.header.hlen * 4 + payload.size();
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( payload );
+
+  EthernetFrame frame;
+  frame.header = { router_eth0, host_a_eth, EthernetHeader::TYPE_IPv4 };
+  frame.payload = serialize( dgram );
+  return frame;
+}
+
+// Host B's (10.0.1.2, on interface 1) reply to the router's ARP request
+EthernetFrame arp_reply_from_b()
+{
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REPLY;
+  arp.sender_ethernet_address = host_b_eth;
+  arp.sender_ip_address = ip( "10.0.1.2" );
+  arp.target_ethernet_address = router_eth1;
+  arp.target_ip_address = ip( "10.0.1.1" );
+
+  EthernetFrame frame;
+  frame.header = { router_eth1, host_b_eth, EthernetHeader::TYPE_ARP };
+  frame.payload = serialize( arp );
+  return frame;
+}
+
+// The next frame the router sends on interface N (waiting for its worker, but not forever)
+EthernetFrame next_frame( Router& router, const size_t N )
+{
+  const auto deadline = steady_clock::now() + seconds( 2 );
+  while ( steady_clock::now() < deadline ) {
+    if ( auto frame = router.maybe_send( N ) ) {
+      return std::move( *frame );
+    }
+    this_thread::sleep_for( milliseconds( 1 ) );
+  }
+  throw runtime_error( "router sent nothing on interface " + to_string( N ) );
+}
+
+ARPMessage expect_arp_request( const EthernetFrame& frame, const string& target )
+{
+  ARPMessage arp;
+  test_should_be( frame.header.type, EthernetHeader::TYPE_ARP );
+  test_should_be( parse( arp, frame.payload ), true );
+  test_should_be( arp.opcode, ARPMessage::OPCODE_REQUEST );
+  test_should_be( arp.target_ip_address, ip( target ) );
+  return arp;
+}
+
+InternetDatagram expect_datagram( const EthernetFrame& frame, const EthernetAddress& dst )
+{
+  InternetDatagram dgram;
+  test_should_be( frame.header.type, EthernetHeader::TYPE_IPv4 );
+  test_should_be( frame.header.dst == dst, true );
+  test_should_be( parse( dgram, frame.payload ), true );
+  return dgram;
+}
+
+string payload( const InternetDatagram& dgram )
+{
+  string ret;
+  for ( const auto& x : dgram.payload ) {
+    ret.append( x );
+  }
+  return ret;
+}
+
+// Workers pick up a new routing table between bursts: give them time to finish the one in hand
+void let_workers_catch_up()
+{
+  this_thread::sleep_for( milliseconds( 50 ) );
+}
+
+void send( Router& router, const size_t N, EthernetFrame frame )
+{
+  test_should_be( router.recv_frame( N, std::move( frame ) ), true );
+}
+
+// Resolve a next hop with ARP, then forward to it, all through the worker threads
+void forward_through_workers( Router& router )
+{
+  send( router, 0, datagram_from_a( "10.0.1.2", "hello" ) );
+  const ARPMessage request = expect_arp_request( next_frame( router, 1 ), "10.0.1.2" );
+  test_should_be( request.sender_ip_address, ip( "10.0.1.1" ) );
+  test_should_be( router.maybe_send( 1 ).has_value(), false );
+
+  send( router, 1, arp_reply_from_b() );
+  InternetDatagram dgram = expect_datagram( next_frame( router, 1 ), host_b_eth );
+  test_should_be( dgram.header.dst, ip( "10.0.1.2" ) );
+  test_should_be( dgram.header.ttl, uint8_t { 63 } );
+  test_should_be( payload( dgram ) == "hello", true );
+
+  // Now that B is known, the next datagram goes straight out
+  send( router, 0, datagram_from_a( "10.0.1.2", "again" ) );
+  dgram = expect_datagram( next_frame( router, 1 ), host_b_eth );
+  test_should_be( payload( dgram ) == "again", true );
+}
+
+// A route to an interface that does not exist drops the datagram, and the worker carries on
+void missing_interface( Router& router )
+{
+  send( router, 0, datagram_from_a( "10.0.2.5", "nowhere" ) );
+  const auto deadline = steady_clock::now() + seconds( 2 );
+  while ( router.dropped() == 0 and steady_clock::now() < deadline ) {
+    this_thread::sleep_for( milliseconds( 1 ) );
+  }
+  test_should_be( router.dropped(), uint64_t { 1 } );
+
+  send( router, 0, datagram_from_a( "10.0.1.2", "still here" ) );
+  expect_datagram( next_frame( router, 1 ), host_b_eth );
+}
+
+// Routes added and removed while the workers are running take effect
+void update_while_running( Router& router )
+{
+  for ( size_t i = 0; i < 3; ++i ) {
+    router.add_route( ip( "10.0.3.0" ), 24, Address { "10.0.1.2" }, 1 );
+    let_workers_catch_up();
+    send( router, 0, datagram_from_a( "10.0.3.9", "via B" ) );
+    test_should_be( expect_datagram( next_frame( router, 1 ), host_b_eth ).header.dst, ip( "10.0.3.9" ) );
+
+    test_should_be( router.remove_route( ip( "10.0.3.0" ), 24 ), true );
+    test_should_be( router.remove_route( ip( "10.0.3.0" ), 24 ), false );
+    let_workers_catch_up();
+    send( router, 0, datagram_from_a( "10.0.3.9", "no route" ) );
+    send( router, 0, datagram_from_a( "10.0.1.2", "marker" ) );
+    const InternetDatagram dgram = expect_datagram( next_frame( router, 1 ), host_b_eth );
+    test_should_be( payload( dgram ) == "marker", true );
+  }
+
+  // The route now goes the other way: the router has to find 10.0.0.2 first
+  router.add_route( ip( "10.0.3.0" ), 24, Address { "10.0.0.2" }, 0 );
+  let_workers_catch_up();
+  send( router, 0, datagram_from_a( "10.0.3.9", "via A" ) );
+  expect_arp_request( next_frame( router, 0 ), "10.0.0.2" );
+}
+
+// Time passes for the interfaces only through Router::tick(): an unanswered ARP request is resent once
+// it has expired
+void tick_through_workers( Router& router )
+{
+  send( router, 0, datagram_from_a( "10.0.1.3", "to C" ) );
+  expect_arp_request( next_frame( router, 1 ), "10.0.1.3" );
+
+  router.tick( 5'001 );
+  const auto deadline = steady_clock::now() + seconds( 2 );
+  while ( steady_clock::now() < deadline ) {
+    send( router, 0, datagram_from_a( "10.0.1.3", "to C again" ) );
+    this_thread::sleep_for( milliseconds( 1 ) );
+    if ( auto frame = router.maybe_send( 1 ) ) {
+      expect_arp_request( *frame, "10.0.1.3" );
+      return;
+    }
+  }
+  throw runtime_error( "ARP request was not resent after tick()" );
+}
+
+// tick() may come from a clock thread of its own, while the router is started and stopped under it (the
+// clock stands still, so host B stays in the ARP cache)
+void tick_while_restarting( Router& router )
+{
+  atomic<bool> done {};
+  thread clock { [&] {
+    while ( not done ) {
+      router.tick( 0 );
+    }
+  } };
+  for ( size_t i = 0; i < 20; ++i ) {
+    router.start();
+    send( router, 0, datagram_from_a( "10.0.1.2", "between restarts" ) );
+    const InternetDatagram dgram = expect_datagram( next_frame( router, 1 ), host_b_eth );
+    test_should_be( payload( dgram ) == "between restarts", true );
+    router.stop();
+  }
+  done = true;
+  clock.join();
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    Router router;
+    router.add_interface( { router_eth0, Address { "10.0.0.1" } } );
+    router.add_interface( { router_eth1, Address { "10.0.1.1" } } );
+    router.add_route( ip( "10.0.0.0" ), 24, {}, 0 );
+    router.add_route( ip( "10.0.1.0" ), 24, {}, 1 );
+    router.add_route( ip( "10.0.2.0" ), 24, {}, 7 );
+
+    router.start();
+    forward_through_workers( router );
+    missing_interface( router );
+    update_while_running( router );
+    tick_through_workers( router );
+    router.stop();
+
+    tick_while_restarting( router );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,516 @@
+#include "router.hh"
+
+#include "arp_message.hh"
+#include "ethernet_frame.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "ipv4_datagram.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Count the heap allocations made by the code under test
+atomic<size_t> allocations {}; // NOLINT(*-non-const-global-variables)
+
+void* operator new( size_t size )
+{
+  allocations.fetch_add( 1, memory_order_relaxed );
+  if ( void* ptr = malloc( size ) ) { // NOLINT(*-no-malloc)
+    return ptr;
+  }
+  throw bad_alloc();
+}
+
+// (GCC mistakes these for a mismatch with the allocation in operator new above once inlined)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void operator delete( void* ptr ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+void operator delete( void* ptr, size_t /* size */ ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+#pragma GCC diagnostic pop
+
+// The router of tests/router.cc. On each interface there is one neighbor (a host or another router)
+// that sends traffic into the router, and that is the next hop for `destination`.
+struct Port
+{
+  string router_ip;
+  string neighbor_ip;
+  string destination;
+};
+
+const vector<Port> ports {
+  { "171.67.76.46", "171.67.76.1", "93.184.216.34" },      // default (via default_router)
+  { "10.0.0.1", "10.0.0.2", "10.0.0.2" },                  // eth0 (applesauce)
+  { "172.16.0.1", "172.16.0.2", "172.16.0.2" },            // eth1
+  { "192.168.0.1", "192.168.0.2", "192.168.0.2" },         // eth2 (cherrypie)
+  { "198.178.229.1", "198.178.229.42", "198.178.229.42" }, // uun3 (dm42)
+  { "143.195.0.2", "143.195.0.1", "143.195.130.7" },       // hs4 (via hs_router)
+  { "128.30.76.255", "128.30.0.1", "128.30.1.2" },         // mit5 (via 128.30.0.1)
+};
+
+EthernetAddress router_eth( const size_t port )
+{
+  return { 0x02, 0, 0, 0, 0, static_cast<uint8_t>( port + 1 ) };
+}
+
+EthernetAddress neighbor_eth( const size_t port )
+{
+  return { 0x02, 0, 0, 0, 1, static_cast<uint8_t>( port + 1 ) };
+}
+
+uint32_t ip( const string& str )
+{
+  return Address { str }.ipv4_numeric();
+}
+
+// Build the router, with the Ethernet address of every next hop already known
+void build_router( Router& router )
+{
+  for ( size_t i = 0; i < ports.size(); ++i ) {
+    router.add_interface( { router_eth( i ), Address { ports[i].router_ip } } );
+  }
+
+  router.add_route( ip( "0.0.0.0" ), 0, Address { ports[0].neighbor_ip }, 0 );
+  router.add_route( ip( "10.0.0.0" ), 8, {}, 1 );
+  router.add_route( ip( "172.16.0.0" ), 16, {}, 2 );
+  router.add_route( ip( "192.168.0.0" ), 24, {}, 3 );
+  router.add_route( ip( "198.178.229.0" ), 24, {}, 4 );
+  router.add_route( ip( "143.195.0.0" ), 17, Address { ports[5].neighbor_ip }, 5 );
+  router.add_route( ip( "143.195.128.0" ), 18, Address { ports[5].neighbor_ip }, 5 );
+  router.add_route( ip( "143.195.192.0" ), 19, Address { ports[5].neighbor_ip }, 5 );
+  router.add_route( ip( "128.30.76.255" ), 16, Address { ports[6].neighbor_ip }, 6 );
+
+  for ( size_t i = 0; i < ports.size(); ++i ) {
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = neighbor_eth( i );
+    arp.sender_ip_address = ip( ports[i].neighbor_ip );
+    arp.target_ethernet_address = router_eth( i );
+    arp.target_ip_address = ip( ports[i].router_ip );
+
+    EthernetFrame frame;
+    frame.header = { router_eth( i ), neighbor_eth( i ), EthernetHeader::TYPE_ARP };
+    frame.payload = serialize( arp );
+    router.interface( i ).recv_frame( frame );
+  }
+}
+
+// A frame from the neighbor on port `from` to `destination`, as raw bytes
+string wire_frame( const size_t from, const uint32_t destination, const size_t payload_len )
+{
+  InternetDatagram dgram;
+  dgram.header.src = ip( ports[from].neighbor_ip );
+  dgram.header.dst = destination;
+  dgram.header.len = dgram.header.hlen * 4 + payload_len;
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( string( payload_len, 'x' ) );
+
+  EthernetFrame frame;
+  frame.header = { router_eth( from ), neighbor_eth( from ), EthernetHeader::TYPE_IPv4 };
+  frame.payload = serialize( dgram );
+
+  string ret;
+  for ( const auto& x : serialize( frame ) ) {
+    ret.append( x );
+  }
+  return ret;
+}
+
+// Write the routes of build_router(), plus `num_routes` more (none of which covers any of the ports'
+// destinations), to a file in the format of RoutingTable::load()
+void write_routes_file( const string& filename, const size_t num_routes, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<uint32_t> address_dist { 0x01000000, 0x09ffffff };
+  uniform_int_distribution<uint8_t> length_dist { 16, 24 };
+  uniform_int_distribution<size_t> port_dist { 0, ports.size() - 1 };
+
+  ofstream output { filename };
+  output << "# prefix/length next-hop interface\n";
+  output << "0.0.0.0/0 " << ports[0].neighbor_ip << " 0\n";
+  output << "10.0.0.0/8 - 1\n";
+  output << "172.16.0.0/16 - 2\n";
+  output << "192.168.0.0/24 - 3\n";
+  output << "198.178.229.0/24 - 4\n";
+  output << "143.195.0.0/17 " << ports[5].neighbor_ip << " 5\n";
+  output << "143.195.128.0/18 " << ports[5].neighbor_ip << " 5\n";
+  output << "143.195.192.0/19 " << ports[5].neighbor_ip << " 5\n";
+  output << "128.30.76.255/16 " << ports[6].neighbor_ip << " 6\n";
+  for ( size_t i = 0; i < num_routes; ++i ) {
+    const size_t port = port_dist( rd );
+    output << Address::from_ipv4_numeric( address_dist( rd ) ).ip() << "/" << +length_dist( rd ) << " "
+           << ports[port].neighbor_ip << " " << port << "\n";
+  }
+  if ( not output ) {
+    throw runtime_error( "could not write " + filename );
+  }
+}
+
+// A uniquely named file in the temporary directory, removed when it goes out of scope
+class TemporaryFile
+{
+  string name_ { ( filesystem::temp_directory_path() / "router_speed_test_routes.XXXXXX" ).string() };
+
+public:
+  TemporaryFile() { FileDescriptor { CheckSystemCall( "mkstemp", ::mkstemp( name_.data() ) ) }; }
+  ~TemporaryFile() { filesystem::remove( name_ ); }
+  TemporaryFile( const TemporaryFile& other ) = delete;
+  TemporaryFile& operator=( const TemporaryFile& other ) = delete;
+  TemporaryFile( TemporaryFile&& other ) = delete;
+  TemporaryFile& operator=( TemporaryFile&& other ) = delete;
+
+  const string& name() const { return name_; }
+};
+
+// Send `num_datagrams` from each of the first `num_ingress` neighbors (spread over the destinations
+// behind every other port) through a router running one worker thread per interface, with one more
+// thread per port playing the link. Meanwhile, the main thread may change the routing table: with
+// RouteChurn, an unrelated route is added and removed every 100 ms; with TableSwap, a whole new table
+// is loaded from `routes_file` and installed. Returns the aggregate forwarding rate in datagrams/s.
+enum class Meanwhile
+{
+  Nothing,
+  RouteChurn,
+  TableSwap
+};
+
+double parallel_speed_test( const size_t num_ingress, // NOLINT(bugprone-easily-swappable-parameters)
+                            const size_t num_datagrams,
+                            const size_t payload_len,
+                            const Meanwhile meanwhile = Meanwhile::Nothing,
+                            const string& routes_file = {} )
+{
+  Router router;
+  build_router( router );
+
+  // Each ingress port cycles through the destinations behind all the other ports
+  vector<vector<string>> wire( num_ingress );
+  vector<size_t> expected( ports.size() );
+  for ( size_t from = 0; from < num_ingress; ++from ) {
+    for ( size_t to = 0; to < ports.size(); ++to ) {
+      if ( to != from ) {
+        wire[from].push_back( wire_frame( from, ip( ports[to].destination ), payload_len ) );
+      }
+    }
+    for ( size_t i = 0; i < num_datagrams; ++i ) {
+      const size_t to = i % ( ports.size() - 1 );
+      ++expected.at( to < from ? to : to + 1 );
+    }
+  }
+
+  const size_t total = num_ingress * num_datagrams;
+  atomic<size_t> forwarded {};
+  atomic<bool> misdirected {};
+  vector<size_t> received( ports.size() );
+  vector<thread> links;
+
+  router.start();
+  const auto start_time = steady_clock::now();
+
+  for ( size_t port = 0; port < ports.size(); ++port ) {
+    links.emplace_back( [&, port] {
+      size_t sent = 0;
+      vector<EthernetFrame> outgoing;
+      while ( forwarded.load( memory_order_relaxed ) + router.dropped() < total ) {
+        // Offer the router a burst of frames, as a NIC's receive ring would
+        for ( size_t i = 0; port < num_ingress and i < 32 and sent < num_datagrams; ++i ) {
+          EthernetFrame frame;
+          parse( frame, { Buffer { wire[port][sent % wire[port].size()] } } );
+          if ( not router.recv_frame( port, std::move( frame ) ) ) {
+            break;
+          }
+          ++sent;
+        }
+
+        // Take whatever the router has sent on this port, a burst at a time, as a NIC's transmit ring would
+        size_t count = 0;
+        while ( router.maybe_send( port, outgoing, 32 ) ) {
+          for ( const auto& frame : outgoing ) {
+            if ( frame.header.type != EthernetHeader::TYPE_IPv4 or frame.header.dst != neighbor_eth( port ) ) {
+              misdirected = true;
+            }
+          }
+          count += outgoing.size();
+          outgoing.clear();
+        }
+        received[port] += count;
+        forwarded.fetch_add( count, memory_order_relaxed );
+
+        if ( count == 0 ) {
+          this_thread::yield();
+        }
+      }
+    } );
+  }
+
+  string note;
+  size_t route_updates = 0;
+  while ( meanwhile == Meanwhile::RouteChurn and forwarded.load() + router.dropped() < total ) {
+    this_thread::sleep_for( milliseconds( 100 ) );
+    if ( route_updates++ % 2 == 0 ) {
+      router.add_route( ip( "203.0.113.0" ), 24, {}, 0 );
+    } else {
+      router.remove_route( ip( "203.0.113.0" ), 24 );
+    }
+    note = ", across " + to_string( route_updates ) + " route updates";
+  }
+
+  if ( meanwhile == Meanwhile::TableSwap ) {
+    this_thread::sleep_for( milliseconds( 100 ) );
+    const auto load_start = steady_clock::now();
+    RoutingTable table = RoutingTable::load( routes_file );
+    const size_t num_routes = table.size();
+    const auto install_start = steady_clock::now();
+    router.install_routing_table( std::move( table ) );
+    const auto install_stop = steady_clock::now();
+
+    ostringstream ss;
+    ss << fixed << setprecision( 2 ) << ", loading " << num_routes << " routes in "
+       << duration<double>( install_start - load_start ).count() << " s and installing them in "
+       << duration<double>( install_stop - install_start ).count() * 1e6 << " us";
+    note = ss.str();
+  }
+
+  for ( auto& link : links ) {
+    link.join();
+  }
+  const auto stop_time = steady_clock::now();
+  router.stop();
+
+  if ( misdirected or ( router.dropped() == 0 and received != expected ) ) {
+    throw runtime_error( "router did not forward each datagram to the right port" );
+  }
+  if ( router.dropped() > total / 100 ) {
+    throw runtime_error( "router dropped more than 1% of datagrams" );
+  }
+
+  const double datagrams_per_second
+    = static_cast<double>( forwarded.load() ) / duration<double>( stop_time - start_time ).count();
+
+  cout << "Router (" << ports.size() << " worker threads, " << num_ingress << " ingress interface"
+       << ( num_ingress == 1 ? "" : "s" ) << ") forwarded " << forwarded.load() << " datagrams (" << payload_len
+       << "-byte payloads) at " << fixed << setprecision( 2 ) << datagrams_per_second / 1e6 << " Mpps, dropping "
+       << router.dropped() << note << ".\n";
+
+  return datagrams_per_second;
+}
+
+// Forward datagrams from every port's neighbor to the destinations behind all the other ports, one
+// thread doing everything: recv_frame() on the ingress interface, route(), and maybe_send() on the
+// egress interface. Only those three are timed (and their allocations counted); the frames are
+// parsed from raw bytes beforehand, a batch at a time, as a NIC driver would hand them over.
+void forwarding_speed_test( const size_t num_datagrams, const size_t payload_len )
+{
+  Router router;
+  build_router( router );
+
+  vector<vector<string>> wire( ports.size() );
+  for ( size_t from = 0; from < ports.size(); ++from ) {
+    for ( size_t to = 0; to < ports.size(); ++to ) {
+      if ( to != from ) {
+        wire[from].push_back( wire_frame( from, ip( ports[to].destination ), payload_len ) );
+      }
+    }
+  }
+
+  constexpr size_t batch_size = 4096;
+  vector<EthernetFrame> batch( batch_size );
+  size_t forwarded = 0;
+  size_t allocations_forwarding = 0;
+  duration<double> elapsed {};
+
+  for ( size_t done = 0; done < num_datagrams; ) {
+    const size_t count = min( batch_size, num_datagrams - done );
+    for ( size_t i = 0; i < count; ++i ) {
+      const size_t n = done + i;
+      const auto& port_wire = wire[n % ports.size()];
+      parse( batch[i], { Buffer { port_wire[n / ports.size() % port_wire.size()] } } );
+    }
+
+    const size_t allocations_before = allocations.load( memory_order_relaxed );
+    const auto start_time = steady_clock::now();
+    for ( size_t i = 0; i < count; i += 32 ) {
+      for ( size_t j = i; j < min( i + 32, count ); ++j ) {
+        router.interface( ( done + j ) % ports.size() ).recv_frame( batch[j] );
+        batch[j] = {};
+      }
+      router.route();
+      for ( size_t port = 0; port < ports.size(); ++port ) {
+        while ( auto frame = router.interface( port ).maybe_send() ) {
+          ++forwarded;
+        }
+      }
+    }
+    elapsed += steady_clock::now() - start_time;
+    allocations_forwarding += allocations.load( memory_order_relaxed ) - allocations_before;
+    done += count;
+  }
+
+  if ( forwarded != num_datagrams ) {
+    throw runtime_error( "router did not forward every datagram" );
+  }
+
+  const double ns_per_datagram = elapsed.count() * 1e9 / static_cast<double>( num_datagrams );
+  const double allocations_per_datagram
+    = static_cast<double>( allocations_forwarding ) / static_cast<double>( num_datagrams );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Router (" << ports.size() << " interfaces, one thread) forwarded " << num_datagrams << " datagrams ("
+       << payload_len << "-byte payloads) at " << fixed << setprecision( 2 ) << 1e3 / ns_per_datagram << " Mpps, "
+       << ns_per_datagram << " ns/datagram, " << allocations_per_datagram << " allocations/datagram.\n";
+
+  debug_output << "             Router forwarding: " << fixed << setprecision( 2 ) << 1e3 / ns_per_datagram
+               << " Mpps (" << allocations_per_datagram << " allocations/datagram)\n";
+
+  if ( ns_per_datagram > 10'000 ) {
+    throw runtime_error( "Router forwarding did not meet minimum speed of 0.1 Mpps." );
+  }
+}
+
+// Route datagrams to a few hot destinations (and some others) through a router with a large routing
+// table, one burst at a time with route(), with and without the route cache
+void route_cache_speed_test( const size_t num_routes, // NOLINT(bugprone-easily-swappable-parameters)
+                             const size_t num_datagrams,
+                             const size_t cache_size,
+                             const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  Router router;
+  build_router( router );
+
+  // Routes for random /16 to /24 prefixes, each out of a random port to that port's neighbor
+  uniform_int_distribution<uint32_t> address_dist;
+  uniform_int_distribution<uint8_t> length_dist { 16, 24 };
+  uniform_int_distribution<size_t> port_dist { 0, ports.size() - 1 };
+  for ( size_t i = 0; i < num_routes; ++i ) {
+    const size_t port = port_dist( rd );
+    router.add_route( address_dist( rd ), length_dist( rd ), Address { ports[port].neighbor_ip }, port );
+  }
+  router.set_route_cache_size( cache_size );
+
+  // Nine in ten datagrams go to one of 64 hot destinations, the rest anywhere in 1.0.0.0/8 to 9.0.0.0/8
+  // (away from the directly-connected networks, where the router would have to ARP for each one)
+  constexpr size_t ingress = 1;
+  uniform_int_distribution<uint32_t> destination_dist { 0x01000000, 0x09ffffff };
+  vector<string> hot;
+  vector<string> cold;
+  for ( size_t i = 0; i < 64; ++i ) {
+    hot.push_back( wire_frame( ingress, destination_dist( rd ), 64 ) );
+  }
+  for ( size_t i = 0; i < 4096; ++i ) {
+    cold.push_back( wire_frame( ingress, destination_dist( rd ), 64 ) );
+  }
+  vector<const string*> traffic;
+  for ( size_t i = 0; i < 1 << 16; ++i ) {
+    traffic.push_back( i % 10 == 0 ? &cold[address_dist( rd ) % cold.size()] : &hot[address_dist( rd ) % hot.size()] );
+  }
+
+  size_t forwarded = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_datagrams; ++i ) {
+    EthernetFrame frame;
+    parse( frame, { Buffer { *traffic[i % traffic.size()] } } );
+    router.interface( ingress ).recv_frame( frame );
+
+    if ( i % 32 == 31 or i == num_datagrams - 1 ) {
+      router.route();
+      for ( size_t port = 0; port < ports.size(); ++port ) {
+        while ( router.interface( port ).maybe_send() ) {
+          ++forwarded;
+        }
+      }
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( forwarded != num_datagrams ) {
+    throw runtime_error( "router did not forward every datagram" );
+  }
+
+  const RouteLookupStats stats = router.route_lookup_stats();
+  const double ns_per_datagram
+    = duration<double>( stop_time - start_time ).count() * 1e9 / static_cast<double>( num_datagrams );
+
+  cout << "Router with " << num_routes << " routes, ";
+  if ( cache_size ) {
+    cout << cache_size << "-entry route cache";
+  } else {
+    cout << "no route cache";
+  }
+  cout << ": " << fixed << setprecision( 2 ) << ns_per_datagram << " ns/datagram, " << stats.ns_per_lookup()
+       << " ns/lookup, hit rate " << stats.hit_rate() * 100 << "%, miss rate " << stats.miss_rate() * 100
+       << "%.\n";
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Running on " << thread::hardware_concurrency() << " hardware thread(s).\n";
+
+  forwarding_speed_test( 1'000'000, 64 );
+
+  route_cache_speed_test( 500'000, 500'000, 0, 1071 );
+  route_cache_speed_test( 500'000, 500'000, 4096, 1071 );
+
+  const double single = parallel_speed_test( 1, 100'000, 64 );
+  double best = single;
+  for ( const size_t num_ingress : { 2, 4, 7 } ) {
+    best = max( best, parallel_speed_test( num_ingress, 100'000, 64 ) );
+  }
+  parallel_speed_test( ports.size(), 100'000, 64, Meanwhile::RouteChurn );
+
+  {
+    const TemporaryFile routes_file;
+    write_routes_file( routes_file.name(), 50'000, 1072 );
+    parallel_speed_test( ports.size(), 100'000, 64, Meanwhile::TableSwap, routes_file.name() );
+  }
+
+  cout << "Best aggregate rate: " << fixed << setprecision( 2 ) << best / 1e6 << " Mpps, " << best / single
+       << "x one ingress interface.\n";
+  debug_output << "             Router parallel forwarding: " << fixed << setprecision( 2 ) << best / 1e6
+               << " Mpps (" << best / single << "x one ingress)\n";
+
+  if ( best < 1e4 ) {
+    throw runtime_error( "Router did not meet minimum speed of 0.01 Mpps." );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
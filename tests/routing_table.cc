@@ -0,0 +1,166 @@
+#include "routing_table.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+uint32_t ip( const string& str )
+{
+  return Address { str }.ipv4_numeric();
+}
+
+// The route that `address` takes, as "<prefix>/<length>", or "none"
+string route_for( const RoutingTable& table, const string& address )
+{
+  const array<uint32_t, 1> addresses { ip( address ) };
+  array<uint32_t, 1> results {};
+  table.lookup( addresses, results );
+  if ( results[0] == LPMTable::NO_MATCH ) {
+    return "none";
+  }
+  const RoutingTable::Route& route = table.route( results[0] );
+  return Address::from_ipv4_numeric( route.route_prefix ).ip() + "/" + to_string( route.prefix_length );
+}
+
+// The message of the exception that `load` throws, or "" if it does not throw
+string load_error( const string& contents )
+{
+  istringstream input { contents };
+  try {
+    RoutingTable::load( input );
+  } catch ( const runtime_error& e ) {
+    return e.what();
+  }
+  return {};
+}
+
+void load_routes()
+{
+  istringstream input { "# prefix/length next-hop interface\n"
+                        "\n"
+                        "0.0.0.0/0 171.67.76.1 0\n"
+                        "10.0.0.0/8 - 1\n"
+                        "143.195.0.0/17 143.195.0.1 5\n"
+                        "143.195.128.0/18   143.195.0.1\t5\n"
+                        "192.168.0.7/32 - 3\n"
+                        "10.0.0.0/8 - 2\n" };
+  const RoutingTable table = RoutingTable::load( input );
+  test_should_be( table.size(), size_t { 5 } ); // the last line replaced the second route
+
+  test_should_be( route_for( table, "1.2.3.4" ) == "0.0.0.0/0", true );
+  test_should_be( route_for( table, "10.9.8.7" ) == "10.0.0.0/8", true );
+  test_should_be( route_for( table, "143.195.1.1" ) == "143.195.0.0/17", true );
+  test_should_be( route_for( table, "143.195.130.1" ) == "143.195.128.0/18", true );
+  test_should_be( route_for( table, "192.168.0.7" ) == "192.168.0.7/32", true );
+
+  const array<uint32_t, 3> addresses { ip( "10.9.8.7" ), ip( "143.195.1.1" ), ip( "1.2.3.4" ) };
+  array<uint32_t, 3> results {};
+  table.lookup( addresses, results );
+  test_should_be( table.route( results[0] ).interface_num, size_t { 2 } );
+  test_should_be( table.route( results[0] ).next_hop.has_value(), false );
+  test_should_be( table.route( results[1] ).interface_num, size_t { 5 } );
+  test_should_be( table.route( results[1] ).next_hop->ip() == "143.195.0.1", true );
+  test_should_be( table.route( results[2] ).next_hop->ip() == "171.67.76.1", true );
+
+  // Nothing at all is an empty table
+  istringstream empty { "# nothing here\n" };
+  test_should_be( RoutingTable::load( empty ).size(), size_t { 0 } );
+}
+
+void malformed_lines()
+{
+  test_should_be( load_error( "10.0.0.0/8 - 1\n" ).empty(), true );
+
+  // Each of these is reported along with its line number
+  const vector<string> bad_lines {
+    "10.0.0.0/8 -",
+    "10.0.0.0/8",
+    "10.0.0.0 - 1",
+    "10.0.0.0/ - 1",
+    "10.0.0.0/8x - 1",
+    "10.0.0.0/-8 - 1",
+    "10.0.0.0/33 - 1",
+    "10.0.0.0/100 - 1",
+    "10.0.0.300/8 - 1",
+    "not.an.address/8 - 1",
+    "10.0.0.0/8 not-an-address 1",
+    "10.0.0.0/8 - one",
+    "10.0.0.0/8 - -1",
+    "10.0.0.0/8 - 1 extra",
+  };
+  for ( const string& line : bad_lines ) {
+    const string error = load_error( "# first line\n10.0.0.0/8 - 1\n" + line + "\n" );
+    if ( error != "RoutingTable: malformed route on line 3: " + line ) {
+      throw runtime_error( "\"" + line + "\" gave \"" + error + "\"" );
+    }
+  }
+
+  // A route at the boundaries is fine
+  test_should_be( load_error( "0.0.0.0/0 - 0\n255.255.255.255/32 - 0\n" ).empty(), true );
+}
+
+void missing_file()
+{
+  const string filename = "/nonexistent/routes.txt";
+  string error;
+  try {
+    RoutingTable::load( filename );
+  } catch ( const runtime_error& e ) {
+    error = e.what();
+  }
+  test_should_be( error == "RoutingTable: could not open " + filename, true );
+}
+
+void remove_routes()
+{
+  RoutingTable table;
+  table.add_route( ip( "10.0.0.0" ), 8, {}, 1 );
+  table.add_route( ip( "10.1.0.0" ), 16, {}, 2 );
+
+  const uint64_t generation = table.generation();
+  test_should_be( table.remove_route( ip( "10.2.0.0" ), 16 ), false );
+  test_should_be( table.remove_route( ip( "10.1.0.0" ), 24 ), false );
+  test_should_be( table.remove_route( ip( "10.0.0.0" ), 16 ), false );
+  test_should_be( table.size(), size_t { 2 } );
+  test_should_be( table.generation(), generation ); // nothing changed
+
+  test_should_be( table.remove_route( ip( "10.1.0.0" ), 16 ), true );
+  test_should_be( table.generation() != generation, true );
+  test_should_be( table.size(), size_t { 1 } );
+  test_should_be( route_for( table, "10.1.2.3" ) == "10.0.0.0/8", true );
+  test_should_be( table.remove_route( ip( "10.1.0.0" ), 16 ), false );
+
+  // The removed route's slot is reused
+  table.add_route( ip( "172.16.0.0" ), 12, {}, 3 );
+  test_should_be( table.size(), size_t { 2 } );
+  test_should_be( route_for( table, "172.16.1.1" ) == "172.16.0.0/12", true );
+  test_should_be( route_for( table, "10.1.2.3" ) == "10.0.0.0/8", true );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    load_routes();
+    malformed_lines();
+    missing_file();
+    remove_routes();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include "trace.hh"
+
+#include "address.hh"
+#include "network_interface.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Records come back from snapshot() oldest first, with their fields intact
+void record_and_snapshot()
+{
+  const uint64_t before = Trace::recorded();
+  Trace::record( Trace::Event::ArpRequestSent, 0x0a000001, 1 );
+  Trace::record( Trace::Event::SegmentReceived, 1000, 20 );
+  Trace::record( Trace::Event::ArpMappingExpired, 0x0a000002 );
+  test_should_be( Trace::recorded() - before, uint64_t { 3 } );
+
+  const vector<Trace::Record> records = Trace::snapshot();
+  test_should_be( records.size() >= 3, true );
+  const vector<Trace::Record> last( records.end() - 3, records.end() );
+  test_should_be( last[0].event == Trace::Event::ArpRequestSent, true );
+  test_should_be( last[0].a, uint64_t { 0x0a000001 } );
+  test_should_be( last[0].b, uint64_t { 1 } );
+  test_should_be( last[1].event == Trace::Event::SegmentReceived, true );
+  test_should_be( last[1].a, uint64_t { 1000 } );
+  test_should_be( last[1].b, uint64_t { 20 } );
+  test_should_be( last[2].event == Trace::Event::ArpMappingExpired, true );
+  test_should_be( last[2].b, uint64_t { 0 } );
+  test_should_be( last[0].time_ns <= last[1].time_ns and last[1].time_ns <= last[2].time_ns, true );
+
+  test_should_be( Trace::name( Trace::Event::ArpRequestSent ) == "ArpRequestSent", true );
+  test_should_be( Trace::to_string( last[1] ) == to_string( last[1].time_ns ) + " SegmentReceived 1000 20", true );
+}
+
+// The ring keeps the last CAPACITY records, in order
+void wrap_around()
+{
+  const uint64_t before = Trace::recorded();
+  const uint64_t count = Trace::CAPACITY + 10;
+  for ( uint64_t i = 0; i < count; ++i ) {
+    Trace::record( Trace::Event::SegmentReceived, i, before );
+  }
+  test_should_be( Trace::recorded() - before, count );
+
+  const vector<Trace::Record> records = Trace::snapshot();
+  test_should_be( records.size(), Trace::CAPACITY );
+  for ( size_t i = 0; i < records.size(); ++i ) {
+    test_should_be( records[i].a, count - Trace::CAPACITY + i );
+    test_should_be( records[i].b, before );
+  }
+}
+
+// Threads record at once without losing count, and each thread's records stay in its order
+void concurrent_writers()
+{
+  constexpr size_t num_threads = 4;
+  constexpr size_t num_records = 20'000;
+  const uint64_t before = Trace::recorded();
+
+  vector<thread> threads;
+  for ( size_t t = 0; t < num_threads; ++t ) {
+    threads.emplace_back( [t] {
+      for ( size_t i = 0; i < num_records; ++i ) {
+        Trace::record( Trace::Event::SegmentReceived, t, i );
+      }
+    } );
+  }
+  for ( auto& th : threads ) {
+    th.join();
+  }
+  test_should_be( Trace::recorded() - before, uint64_t { num_threads * num_records } );
+
+  vector<uint64_t> next( num_threads );
+  for ( const auto& record : Trace::snapshot() ) {
+    test_should_be( record.a < num_threads and record.b < num_records, true );
+    test_should_be( record.b >= next[record.a], true );
+    next[record.a] = record.b + 1;
+  }
+}
+
+// These libraries are built with every trace point compiled in
+void trace_points()
+{
+  test_should_be( MINNOW_TRACE_LEVEL, 3 );
+
+  bool evaluated = false;
+  MINNOW_TRACE( Debug, SegmentIgnored, ( evaluated = true ) );
+  test_should_be( evaluated, true );
+  test_should_be( Trace::snapshot().back().event == Trace::Event::SegmentIgnored, true );
+
+  const NetworkInterface interface { { 0x02, 0, 0, 0, 0, 0x01 }, Address { "10.0.0.1" } };
+  const Trace::Record created = Trace::snapshot().back();
+  test_should_be( created.event == Trace::Event::InterfaceCreated, true );
+  test_should_be( created.a, uint64_t { Address { "10.0.0.1" }.ipv4_numeric() } );
+  test_should_be( created.b, uint64_t { 0x020000000001 } );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    record_and_snapshot();
+    wrap_around();
+    concurrent_writers();
+    trace_points();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include "trace.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Record `num_records` events from each of `num_threads` threads at once, check that the ring holds the
+// last of them intact, and report the cost of each record. Each thread records a = thread number and
+// b = a running count, so that a torn record would show up as a count out of order.
+double trace_speed_test( const size_t num_threads, const size_t num_records )
+{
+  const uint64_t recorded_before = Trace::recorded();
+
+  atomic<bool> go { false };
+  vector<thread> threads;
+  vector<duration<double>> elapsed( num_threads );
+  for ( size_t t = 0; t < num_threads; ++t ) {
+    threads.emplace_back( [&, t] {
+      while ( not go.load() ) {
+        this_thread::yield();
+      }
+      const auto start_time = steady_clock::now();
+      for ( size_t i = 0; i < num_records; ++i ) {
+        Trace::record( Trace::Event::SegmentReceived, t, i );
+      }
+      elapsed[t] = steady_clock::now() - start_time;
+    } );
+  }
+  go = true;
+  for ( auto& th : threads ) {
+    th.join();
+  }
+
+  if ( Trace::recorded() - recorded_before != num_threads * num_records ) {
+    throw runtime_error( "Trace lost count of its records" );
+  }
+
+  // A writer that was preempted in the middle of a record can finish it after a later writer has
+  // reused the slot, losing the later record: at most one per thread
+  const vector<Trace::Record> records = Trace::snapshot();
+  if ( records.size() > Trace::CAPACITY or records.size() + num_threads < Trace::CAPACITY ) {
+    throw runtime_error( "Trace ring kept " + to_string( records.size() ) + " records" );
+  }
+  vector<uint64_t> last( num_threads, 0 );
+  vector<bool> seen( num_threads, false );
+  for ( const auto& record : records ) {
+    if ( record.event != Trace::Event::SegmentReceived or record.a >= num_threads or record.b >= num_records
+         or ( seen[record.a] and record.b <= last[record.a] ) ) {
+      throw runtime_error( "Trace record out of order or torn: " + Trace::to_string( record ) );
+    }
+    seen[record.a] = true;
+    last[record.a] = record.b;
+  }
+
+  duration<double> total {};
+  for ( const auto& e : elapsed ) {
+    total += e;
+  }
+  const double ns_per_record = total.count() * 1e9 / static_cast<double>( num_threads * num_records );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Trace with " << num_threads << " thread(s) recorded " << num_threads * num_records << " events at "
+       << fixed << setprecision( 2 ) << ns_per_record << " ns/record.\n";
+  debug_output << "             Trace (" << num_threads << " thread(s)): " << fixed << setprecision( 2 )
+               << ns_per_record << " ns/record\n";
+
+  if ( ns_per_record > 1000 ) {
+    throw runtime_error( "Trace did not meet maximum cost of 1 us per record." );
+  }
+
+  return ns_per_record;
+}
+
+void program_body()
+{
+  cout << "Trace points compiled in up to level " << MINNOW_TRACE_LEVEL << ".\n";
+
+  trace_speed_test( 1, 10'000'000 );
+  trace_speed_test( 4, 2'000'000 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include "arp_message.hh"
+#include "header_layout.hh"
 
 #include <arpa/inet.h>
 #include <iomanip>
@@ -6,6 +7,22 @@
 
 using namespace std;
 
+namespace {
+
+using ARPLayout = HeaderLayout<Field<&ARPMessage::hardware_type, 0, 16>,
+                               Field<&ARPMessage::protocol_type, 16, 16>,
+                               Field<&ARPMessage::hardware_address_size, 32, 8>,
+                               Field<&ARPMessage::protocol_address_size, 40, 8>,
+                               Field<&ARPMessage::opcode, 48, 16>,
+                               Field<&ARPMessage::sender_ethernet_address, 64, 48>,
+                               Field<&ARPMessage::sender_ip_address, 112, 32>,
+                               Field<&ARPMessage::target_ethernet_address, 144, 48>,
+                               Field<&ARPMessage::target_ip_address, 192, 32>>;
+
+static_assert( ARPLayout::LENGTH == ARPMessage::LENGTH );
+
+} // namespace
+
 bool ARPMessage::supported() const
 {
   return hardware_type == TYPE_ETHERNET and protocol_type == EthernetHeader::TYPE_IPv4
@@ -32,28 +49,11 @@ string ARPMessage::to_string() const
 
 void ARPMessage::parse( Parser& parser )
 {
-  parser.integer( hardware_type );
-  parser.integer( protocol_type );
-  parser.integer( hardware_address_size );
-  parser.integer( protocol_address_size );
-  parser.integer( opcode );
+  ARPLayout::parse( *this, parser );
 
   if ( not supported() ) {
     parser.set_error();
-    return;
-  }
-
-  // read sender addresses (Ethernet and IP)
-  for ( auto& b : sender_ethernet_address ) {
-    parser.integer( b );
   }
-  parser.integer( sender_ip_address );
-
-  // read target addresses (Ethernet and IP)
-  for ( auto& b : target_ethernet_address ) {
-    parser.integer( b );
-  }
-  parser.integer( target_ip_address );
 }
 
 void ARPMessage::serialize( Serializer& serializer ) const
@@ -62,21 +62,5 @@ void ARPMessage::serialize( Serializer& serializer ) const
     throw runtime_error( "ARPMessage: unsupported field combination (must be Ethernet/IP, and request or reply)" );
   }
 
-  serializer.integer( hardware_type );
-  serializer.integer( protocol_type );
-  serializer.integer( hardware_address_size );
-  serializer.integer( protocol_address_size );
-  serializer.integer( opcode );
-
-  // read sender addresses (Ethernet and IP)
-  for ( const auto& b : sender_ethernet_address ) {
-    serializer.integer( b );
-  }
-  serializer.integer( sender_ip_address );
-
-  // read target addresses (Ethernet and IP)
-  for ( const auto& b : target_ethernet_address ) {
-    serializer.integer( b );
-  }
-  serializer.integer( target_ip_address );
+  ARPLayout::serialize( *this, serializer );
 }
@@ -1,23 +1,94 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 
+// A reference-counted, read-only view of (part of) a byte string.
+// Copies and slices share the underlying storage, which is freed when the last view is dropped.
+//
+// The storage in front of a view (its "headroom") may be used to prepend a header in place, e.g.
+// when a datagram serialized with headroom (see serialize_contiguous()) is framed by a lower layer.
 class Buffer
 {
-  std::shared_ptr<std::string> buffer_;
+  std::shared_ptr<const char> data_ {};
+  size_t size_ {};
+  size_t headroom_ {}; // bytes of storage before data_
+
+  Buffer( std::shared_ptr<const char> data, size_t size, size_t headroom )
+    : data_( std::move( data ) ), size_( size ), headroom_( headroom )
+  {}
 
 public:
   // NOLINTBEGIN(*-explicit-*)
 
-  Buffer( std::string str = {} ) : buffer_( make_shared<std::string>( std::move( str ) ) ) {}
-  operator std::string_view() const { return *buffer_; }
-  operator std::string&() { return *buffer_; }
+  Buffer( std::string str = {} )
+  {
+    if ( str.empty() ) {
+      return;
+    }
+    auto owner = std::make_shared<std::string>( std::move( str ) );
+    size_ = owner->size();
+    data_ = { owner, owner->data() };
+  }
+
+  operator std::string_view() const { return { data_.get(), size_ }; }
+  operator std::string() const { return std::string { std::string_view { *this } }; }
 
   // NOLINTEND(*-explicit-*)
 
-  std::string&& release() { return std::move( *buffer_ ); }
-  size_t size() const { return buffer_->size(); }
-  size_t length() const { return buffer_->length(); }
-  bool empty() const { return buffer_->empty(); }
+  // View `str` minus its first `headroom` bytes, which are kept as room to prepend a header
+  Buffer( std::string str, size_t headroom )
+  {
+    headroom = std::min( headroom, str.size() );
+    auto owner = std::make_shared<std::string>( std::move( str ) );
+    size_ = owner->size() - headroom;
+    headroom_ = headroom;
+    data_ = { owner, owner->data() + headroom };
+  }
+
+  // Wrap the first `size` bytes of shared, writable storage without copying (e.g. a BufferPool lease)
+  Buffer( std::shared_ptr<char> storage, size_t size ) : data_( std::move( storage ) ), size_( size ) {}
+
+  size_t size() const { return size_; }
+  size_t length() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t headroom() const { return headroom_; }
+
+  // Drop the first `n` bytes from this view (the underlying storage is untouched)
+  void remove_prefix( size_t n )
+  {
+    n = std::min( n, size_ );
+    const char* const start = data_.get() + n;
+    data_ = { std::move( data_ ), start };
+    size_ -= n;
+    headroom_ += n;
+  }
+
+  // A view of (up to) `len` bytes starting at `pos` that shares this buffer's storage
+  Buffer substr( size_t pos, size_t len = std::string_view::npos ) const
+  {
+    pos = std::min( pos, size_ );
+    return { { data_, data_.get() + pos }, std::min( len, size_ - pos ), headroom_ + pos };
+  }
+
+  // The last `n` bytes of headroom, to be filled in before calling expand_front( n ). Writing there
+  // is only safe if no other view can see those bytes, so this returns an empty span unless this is
+  // the only Buffer sharing the storage (and the headroom is large enough).
+  std::span<char> writable_headroom( size_t n ) const
+  {
+    if ( n == 0 or n > headroom_ or data_.use_count() != 1 ) {
+      return {};
+    }
+    return { const_cast<char*>( data_.get() ) - n, n }; // NOLINT(*-const-cast)
+  }
+
+  // A view that extends this one `n` bytes to the front, into its headroom
+  Buffer expand_front( size_t n ) const
+  {
+    n = std::min( n, headroom_ );
+    return { { data_, data_.get() - n }, size_ + n, headroom_ - n };
+  }
 };
@@ -0,0 +1,192 @@
+#include "buffer_pool.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// A list of freed memory blocks that any thread may push onto and one thread takes over whole. The
+// link to the next block is kept in the first bytes of the block itself. (Nothing is ever popped
+// singly, so there is no ABA problem.)
+class ReturnList
+{
+  atomic<void*> head_ { nullptr };
+
+public:
+  void push( void* block )
+  {
+    void* next = head_.load( memory_order_relaxed );
+    do {
+      memcpy( block, &next, sizeof( next ) );
+    } while ( not head_.compare_exchange_weak( next, block, memory_order_release, memory_order_relaxed ) );
+  }
+
+  // Move every block on the list to the end of `out`, the most recently pushed last
+  void take_all( vector<void*>& out )
+  {
+    if ( head_.load( memory_order_relaxed ) == nullptr ) {
+      return;
+    }
+    const size_t start = out.size();
+    for ( void* block = head_.exchange( nullptr, memory_order_acquire ); block != nullptr; ) {
+      out.push_back( block );
+      memcpy( &block, block, sizeof( block ) );
+    }
+    reverse( out.begin() + static_cast<ptrdiff_t>( start ), out.end() );
+  }
+};
+
+} // namespace
+
+struct BufferPool::State
+{
+  size_t buffer_size;
+  size_t buffers_per_slab;
+  vector<unique_ptr<char[]>> slabs {}; // NOLINT(*-avoid-c-arrays)
+  vector<void*> free_buffers {};
+  ReturnList returned_buffers {};
+  Stats stats {};
+
+  // recycled shared_ptr control blocks (all leases use the same control-block type, hence size)
+  atomic<size_t> block_size {};
+  vector<void*> free_blocks {};
+  ReturnList returned_blocks {};
+
+  State( size_t buffer_size_, size_t buffers_per_slab_ )
+    : buffer_size( buffer_size_ ), buffers_per_slab( buffers_per_slab_ )
+  {}
+
+  ~State()
+  {
+    returned_blocks.take_all( free_blocks );
+    for ( void* block : free_blocks ) {
+      ::operator delete( block );
+    }
+  }
+
+  State( const State& other ) = delete;
+  State& operator=( const State& other ) = delete;
+  State( State&& other ) = delete;
+  State& operator=( State&& other ) = delete;
+
+  void add_slab()
+  {
+    auto& slab = slabs.emplace_back( make_unique_for_overwrite<char[]>( buffer_size * buffers_per_slab ) );
+    for ( size_t i = 0; i < buffers_per_slab; ++i ) {
+      free_buffers.push_back( slab.get() + i * buffer_size );
+    }
+    ++stats.slabs;
+  }
+
+  // Only called from lease()
+  void* allocate_block( size_t bytes )
+  {
+    if ( bytes == block_size.load( memory_order_relaxed ) ) {
+      if ( free_blocks.empty() ) {
+        returned_blocks.take_all( free_blocks );
+      }
+      if ( not free_blocks.empty() ) {
+        void* block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+      }
+    }
+    if ( block_size.load( memory_order_relaxed ) == 0 and bytes >= sizeof( void* ) ) {
+      block_size.store( bytes, memory_order_relaxed );
+    }
+    return ::operator new( bytes );
+  }
+
+  // Called from whichever thread drops the last reference to a lease
+  void free_block( void* block, size_t bytes )
+  {
+    if ( bytes == block_size.load( memory_order_relaxed ) ) {
+      returned_blocks.push( block );
+    } else {
+      ::operator delete( block );
+    }
+  }
+};
+
+// Allocates the shared_ptr control block for a lease. It holds a reference to the pool's state,
+// which keeps the state alive until the control block itself has been freed.
+template<typename T>
+class BufferPool::ControlBlockAllocator
+{
+  shared_ptr<State> state_;
+
+  template<typename U>
+  friend class ControlBlockAllocator;
+
+public:
+  using value_type = T;
+
+  explicit ControlBlockAllocator( shared_ptr<State> state ) : state_( move( state ) ) {}
+
+  template<typename U>
+  explicit ControlBlockAllocator( const ControlBlockAllocator<U>& other ) : state_( other.state_ )
+  {}
+
+  T* allocate( size_t n ) { return static_cast<T*>( state_->allocate_block( n * sizeof( T ) ) ); }
+  void deallocate( T* p, size_t n ) { state_->free_block( p, n * sizeof( T ) ); }
+
+  template<typename U>
+  bool operator==( const ControlBlockAllocator<U>& other ) const
+  {
+    return state_ == other.state_;
+  }
+};
+
+BufferPool::BufferPool( size_t buffer_size, size_t buffers_per_slab )
+  : state_( make_shared<State>( buffer_size, buffers_per_slab ) )
+{
+  if ( buffer_size < sizeof( void* ) or buffers_per_slab == 0 ) {
+    throw runtime_error( "BufferPool: buffers must hold at least a pointer, and slabs at least one buffer" );
+  }
+}
+
+shared_ptr<char> BufferPool::lease()
+{
+  // Buffers returned since last time (perhaps by other threads) go on top, to be reused first
+  state_->returned_buffers.take_all( state_->free_buffers );
+
+  if ( state_->free_buffers.empty() ) {
+    ++state_->stats.misses;
+    state_->add_slab();
+  } else {
+    ++state_->stats.hits;
+  }
+
+  char* const buffer = static_cast<char*>( state_->free_buffers.back() );
+  state_->free_buffers.pop_back();
+
+  // The deleter can use a plain pointer: the allocator stored alongside it keeps the state alive.
+  State* const state = state_.get();
+  return { buffer, [state]( char* p ) { state->returned_buffers.push( p ); }, ControlBlockAllocator<char> { state_ } };
+}
+
+size_t BufferPool::buffer_size() const
+{
+  return state_->buffer_size;
+}
+
+const BufferPool::Stats& BufferPool::stats() const
+{
+  return state_->stats;
+}
+
+vector<iovec> BufferPool::slabs() const
+{
+  vector<iovec> ret;
+  ret.reserve( state_->slabs.size() );
+  for ( const auto& slab : state_->slabs ) {
+    ret.push_back( { slab.get(), state_->buffer_size * state_->buffers_per_slab } );
+  }
+  return ret;
+}
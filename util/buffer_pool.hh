@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+// A pool of fixed-size read buffers carved out of large slabs.
+//
+// lease() hands out a buffer as a std::shared_ptr. It can be wrapped in a Buffer (and from there
+// flow into a Parser and the payload of an EthernetFrame or IPv4Datagram) without copying, and it
+// goes back on the pool's free list when the last reference is dropped. The control blocks of
+// those shared_ptrs are recycled too, so a lease served from the free list does not allocate.
+//
+// Leases may outlive the BufferPool itself, and may be dropped on any thread: a returned buffer (and
+// its control block) goes onto a lock-free return list, which lease() takes over whole the next time
+// it runs. Everything else (lease(), stats(), slabs()) belongs to one thread at a time.
+class BufferPool
+{
+public:
+  struct Stats
+  {
+    uint64_t hits {};   // leases served from the free list
+    uint64_t misses {}; // leases that had to grow the pool by a slab
+    uint64_t slabs {};  // slabs allocated so far
+  };
+
+  explicit BufferPool( size_t buffer_size = 16384, size_t buffers_per_slab = 64 );
+
+  // Lease a writable buffer of buffer_size() bytes (contents unspecified)
+  std::shared_ptr<char> lease();
+
+  size_t buffer_size() const;
+  const Stats& stats() const;
+
+  // The memory regions backing the pool (e.g. to register with IOUring::register_buffers()). A new
+  // slab is added whenever the pool runs out, so check stats().slabs before relying on the list.
+  std::vector<iovec> slabs() const;
+
+private:
+  struct State;
+
+  template<typename T>
+  class ControlBlockAllocator;
+
+  std::shared_ptr<State> state_;
+};
@@ -0,0 +1,188 @@
+#include "checksum.hh"
+
+#include <cstring>
+#include <endian.h>
+#include <stdexcept>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define MINNOW_CHECKSUM_X86 1
+#endif
+
+using namespace std;
+
+// Each implementation below returns the exact (unfolded) sum of `len` bytes taken as big-endian 16-bit words,
+// where `len` is even. Because the running sum is kept modulo 2^32 either way, adding this total once gives
+// the same result as the bytewise loop adding one word at a time.
+
+namespace {
+
+uint64_t word_sum_64( const uint8_t* data, size_t len )
+{
+  constexpr uint64_t low_halves = 0x0000ffff0000ffff;
+  constexpr size_t max_words_per_block = 1 << 14; // keeps the two 32-bit lanes of `lanes` from overflowing
+
+  uint64_t total = 0;
+  while ( len >= sizeof( uint64_t ) ) {
+    uint64_t lanes = 0;
+    for ( size_t n = 0; n < max_words_per_block and len >= sizeof( uint64_t ); ++n ) {
+      uint64_t word {};
+      memcpy( &word, data, sizeof( word ) );
+      word = be64toh( word );
+      lanes += ( word & low_halves ) + ( ( word >> 16 ) & low_halves );
+      data += sizeof( word );
+      len -= sizeof( word );
+    }
+    total += ( lanes >> 32 ) + ( lanes & 0xffffffff );
+  }
+
+  for ( ; len >= 2; data += 2, len -= 2 ) {
+    total += ( static_cast<uint64_t>( data[0] ) << 8 ) | data[1];
+  }
+
+  return total;
+}
+
+#ifdef MINNOW_CHECKSUM_X86
+
+// Even-offset (high) and odd-offset (low) bytes are summed separately with psadbw, whose 64-bit lanes
+// cannot overflow for any realistic length.
+
+__attribute__( ( target( "sse2" ) ) ) uint64_t word_sum_sse2( const uint8_t* data, size_t len )
+{
+  const __m128i high_bytes = _mm_set1_epi16( 0x00ff );
+  const __m128i zero = _mm_setzero_si128();
+  __m128i high = zero;
+  __m128i low = zero;
+
+  for ( ; len >= sizeof( __m128i ); data += sizeof( __m128i ), len -= sizeof( __m128i ) ) {
+    const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) ); // NOLINT(*-reinterpret-cast)
+    high = _mm_add_epi64( high, _mm_sad_epu8( _mm_and_si128( v, high_bytes ), zero ) );
+    low = _mm_add_epi64( low, _mm_sad_epu8( _mm_srli_epi16( v, 8 ), zero ) );
+  }
+
+  alignas( 16 ) uint64_t high_lanes[2];
+  alignas( 16 ) uint64_t low_lanes[2];
+  _mm_store_si128( reinterpret_cast<__m128i*>( high_lanes ), high ); // NOLINT(*-reinterpret-cast)
+  _mm_store_si128( reinterpret_cast<__m128i*>( low_lanes ), low );   // NOLINT(*-reinterpret-cast)
+
+  return ( ( high_lanes[0] + high_lanes[1] ) << 8 ) + low_lanes[0] + low_lanes[1] + word_sum_64( data, len );
+}
+
+__attribute__( ( target( "avx2" ) ) ) uint64_t word_sum_avx2( const uint8_t* data, size_t len )
+{
+  const __m256i high_bytes = _mm256_set1_epi16( 0x00ff );
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i high = zero;
+  __m256i low = zero;
+
+  for ( ; len >= sizeof( __m256i ); data += sizeof( __m256i ), len -= sizeof( __m256i ) ) {
+    const __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data ) ); // NOLINT(*-reinterpret-cast)
+    high = _mm256_add_epi64( high, _mm256_sad_epu8( _mm256_and_si256( v, high_bytes ), zero ) );
+    low = _mm256_add_epi64( low, _mm256_sad_epu8( _mm256_srli_epi16( v, 8 ), zero ) );
+  }
+
+  alignas( 32 ) uint64_t high_lanes[4];
+  alignas( 32 ) uint64_t low_lanes[4];
+  _mm256_store_si256( reinterpret_cast<__m256i*>( high_lanes ), high ); // NOLINT(*-reinterpret-cast)
+  _mm256_store_si256( reinterpret_cast<__m256i*>( low_lanes ), low );   // NOLINT(*-reinterpret-cast)
+
+  const uint64_t high_sum = high_lanes[0] + high_lanes[1] + high_lanes[2] + high_lanes[3];
+  const uint64_t low_sum = low_lanes[0] + low_lanes[1] + low_lanes[2] + low_lanes[3];
+  return ( high_sum << 8 ) + low_sum + word_sum_sse2( data, len );
+}
+
+#endif
+
+} // namespace
+
+void InternetChecksum::add( string_view data, Implementation impl )
+{
+  if ( impl == Implementation::Bytewise ) {
+    for ( const uint8_t i : data ) {
+      uint16_t val = i;
+      if ( not parity_ ) {
+        val <<= 8;
+      }
+      sum_ += val;
+      parity_ = !parity_;
+    }
+    return;
+  }
+
+  const auto* bytes = reinterpret_cast<const uint8_t*>( data.data() ); // NOLINT(*-reinterpret-cast)
+  size_t len = data.size();
+  if ( len == 0 ) {
+    return;
+  }
+
+  uint64_t sum = 0;
+
+  // an odd number of bytes so far: this byte completes the low half of the previous word
+  if ( parity_ ) {
+    sum += bytes[0];
+    ++bytes;
+    --len;
+    parity_ = false;
+  }
+
+  const size_t even_len = len & ~size_t { 1 };
+  switch ( impl ) {
+    case Implementation::Word64:
+      sum += word_sum_64( bytes, even_len );
+      break;
+#ifdef MINNOW_CHECKSUM_X86
+    case Implementation::SSE2:
+      sum += word_sum_sse2( bytes, even_len );
+      break;
+    case Implementation::AVX2:
+      sum += word_sum_avx2( bytes, even_len );
+      break;
+#endif
+    default:
+      throw runtime_error( "InternetChecksum: " + string( name( impl ) ) + " is not supported on this CPU" );
+  }
+
+  // a trailing odd byte is the high half of a word that the next add() will complete
+  if ( len & 1 ) {
+    sum += static_cast<uint64_t>( bytes[len - 1] ) << 8;
+    parity_ = true;
+  }
+
+  sum_ += static_cast<uint32_t>( sum );
+}
+
+vector<InternetChecksum::Implementation> InternetChecksum::supported_implementations()
+{
+  vector<Implementation> ret { Implementation::Bytewise, Implementation::Word64 };
+#ifdef MINNOW_CHECKSUM_X86
+  if ( __builtin_cpu_supports( "sse2" ) ) {
+    ret.push_back( Implementation::SSE2 );
+  }
+  if ( __builtin_cpu_supports( "avx2" ) ) {
+    ret.push_back( Implementation::AVX2 );
+  }
+#endif
+  return ret;
+}
+
+InternetChecksum::Implementation InternetChecksum::best_implementation()
+{
+  static const Implementation best = supported_implementations().back();
+  return best;
+}
+
+string_view InternetChecksum::name( Implementation impl )
+{
+  switch ( impl ) {
+    case Implementation::Bytewise:
+      return "bytewise";
+    case Implementation::Word64:
+      return "64-bit word";
+    case Implementation::SSE2:
+      return "SSE2";
+    case Implementation::AVX2:
+      return "AVX2";
+  }
+  return "unknown";
+}
@@ -4,6 +4,7 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 //! The internet checksum algorithm
@@ -14,18 +15,19 @@ private:
   bool parity_ {};
 
 public:
-  explicit InternetChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
-  void add( std::string_view data )
+  //! Ways of summing the data. All give bit-identical results; add() uses the fastest one the CPU supports.
+  enum class Implementation
   {
-    for ( const uint8_t i : data ) {
-      uint16_t val = i;
-      if ( not parity_ ) {
-        val <<= 8;
-      }
-      sum_ += val;
-      parity_ = !parity_;
-    }
-  }
+    Bytewise, //!< one byte at a time (the reference implementation)
+    Word64,   //!< 64-bit words, portable
+    SSE2,     //!< 16 bytes at a time (x86 only)
+    AVX2,     //!< 32 bytes at a time (x86 only, chosen at runtime)
+  };
+
+  explicit InternetChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
+
+  void add( std::string_view data ) { add( data, best_implementation() ); }
+  void add( std::string_view data, Implementation impl );
 
   uint16_t value() const
   {
@@ -44,4 +46,9 @@ public:
       add( x );
     }
   }
+
+  //! The implementations this CPU can run, slowest first
+  static std::vector<Implementation> supported_implementations();
+  static Implementation best_implementation();
+  static std::string_view name( Implementation impl );
 };
@@ -11,6 +11,15 @@ struct EthernetFrame
   EthernetHeader header {};
   std::vector<Buffer> payload {};
 
+  uint64_t serialized_length() const
+  {
+    uint64_t ret = header.serialized_length();
+    for ( const auto& x : payload ) {
+      ret += x.size();
+    }
+    return ret;
+  }
+
   void parse( Parser& parser )
   {
     header.parse( parser );
@@ -23,3 +32,22 @@ struct EthernetFrame
     serializer.buffer( payload );
   }
 };
+
+// Serialize a frame. If the payload is a single Buffer with room for the header in front of it (as
+// left by serialize_contiguous()), the header is written there in place and the whole frame comes out
+// as one Buffer; otherwise the header is serialized on its own, ahead of the payload Buffers.
+inline std::vector<Buffer> serialize( const EthernetFrame& frame )
+{
+  if ( frame.payload.size() == 1 ) {
+    const Buffer& payload = frame.payload.front();
+    const std::span<char> room = payload.writable_headroom( EthernetHeader::LENGTH );
+    if ( not room.empty() ) {
+      frame.header.serialize( room.first<EthernetHeader::LENGTH>() );
+      return { payload.expand_front( EthernetHeader::LENGTH ) };
+    }
+  }
+
+  Serializer s;
+  frame.serialize( s );
+  return s.output();
+}
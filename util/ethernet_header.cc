@@ -1,10 +1,21 @@
 #include "ethernet_header.hh"
+#include "header_layout.hh"
 
 #include <iomanip>
 #include <sstream>
 
 using namespace std;
 
+namespace {
+
+using EthernetLayout = HeaderLayout<Field<&EthernetHeader::dst, 0, 48>,
+                                    Field<&EthernetHeader::src, 48, 48>,
+                                    Field<&EthernetHeader::type, 96, 16>>;
+
+static_assert( EthernetLayout::LENGTH == EthernetHeader::LENGTH );
+
+} // namespace
+
 //! \returns A string with a textual representation of an Ethernet address
 string to_string( const EthernetAddress address )
 {
@@ -43,32 +54,15 @@ string EthernetHeader::to_string() const
 
 void EthernetHeader::parse( Parser& parser )
 {
-  // read destination address
-  for ( auto& b : dst ) {
-    parser.integer( b );
-  }
-
-  // read source address
-  for ( auto& b : src ) {
-    parser.integer( b );
-  }
-
-  // read frame type (e.g. IPv4, ARP, or something else)
-  parser.integer( type );
+  EthernetLayout::parse( *this, parser );
 }
 
 void EthernetHeader::serialize( Serializer& serializer ) const
 {
-  // write destination address
-  for ( const auto& b : dst ) {
-    serializer.integer( b );
-  }
-
-  // write source address
-  for ( const auto& b : src ) {
-    serializer.integer( b );
-  }
+  EthernetLayout::serialize( *this, serializer );
+}
 
-  // write frame type (e.g. IPv4, ARP, or something else)
-  serializer.integer( type );
+void EthernetHeader::serialize( span<char, LENGTH> out ) const
+{
+  EthernetLayout::serialize( *this, reinterpret_cast<uint8_t*>( out.data() ) ); // NOLINT(*-reinterpret-cast)
 }
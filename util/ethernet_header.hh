@@ -4,6 +4,7 @@
 
 #include <array>
 #include <cstdint>
+#include <span>
 #include <string>
 
 // Helper type for an Ethernet address (an array of six bytes)
@@ -22,6 +23,8 @@ struct EthernetHeader
   static constexpr uint16_t TYPE_IPv4 = 0x800; //!< Type number for [IPv4](\ref rfc::rfc791)
   static constexpr uint16_t TYPE_ARP = 0x806;  //!< Type number for [ARP](\ref rfc::rfc826)
 
+  static constexpr uint64_t serialized_length() { return LENGTH; }
+
   EthernetAddress dst;
   EthernetAddress src;
   uint16_t type;
@@ -31,4 +34,5 @@ struct EthernetHeader
 
   void parse( Parser& parser );
   void serialize( Serializer& serializer ) const;
+  void serialize( std::span<char, LENGTH> out ) const;
 };
@@ -1,8 +1,12 @@
 #include "file_descriptor.hh"
 
+#include "buffer.hh"
+#include "buffer_pool.hh"
 #include "exception.hh"
+#include "io_uring.hh"
 
 #include <algorithm>
+#include <atomic>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
@@ -13,6 +17,53 @@
 
 using namespace std;
 
+namespace {
+
+atomic<FileDescriptor::IOBackend> selected_backend { FileDescriptor::IOBackend::Syscall };
+
+// Run a single readv/writev on the calling thread's ring and wait for it.
+// Follows the system-call convention: returns -1 and sets errno on failure.
+ssize_t ring_rw( const FileDescriptor& fd, const vector<iovec>& iovecs, bool is_write )
+{
+  thread_local IOUring ring { 64 };
+
+  if ( is_write ) {
+    ring.prepare_writev( fd, iovecs, 0 );
+  } else {
+    ring.prepare_readv( fd, iovecs, 0 );
+  }
+  ring.submit( 1 );
+
+  thread_local vector<IOUring::Completion> completions;
+  completions.clear();
+  while ( ring.reap( completions ) == 0 ) {
+    ring.submit( 1 );
+  }
+
+  const int32_t result = completions.front().result;
+  if ( result < 0 ) {
+    errno = -result;
+    return -1;
+  }
+  return result;
+}
+
+} // namespace
+
+FileDescriptor::IOBackend FileDescriptor::set_io_backend( IOBackend backend )
+{
+  if ( backend == IOBackend::IOUring and not IOUring::supported() ) {
+    backend = IOBackend::Syscall;
+  }
+  selected_backend.store( backend );
+  return backend;
+}
+
+FileDescriptor::IOBackend FileDescriptor::io_backend()
+{
+  return selected_backend.load( memory_order_relaxed );
+}
+
 template<typename T>
 T FileDescriptor::FDWrapper::CheckSystemCall( string_view s_attempt, T return_value ) const
 {
@@ -82,28 +133,12 @@ FileDescriptor FileDescriptor::duplicate() const
 // buffer is the string to be read into
 void FileDescriptor::read( string& buffer )
 {
-  buffer.clear();
-  buffer.resize( kReadBufferSize );
-
-  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
-  if ( bytes_read < 0 ) {
-    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
-      return;
-    }
-    throw unix_error { "read" };
-  }
-
-  register_read();
-
-  if ( bytes_read == 0 ) {
-    internal_fd_->eof_ = true;
-  }
-
-  if ( bytes_read > static_cast<ssize_t>( buffer.size() ) ) {
-    throw runtime_error( "read() read more than requested" );
-  }
-
-  buffer.resize( bytes_read );
+  // Read into a pooled buffer and copy out what arrived, rather than zero-filling a whole read buffer's
+  // worth of string on every call
+  thread_local BufferPool pool { kReadBufferSize, 4 };
+  Buffer data;
+  read( data, pool );
+  buffer.assign( string_view { data } );
 }
 
 void FileDescriptor::read( vector<unique_ptr<string>>& buffers )
@@ -123,7 +158,9 @@ void FileDescriptor::read( vector<unique_ptr<string>>& buffers )
     total_size += x->size();
   }
 
-  const ssize_t bytes_read = ::readv( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
+  const ssize_t bytes_read = io_backend() == IOBackend::IOUring
+                               ? ring_rw( *this, iovecs, false )
+                               : ::readv( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
   if ( bytes_read < 0 ) {
     if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
       return;
@@ -150,6 +187,34 @@ void FileDescriptor::read( vector<unique_ptr<string>>& buffers )
   }
 }
 
+void FileDescriptor::read( Buffer& buffer, BufferPool& pool )
+{
+  shared_ptr<char> storage = pool.lease();
+
+  const ssize_t bytes_read = io_backend() == IOBackend::IOUring
+                               ? ring_rw( *this, { { storage.get(), pool.buffer_size() } }, false )
+                               : ::read( fd_num(), storage.get(), pool.buffer_size() );
+  if ( bytes_read < 0 ) {
+    buffer = {};
+    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+      return;
+    }
+    throw unix_error { "read" };
+  }
+
+  register_read();
+
+  if ( bytes_read == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+
+  if ( bytes_read > static_cast<ssize_t>( pool.buffer_size() ) ) {
+    throw runtime_error( "read() read more than requested" );
+  }
+
+  buffer = { move( storage ), static_cast<size_t>( bytes_read ) };
+}
+
 size_t FileDescriptor::write( string_view buffer )
 {
   return write( vector<string_view> { buffer } );
@@ -165,8 +230,10 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
     total_size += x.size();
   }
 
-  const ssize_t bytes_written
-    = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
+  const ssize_t bytes_written = CheckSystemCall(
+    "writev",
+    io_backend() == IOBackend::IOUring ? ring_rw( *this, iovecs, true )
+                                       : ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
   register_write();
 
   if ( bytes_written == 0 and total_size != 0 ) {
@@ -5,6 +5,9 @@
 #include <memory>
 #include <vector>
 
+class Buffer;
+class BufferPool;
+
 // A reference-counted handle to a file descriptor
 class FileDescriptor
 {
@@ -55,16 +58,31 @@ protected:
   T CheckSystemCall( std::string_view s_attempt, T return_value ) const;
 
 public:
+  // How read() and write() reach the kernel
+  enum class IOBackend
+  {
+    Syscall, // read(2)/readv(2)/writev(2)
+    IOUring, // one-shot submissions on a per-thread io_uring (see io_uring.hh)
+  };
+
+  // Select the I/O backend for all FileDescriptors; falls back to Syscall if io_uring is unavailable.
+  // Returns the backend actually in effect.
+  static IOBackend set_io_backend( IOBackend backend );
+  static IOBackend io_backend();
+
   // Construct from a file descriptor number returned by the kernel
   explicit FileDescriptor( int fd );
 
   // Free the std::shared_ptr; the FDWrapper destructor calls close() when the refcount goes to zero.
   ~FileDescriptor() = default;
 
-  // Read into `buffer`
+  // Read into `buffer` (by way of a per-thread BufferPool)
   void read( std::string& buffer );
   void read( std::vector<std::unique_ptr<std::string>>& buffers );
 
+  // Read into a buffer leased from `pool` (no allocation or zero-fill when the pool has a free buffer)
+  void read( Buffer& buffer, BufferPool& pool );
+
   // Attempt to write a buffer
   // returns number of bytes written
   size_t write( std::string_view buffer );
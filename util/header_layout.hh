@@ -0,0 +1,169 @@
+#pragma once
+
+#include "parser.hh"
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Compile-time description of a fixed-size, big-endian header.
+//
+// A layout is a typed list of Field<member, bit offset, bit width> entries, in wire order. Both
+// directions (parse and serialize) are generated from the same list, as straight-line code with
+// every offset known at compile time, so the two can never drift apart. The list is checked at
+// compile time to tile the header exactly, with no gaps or overlaps.
+//
+// Bits that carry no member (e.g. a must-be-zero flag) are described with Reserved<bit offset, bit width>.
+//
+// Supported member types are unsigned integers, bool (as a bit flag), and std::array<uint8_t, N>
+// (as a byte-aligned run of N bytes, e.g. an EthernetAddress).
+
+namespace header_layout {
+
+template<typename T>
+struct member_traits;
+
+template<typename C, typename M>
+struct member_traits<M C::*>
+{
+  using class_type = C;
+  using member_type = M;
+};
+
+template<typename T>
+struct is_byte_array : std::false_type
+{};
+
+template<size_t N>
+struct is_byte_array<std::array<uint8_t, N>> : std::true_type
+{};
+
+} // namespace header_layout
+
+template<auto Member, size_t BitOffset, size_t BitWidth>
+struct Field
+{
+  using Class = typename header_layout::member_traits<decltype( Member )>::class_type;
+  using Type = typename header_layout::member_traits<decltype( Member )>::member_type;
+
+  static constexpr size_t bit_offset = BitOffset;
+  static constexpr size_t bit_width = BitWidth;
+
+  static constexpr size_t first_byte = BitOffset / 8;
+  static constexpr size_t num_bytes = ( BitOffset % 8 + BitWidth + 7 ) / 8;
+  static constexpr size_t shift = num_bytes * 8 - BitOffset % 8 - BitWidth; // bits to the right of the field
+
+  static_assert( BitWidth > 0 );
+
+  static constexpr bool is_bytes = header_layout::is_byte_array<Type>::value;
+  static_assert( not is_bytes or ( BitOffset % 8 == 0 and BitWidth == 8 * sizeof( Type ) ),
+                 "byte-array fields must be byte-aligned and span the whole array" );
+  static_assert( is_bytes or std::same_as<Type, bool> or std::unsigned_integral<Type>,
+                 "unsupported field type" );
+  static_assert( is_bytes or num_bytes <= sizeof( uint64_t ), "integer field spans more than 8 bytes" );
+  static_assert( is_bytes or BitWidth <= 8 * sizeof( Type ), "field is wider than its member" );
+
+  static void parse( Class& obj, const uint8_t* data )
+  {
+    if constexpr ( is_bytes ) {
+      std::memcpy( ( obj.*Member ).data(), data + first_byte, sizeof( Type ) );
+    } else {
+      uint64_t word = 0;
+      for ( size_t i = 0; i < num_bytes; ++i ) {
+        word = ( word << 8 ) | data[first_byte + i];
+      }
+      word >>= shift;
+      if constexpr ( BitWidth < 64 ) {
+        word &= ( uint64_t { 1 } << BitWidth ) - 1;
+      }
+      obj.*Member = static_cast<Type>( word );
+    }
+  }
+
+  // Assumes the field's bits in `data` start out zero
+  static void serialize( const Class& obj, uint8_t* data )
+  {
+    if constexpr ( is_bytes ) {
+      std::memcpy( data + first_byte, ( obj.*Member ).data(), sizeof( Type ) );
+    } else {
+      uint64_t word = static_cast<uint64_t>( obj.*Member );
+      if constexpr ( BitWidth < 64 ) {
+        word &= ( uint64_t { 1 } << BitWidth ) - 1;
+      }
+      word <<= shift;
+      for ( size_t i = num_bytes; i > 0; --i ) {
+        data[first_byte + i - 1] |= static_cast<uint8_t>( word );
+        word >>= 8;
+      }
+    }
+  }
+};
+
+// Bits with no corresponding member: ignored when parsing, written as zero when serializing
+template<size_t BitOffset, size_t BitWidth>
+struct Reserved
+{
+  static constexpr size_t bit_offset = BitOffset;
+  static constexpr size_t bit_width = BitWidth;
+
+  static_assert( BitWidth > 0 );
+
+  template<typename T>
+  static void parse( T& /* obj */, const uint8_t* /* data */ )
+  {}
+
+  template<typename T>
+  static void serialize( const T& /* obj */, uint8_t* /* data */ )
+  {}
+};
+
+template<typename... Fields>
+class HeaderLayout
+{
+  static constexpr bool fields_tile_header()
+  {
+    size_t next_bit = 0;
+    return ( ( Fields::bit_offset == std::exchange( next_bit, next_bit + Fields::bit_width ) ) and ... )
+           and next_bit % 8 == 0;
+  }
+
+public:
+  static_assert( sizeof...( Fields ) > 0 );
+  static_assert( fields_tile_header(), "fields must be listed in wire order with no gaps or overlaps" );
+
+  static constexpr size_t LENGTH = ( Fields::bit_width + ... ) / 8;
+
+  template<typename T>
+  static void parse( T& obj, const uint8_t* data )
+  {
+    ( Fields::parse( obj, data ), ... );
+  }
+
+  template<typename T>
+  static void serialize( const T& obj, uint8_t* data )
+  {
+    std::memset( data, 0, LENGTH );
+    ( Fields::serialize( obj, data ), ... );
+  }
+
+  // Parse from the Parser's next LENGTH bytes (in place when they are contiguous)
+  template<typename T>
+  static void parse( T& obj, Parser& parser )
+  {
+    std::array<char, LENGTH> scratch;
+    const char* data = parser.contiguous( scratch );
+    if ( data ) {
+      parse( obj, reinterpret_cast<const uint8_t*>( data ) ); // NOLINT(*-reinterpret-cast)
+    }
+  }
+
+  template<typename T>
+  static void serialize( const T& obj, Serializer& serializer )
+  {
+    serialize( obj, reinterpret_cast<uint8_t*>( serializer.bytes( LENGTH ).data() ) ); // NOLINT(*-reinterpret-cast)
+  }
+};
@@ -0,0 +1,350 @@
+#include "io_uring.hh"
+
+#include "exception.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+int io_uring_setup( unsigned entries, io_uring_params& params )
+{
+  return static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) );
+}
+
+int io_uring_enter( int fd, unsigned to_submit, unsigned min_complete, unsigned flags )
+{
+  return static_cast<int>( syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0 ) );
+}
+
+int io_uring_register( int fd, unsigned opcode, const void* arg, unsigned nr_args )
+{
+  return static_cast<int>( syscall( __NR_io_uring_register, fd, opcode, arg, nr_args ) );
+}
+
+void* map_ring( const string_view what, size_t length, int fd, off_t offset )
+{
+  void* const ptr = mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset );
+  if ( ptr == MAP_FAILED ) {
+    throw unix_error { what };
+  }
+  return ptr;
+}
+
+template<typename T>
+T* at_offset( void* base, uint32_t offset )
+{
+  return reinterpret_cast<T*>( static_cast<char*>( base ) + offset ); // NOLINT(*-reinterpret-cast)
+}
+
+// The kernel updates the ring indices concurrently, so every access goes through an atomic_ref
+unsigned load_acquire( unsigned* p )
+{
+  return atomic_ref<unsigned> { *p }.load( memory_order_acquire );
+}
+
+void store_release( unsigned* p, unsigned value )
+{
+  atomic_ref<unsigned> { *p }.store( value, memory_order_release );
+}
+
+} // namespace
+
+optional<uint16_t> IOUring::Completion::buffer_id() const
+{
+  if ( not( flags & IORING_CQE_F_BUFFER ) ) {
+    return {};
+  }
+  return static_cast<uint16_t>( flags >> IORING_CQE_BUFFER_SHIFT );
+}
+
+IOUring::IOUring( unsigned entries )
+  : ring_fd_( ::CheckSystemCall( "io_uring_setup", io_uring_setup( entries, params_ ) ) )
+{
+  sq_ring_bytes_ = params_.sq_off.array + params_.sq_entries * sizeof( unsigned );
+  cq_ring_bytes_ = params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe );
+
+  const bool single_mmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+  if ( single_mmap ) {
+    sq_ring_bytes_ = cq_ring_bytes_ = max( sq_ring_bytes_, cq_ring_bytes_ );
+  }
+
+  sq_ring_ = map_ring( "mmap(sq_ring)", sq_ring_bytes_, ring_fd_.fd_num(), IORING_OFF_SQ_RING );
+  cq_ring_ = single_mmap ? sq_ring_
+                         : map_ring( "mmap(cq_ring)", cq_ring_bytes_, ring_fd_.fd_num(), IORING_OFF_CQ_RING );
+
+  sqes_bytes_ = params_.sq_entries * sizeof( io_uring_sqe );
+  sqes_ = static_cast<io_uring_sqe*>( map_ring( "mmap(sqes)", sqes_bytes_, ring_fd_.fd_num(), IORING_OFF_SQES ) );
+
+  sq_head_ = at_offset<unsigned>( sq_ring_, params_.sq_off.head );
+  sq_tail_ = at_offset<unsigned>( sq_ring_, params_.sq_off.tail );
+  sq_array_ = at_offset<unsigned>( sq_ring_, params_.sq_off.array );
+  sq_mask_ = *at_offset<unsigned>( sq_ring_, params_.sq_off.ring_mask );
+
+  cq_head_ = at_offset<unsigned>( cq_ring_, params_.cq_off.head );
+  cq_tail_ = at_offset<unsigned>( cq_ring_, params_.cq_off.tail );
+  cq_mask_ = *at_offset<unsigned>( cq_ring_, params_.cq_off.ring_mask );
+  cqes_ = at_offset<io_uring_cqe>( cq_ring_, params_.cq_off.cqes );
+
+  sqe_tail_ = sqe_submitted_ = load_acquire( sq_tail_ );
+}
+
+IOUring::~IOUring()
+{
+  for ( const auto& br : buffer_rings_ ) {
+    munmap( br.ring, br.ring_bytes );
+  }
+  munmap( sqes_, sqes_bytes_ );
+  if ( cq_ring_ != sq_ring_ ) {
+    munmap( cq_ring_, cq_ring_bytes_ );
+  }
+  munmap( sq_ring_, sq_ring_bytes_ );
+}
+
+bool IOUring::supported()
+{
+  static const bool result = [] {
+    io_uring_params params {};
+    const int fd = io_uring_setup( 1, params );
+    if ( fd < 0 ) {
+      return false;
+    }
+    ::close( fd );
+    return true;
+  }();
+  return result;
+}
+
+io_uring_sqe& IOUring::next_sqe()
+{
+  if ( sqe_tail_ - load_acquire( sq_head_ ) >= params_.sq_entries ) {
+    submit();
+    if ( sqe_tail_ - load_acquire( sq_head_ ) >= params_.sq_entries ) {
+      throw runtime_error( "io_uring submission queue is full" );
+    }
+  }
+
+  const unsigned index = sqe_tail_ & sq_mask_;
+  io_uring_sqe& sqe = sqes_[index]; // NOLINT(*-pointer-arithmetic)
+  memset( &sqe, 0, sizeof( sqe ) );
+  sq_array_[index] = index; // NOLINT(*-pointer-arithmetic)
+  ++sqe_tail_;
+  return sqe;
+}
+
+void IOUring::prepare_read( const FileDescriptor& fd, span<char> buffer, uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = fd.fd_num();
+  sqe.off = -1; // use (and advance) the file position, like read(2)
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = buffer.size();
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_write( const FileDescriptor& fd, string_view buffer, uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_WRITE;
+  sqe.fd = fd.fd_num();
+  sqe.off = -1;
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = buffer.size();
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_readv( const FileDescriptor& fd, span<const iovec> iovecs, uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_READV;
+  sqe.fd = fd.fd_num();
+  sqe.off = -1;
+  sqe.addr = reinterpret_cast<uint64_t>( iovecs.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = iovecs.size();
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_writev( const FileDescriptor& fd, span<const iovec> iovecs, uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_WRITEV;
+  sqe.fd = fd.fd_num();
+  sqe.off = -1;
+  sqe.addr = reinterpret_cast<uint64_t>( iovecs.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = iovecs.size();
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_read_fixed( const FileDescriptor& fd,
+                                  span<char> buffer,
+                                  uint16_t index,
+                                  uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_READ_FIXED;
+  sqe.fd = fd.fd_num();
+  sqe.off = -1;
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = buffer.size();
+  sqe.buf_index = index;
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_recv_multishot( const FileDescriptor& fd, uint16_t group, uint64_t user_data )
+{
+  buffer_ring( group ); // throws if the group does not exist
+
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_RECV;
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.fd = fd.fd_num();
+  sqe.buf_group = group;
+  sqe.user_data = user_data;
+}
+
+unsigned IOUring::submit( unsigned wait_nr )
+{
+  const unsigned to_submit = sqe_tail_ - sqe_submitted_;
+  store_release( sq_tail_, sqe_tail_ );
+  sqe_submitted_ = sqe_tail_;
+
+  if ( to_submit == 0 and wait_nr == 0 ) {
+    return 0;
+  }
+
+  const unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+  int ret {};
+  do {
+    ret = io_uring_enter( ring_fd_.fd_num(), to_submit, wait_nr, flags );
+    ++enters_;
+  } while ( ret < 0 and errno == EINTR );
+
+  return ::CheckSystemCall( "io_uring_enter", ret );
+}
+
+size_t IOUring::reap( vector<Completion>& out )
+{
+  unsigned head = *cq_head_;
+  const unsigned tail = load_acquire( cq_tail_ );
+  const size_t count = tail - head;
+
+  for ( ; head != tail; ++head ) {
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_]; // NOLINT(*-pointer-arithmetic)
+    out.push_back( { cqe.user_data, cqe.res, cqe.flags } );
+  }
+
+  store_release( cq_head_, head );
+  return count;
+}
+
+size_t IOUring::submit_and_reap( vector<Completion>& out, unsigned wait_nr )
+{
+  submit( wait_nr );
+  size_t count = reap( out );
+  while ( count < wait_nr ) {
+    submit( wait_nr - count );
+    count += reap( out );
+  }
+  return count;
+}
+
+void IOUring::register_buffers( span<const iovec> buffers )
+{
+  ::CheckSystemCall(
+    "io_uring_register(BUFFERS)",
+    io_uring_register( ring_fd_.fd_num(), IORING_REGISTER_BUFFERS, buffers.data(), buffers.size() ) );
+}
+
+void IOUring::unregister_buffers()
+{
+  ::CheckSystemCall( "io_uring_register(UNREGISTER_BUFFERS)",
+                     io_uring_register( ring_fd_.fd_num(), IORING_UNREGISTER_BUFFERS, nullptr, 0 ) );
+}
+
+void IOUring::add_buffer_ring( uint16_t group, uint16_t count, uint32_t size )
+{
+  if ( count == 0 or ( count & ( count - 1 ) ) ) {
+    throw runtime_error( "io_uring buffer ring size must be a power of two" );
+  }
+  for ( const auto& br : buffer_rings_ ) {
+    if ( br.group == group ) {
+      throw runtime_error( "io_uring buffer group already exists: " + to_string( group ) );
+    }
+  }
+
+  BufferRing br { group, count, size, nullptr, count * sizeof( io_uring_buf ), vector<char>( count * size ) };
+
+  // the ring itself must be page-aligned memory shared with the kernel
+  void* const ring = mmap( nullptr, br.ring_bytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0 );
+  if ( ring == MAP_FAILED ) {
+    throw unix_error { "mmap(buffer ring)" };
+  }
+  br.ring = static_cast<io_uring_buf*>( ring );
+  br.ring[0].resv = 0; // NOLINT(*-pointer-arithmetic)
+
+  io_uring_buf_reg reg {};
+  reg.ring_addr = reinterpret_cast<uint64_t>( ring ); // NOLINT(*-reinterpret-cast)
+  reg.ring_entries = count;
+  reg.bgid = group;
+  if ( io_uring_register( ring_fd_.fd_num(), IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 ) {
+    const int saved_errno = errno;
+    munmap( ring, br.ring_bytes );
+    throw unix_error { "io_uring_register(PBUF_RING)", saved_errno };
+  }
+
+  buffer_rings_.push_back( move( br ) );
+  for ( uint16_t bid = 0; bid < count; ++bid ) {
+    recycle_buffer( group, bid );
+  }
+}
+
+string_view IOUring::provided_buffer( uint16_t group, const Completion& completion ) const
+{
+  const auto bid = completion.buffer_id();
+  if ( not bid.has_value() or completion.result < 0 ) {
+    return {};
+  }
+  const BufferRing& br = buffer_ring( group );
+  return { br.storage.data() + static_cast<size_t>( *bid ) * br.size, static_cast<size_t>( completion.result ) };
+}
+
+void IOUring::recycle_buffer( uint16_t group, uint16_t buffer_id )
+{
+  BufferRing& br = buffer_ring( group );
+  uint16_t& ring_tail = br.ring[0].resv; // NOLINT(*-pointer-arithmetic)
+  const uint16_t tail = ring_tail;
+  io_uring_buf& buf = br.ring[tail & ( br.count - 1 )]; // NOLINT(*-pointer-arithmetic)
+  buf.addr = reinterpret_cast<uint64_t>( br.storage.data() + static_cast<size_t>( buffer_id ) * br.size ); // NOLINT
+  buf.len = br.size;
+  buf.bid = buffer_id;
+  atomic_ref<uint16_t> { ring_tail }.store( tail + 1, memory_order_release );
+}
+
+IOUring::BufferRing& IOUring::buffer_ring( uint16_t group )
+{
+  for ( auto& br : buffer_rings_ ) {
+    if ( br.group == group ) {
+      return br;
+    }
+  }
+  throw runtime_error( "unknown io_uring buffer group: " + to_string( group ) );
+}
+
+const IOUring::BufferRing& IOUring::buffer_ring( uint16_t group ) const
+{
+  for ( const auto& br : buffer_rings_ ) {
+    if ( br.group == group ) {
+      return br;
+    }
+  }
+  throw runtime_error( "unknown io_uring buffer group: " + to_string( group ) );
+}
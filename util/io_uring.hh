@@ -0,0 +1,156 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+// A minimal wrapper around a Linux io_uring instance (raw syscalls, no liburing).
+//
+// Operations are queued with the prepare_*() methods and are not seen by the kernel until
+// submit() is called, so a driver loop can batch reads and writes on many descriptors into
+// a single io_uring_enter(2). Completions are reaped with reap(), which does not enter the
+// kernel at all; submit_and_reap() does both, for a whole batch, with one io_uring_enter(2).
+//
+// Reads can also go into buffers pinned with register_buffers() (e.g. a BufferPool's slabs),
+// which saves the kernel mapping them on every operation, or into buffers the kernel picks
+// from a provided-buffer ring, which lets one multishot receive stay armed for many datagrams.
+//
+// (FileDescriptor's IOUring backend has to finish each read or write before returning, so it
+// submits one operation at a time; it is there for code that can't be restructured. A loop
+// that owns its descriptors should drive an IOUring directly.)
+//
+// An IOUring is not thread-safe; use one ring per thread.
+class IOUring
+{
+public:
+  // The result of one completed (or, for multishot operations, partially completed) operation
+  struct Completion
+  {
+    uint64_t user_data {}; // the tag given to prepare_*()
+    int32_t result {};     // bytes transferred, or -errno on failure
+    uint32_t flags {};     // IORING_CQE_F_* flags
+
+    // Will the originating multishot operation post more completions?
+    bool more() const { return flags & IORING_CQE_F_MORE; }
+
+    // Which provided buffer (if any) the kernel picked for this completion
+    std::optional<uint16_t> buffer_id() const;
+  };
+
+  // Set up a ring with room for `entries` queued submissions
+  explicit IOUring( unsigned entries = 256 );
+
+  // Unmaps the rings and closes the ring descriptor
+  ~IOUring();
+
+  // Does the running kernel (and sandbox) allow io_uring? Probed once per process.
+  static bool supported();
+
+  // Queue a read(2) of up to `buffer.size()` bytes, or a write(2) of `buffer`
+  void prepare_read( const FileDescriptor& fd, std::span<char> buffer, uint64_t user_data );
+  void prepare_write( const FileDescriptor& fd, std::string_view buffer, uint64_t user_data );
+
+  // Queue a readv(2)/writev(2). The iovec array must stay alive until submit() returns.
+  void prepare_readv( const FileDescriptor& fd, std::span<const iovec> iovecs, uint64_t user_data );
+  void prepare_writev( const FileDescriptor& fd, std::span<const iovec> iovecs, uint64_t user_data );
+
+  // Queue a read into a buffer registered with register_buffers() (`buffer` must lie inside entry `index`)
+  void prepare_read_fixed( const FileDescriptor& fd, std::span<char> buffer, uint16_t index, uint64_t user_data );
+
+  // Queue a multishot receive on a socket (including a PacketSocket). Each arriving datagram posts a
+  // completion whose payload is in a buffer taken from provided-buffer group `group` (see
+  // add_buffer_ring()). The operation stays armed while Completion::more() is true.
+  void prepare_recv_multishot( const FileDescriptor& fd, uint16_t group, uint64_t user_data );
+
+  // Hand the queued submissions to the kernel and wait for at least `wait_nr` completions.
+  // Returns the number of submissions consumed.
+  unsigned submit( unsigned wait_nr = 0 );
+
+  // Append every available completion to `out` (without entering the kernel); returns the number appended
+  size_t reap( std::vector<Completion>& out );
+
+  // Hand the queued submissions to the kernel, wait for at least `wait_nr` completions, and append
+  // every available completion to `out`, with one io_uring_enter(2) (or more only if interrupted, or
+  // if the queue filled up while preparing). Returns the number appended.
+  size_t submit_and_reap( std::vector<Completion>& out, unsigned wait_nr );
+
+  // Number of io_uring_enter(2) calls made so far
+  uint64_t enters() const { return enters_; }
+
+  // Pin `buffers` in the kernel for use with prepare_read_fixed(); entry i has index i
+  void register_buffers( std::span<const iovec> buffers );
+  void unregister_buffers();
+
+  // Create provided-buffer group `group` with `count` (a power of two) buffers of `size` bytes each
+  void add_buffer_ring( uint16_t group, uint16_t count, uint32_t size );
+
+  // The bytes that a multishot completion received into its provided buffer
+  std::string_view provided_buffer( uint16_t group, const Completion& completion ) const;
+
+  // Give a provided buffer back to the kernel after its contents have been consumed
+  void recycle_buffer( uint16_t group, uint16_t buffer_id );
+
+  // Number of queued submissions that have not yet been handed to the kernel
+  unsigned unsubmitted() const { return sqe_tail_ - sqe_submitted_; }
+
+  // An IOUring cannot be copied or moved
+  IOUring( const IOUring& other ) = delete;
+  IOUring& operator=( const IOUring& other ) = delete;
+  IOUring( IOUring&& other ) = delete;
+  IOUring& operator=( IOUring&& other ) = delete;
+
+private:
+  // A kernel-shared ring of provided buffers plus the memory backing them.
+  // The ring is an array of io_uring_buf whose first `resv` field doubles as the tail index
+  // (struct io_uring_buf_ring expresses this with a C-only flexible-array trick that has a
+  // different layout in C++, so it is not used here).
+  struct BufferRing
+  {
+    uint16_t group {};
+    uint16_t count {};
+    uint32_t size {};
+    io_uring_buf* ring {};
+    size_t ring_bytes {};
+    std::vector<char> storage {};
+  };
+
+  io_uring_params params_ {};
+  FileDescriptor ring_fd_;
+
+  // mmap'ed regions shared with the kernel
+  void* sq_ring_ {};
+  size_t sq_ring_bytes_ {};
+  void* cq_ring_ {};
+  size_t cq_ring_bytes_ {};
+  io_uring_sqe* sqes_ {};
+  size_t sqes_bytes_ {};
+
+  // pointers into the rings
+  unsigned* sq_head_ {};
+  unsigned* sq_tail_ {};
+  unsigned* sq_array_ {};
+  unsigned sq_mask_ {};
+  unsigned* cq_head_ {};
+  unsigned* cq_tail_ {};
+  unsigned cq_mask_ {};
+  io_uring_cqe* cqes_ {};
+
+  unsigned sqe_tail_ {};      // next submission slot to fill
+  unsigned sqe_submitted_ {}; // slots already published to the kernel
+  uint64_t enters_ {};
+
+  std::vector<BufferRing> buffer_rings_ {};
+
+  // Claim and zero the next submission slot (submitting the queue first if it is full)
+  io_uring_sqe& next_sqe();
+
+  BufferRing& buffer_ring( uint16_t group );
+  const BufferRing& buffer_ring( uint16_t group ) const;
+};
@@ -13,6 +13,15 @@ struct IPv4Datagram
   IPv4Header header {};
   std::vector<Buffer> payload {};
 
+  uint64_t serialized_length() const
+  {
+    uint64_t ret = header.serialized_length();
+    for ( const auto& x : payload ) {
+      ret += x.size();
+    }
+    return ret;
+  }
+
   void parse( Parser& parser )
   {
     header.parse( parser );
@@ -29,3 +38,23 @@ struct IPv4Datagram
 };
 
 using InternetDatagram = IPv4Datagram;
+
+// Serialize a datagram into one Buffer with `headroom` bytes in front of it (see the generic
+// serialize_contiguous()). A datagram parsed from a received frame still has its header's original
+// bytes in front of its payload; if nothing else shares them, the header is rewritten there in place
+// (e.g. with a decremented TTL and updated checksum) and the payload is not copied at all.
+inline Buffer serialize_contiguous( const IPv4Datagram& dgram, size_t headroom = 0 )
+{
+  if ( dgram.payload.size() == 1 and dgram.header.hlen * 4 == IPv4Header::LENGTH ) {
+    const Buffer& payload = dgram.payload.front();
+    const std::span<char> room = payload.writable_headroom( headroom + IPv4Header::LENGTH );
+    if ( not room.empty() ) {
+      dgram.header.serialize( room.last<IPv4Header::LENGTH>() );
+      return payload.expand_front( IPv4Header::LENGTH );
+    }
+  }
+
+  Serializer s { dgram.serialized_length(), headroom };
+  dgram.serialize( s );
+  return s.contiguous_output();
+}
@@ -1,5 +1,6 @@
 #include "ipv4_header.hh"
 #include "checksum.hh"
+#include "header_layout.hh"
 
 #include <arpa/inet.h>
 #include <array>
@@ -8,28 +9,32 @@
 
 using namespace std;
 
+namespace {
+
+// Wire format of the fixed part of the header (see the diagram in ipv4_header.hh)
+using IPv4Layout = HeaderLayout<Field<&IPv4Header::ver, 0, 4>,
+                                Field<&IPv4Header::hlen, 4, 4>,
+                                Field<&IPv4Header::tos, 8, 8>,
+                                Field<&IPv4Header::len, 16, 16>,
+                                Field<&IPv4Header::id, 32, 16>,
+                                Reserved<48, 1>,
+                                Field<&IPv4Header::df, 49, 1>,
+                                Field<&IPv4Header::mf, 50, 1>,
+                                Field<&IPv4Header::offset, 51, 13>,
+                                Field<&IPv4Header::ttl, 64, 8>,
+                                Field<&IPv4Header::proto, 72, 8>,
+                                Field<&IPv4Header::cksum, 80, 16>,
+                                Field<&IPv4Header::src, 96, 32>,
+                                Field<&IPv4Header::dst, 128, 32>>;
+
+static_assert( IPv4Layout::LENGTH == IPv4Header::LENGTH );
+
+} // namespace
+
 // Parse from string.
 void IPv4Header::parse( Parser& parser )
 {
-  uint8_t first_byte {};
-  parser.integer( first_byte );
-  ver = first_byte >> 4;    // version
-  hlen = first_byte & 0x0f; // header length
-  parser.integer( tos );    // type of service
-  parser.integer( len );
-  parser.integer( id );
-
-  uint16_t fo_val {};
-  parser.integer( fo_val );
-  df = static_cast<bool>( fo_val & 0x4000 ); // don't fragment
-  mf = static_cast<bool>( fo_val & 0x2000 ); // more fragments
-  offset = fo_val & 0x1fff;                  // offset
-
-  parser.integer( ttl );
-  parser.integer( proto );
-  parser.integer( cksum );
-  parser.integer( src );
-  parser.integer( dst );
+  IPv4Layout::parse( *this, parser );
 
   if ( ver != 4 ) {
     parser.set_error();
@@ -57,22 +62,16 @@ void IPv4Header::serialize( Serializer& serializer ) const
     throw runtime_error( "wrong IP version" );
   }
 
-  const uint8_t first_byte = ( static_cast<uint32_t>( ver ) << 4 ) | ( hlen & 0xfU );
-  serializer.integer( first_byte ); // version and header length
-  serializer.integer( tos );
-  serializer.integer( len );
-  serializer.integer( id );
-
-  const uint16_t fo_val = ( df ? 0x4000U : 0 ) | ( mf ? 0x2000U : 0 ) | ( offset & 0x1fffU );
-  serializer.integer( fo_val );
-
-  serializer.integer( ttl );
-  serializer.integer( proto );
+  IPv4Layout::serialize( *this, serializer );
+}
 
-  serializer.integer( cksum );
+void IPv4Header::serialize( span<char, LENGTH> out ) const
+{
+  if ( ver != 4 ) {
+    throw runtime_error( "wrong IP version" );
+  }
 
-  serializer.integer( src );
-  serializer.integer( dst );
+  IPv4Layout::serialize( *this, reinterpret_cast<uint8_t*>( out.data() ) ); // NOLINT(*-reinterpret-cast)
 }
 
 uint16_t IPv4Header::payload_length() const
@@ -103,15 +102,33 @@ uint32_t IPv4Header::pseudo_checksum() const
 void IPv4Header::compute_checksum()
 {
   cksum = 0;
-  Serializer s;
-  serialize( s );
+  array<uint8_t, LENGTH> raw {};
+  IPv4Layout::serialize( *this, raw.data() );
 
   // calculate checksum -- taken over header only
   InternetChecksum check;
-  check.add( s.output() );
+  check.add( { reinterpret_cast<const char*>( raw.data() ), raw.size() } ); // NOLINT(*-reinterpret-cast)
   cksum = check.value();
 }
 
+void IPv4Header::update_checksum( const uint16_t old_word, const uint16_t new_word )
+{
+  // HC' = ~(~HC + ~m + m'), in one's complement arithmetic
+  uint32_t sum = static_cast<uint16_t>( ~cksum ) + static_cast<uint32_t>( static_cast<uint16_t>( ~old_word ) );
+  sum += new_word;
+  sum = ( sum >> 16 ) + ( sum & 0xffff );
+  sum += sum >> 16;
+  cksum = ~static_cast<uint16_t>( sum );
+}
+
+void IPv4Header::decrement_ttl()
+{
+  // TTL shares a 16-bit word with the protocol number
+  const uint16_t old_word = ( static_cast<uint16_t>( ttl ) << 8 ) | proto;
+  --ttl;
+  update_checksum( old_word, ( static_cast<uint16_t>( ttl ) << 8 ) | proto );
+}
+
 std::string IPv4Header::to_string() const
 {
   stringstream ss {};
@@ -4,6 +4,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include <string>
 
 // IPv4 Internet datagram header (note: IP options are not supported)
@@ -57,9 +58,17 @@ struct IPv4Header
   // Set checksum to correct value
   void compute_checksum();
 
+  // Adjust the checksum for one 16-bit word of the header changing from `old_word` to `new_word`,
+  // without re-summing the rest of the header (RFC 1624, eqn. 3)
+  void update_checksum( uint16_t old_word, uint16_t new_word );
+
+  // Decrement the TTL and update the checksum to match
+  void decrement_ttl();
+
   // Return a string containing a header in human-readable format
   std::string to_string() const;
 
   void parse( Parser& parser );
   void serialize( Serializer& serializer ) const;
+  void serialize( std::span<char, LENGTH> out ) const;
 };
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// A bounded, lock-free queue with any number of producer threads and a single consumer thread
+// (after Dmitry Vyukov's bounded MPMC queue, with the consumer side simplified).
+//
+// Each slot carries a sequence number that says whose turn it is: a producer may fill slot
+// `pos % capacity` once its sequence is `pos`, and the consumer may empty it once its sequence is
+// `pos + 1`. Producers claim positions with one compare-and-swap; the consumer needs no atomic
+// read-modify-write at all. Neither side ever waits for the other: push() fails when the queue is
+// full, and pop() returns nothing when it is empty.
+template<typename T>
+class MPSCQueue
+{
+  struct Slot
+  {
+    std::atomic<size_t> sequence {};
+    std::optional<T> value {};
+  };
+
+  size_t mask_;
+  std::unique_ptr<Slot[]> slots_; // NOLINT(*-avoid-c-arrays)
+
+  // Producers and the consumer each get their own cache line
+  alignas( 64 ) std::atomic<size_t> tail_ {}; // next position to be claimed by a producer
+  alignas( 64 ) size_t head_ {};              // next position to be read by the consumer
+
+public:
+  // `capacity` is rounded up to a power of two
+  explicit MPSCQueue( size_t capacity )
+    : mask_( std::bit_ceil( std::max( capacity, size_t { 2 } ) ) - 1 )
+    , slots_( std::make_unique<Slot[]>( mask_ + 1 ) ) // NOLINT(*-avoid-c-arrays)
+  {
+    for ( size_t i = 0; i <= mask_; ++i ) {
+      slots_[i].sequence.store( i, std::memory_order_relaxed );
+    }
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Safe to call from any thread. Returns false (and leaves `value` alone) if the queue is full.
+  bool push( T&& value )
+  {
+    size_t pos = tail_.load( std::memory_order_relaxed );
+    while ( true ) {
+      Slot& slot = slots_[pos & mask_];
+      const size_t sequence = slot.sequence.load( std::memory_order_acquire );
+      if ( sequence == pos ) {
+        if ( tail_.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+          slot.value.emplace( std::move( value ) );
+          slot.sequence.store( pos + 1, std::memory_order_release );
+          return true;
+        }
+      } else if ( sequence < pos ) {
+        return false; // the slot still holds the value from one lap ago
+      } else {
+        pos = tail_.load( std::memory_order_relaxed ); // another producer got here first
+      }
+    }
+  }
+
+  // Only to be called from the consumer thread
+  std::optional<T> pop()
+  {
+    Slot& slot = slots_[head_ & mask_];
+    if ( slot.sequence.load( std::memory_order_acquire ) != head_ + 1 ) {
+      return {};
+    }
+    std::optional<T> ret = std::move( slot.value );
+    slot.value.reset();
+    slot.sequence.store( head_ + mask_ + 1, std::memory_order_release );
+    ++head_;
+    return ret;
+  }
+};
@@ -3,10 +3,12 @@
 #include "buffer.hh"
 
 #include <algorithm>
+#include <array>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
-#include <deque>
+#include <endian.h>
+#include <iterator>
 #include <numeric>
 #include <span>
 #include <stdexcept>
@@ -16,18 +18,48 @@
 
 class Serializer;
 
+template<std::unsigned_integral T>
+T big_endian_to_host( T val )
+{
+  if constexpr ( sizeof( T ) == 1 ) {
+    return val;
+  } else if constexpr ( sizeof( T ) == 2 ) {
+    return be16toh( val );
+  } else if constexpr ( sizeof( T ) == 4 ) {
+    return be32toh( val );
+  } else {
+    return be64toh( val );
+  }
+}
+
+template<std::unsigned_integral T>
+T host_to_big_endian( T val )
+{
+  if constexpr ( sizeof( T ) == 1 ) {
+    return val;
+  } else if constexpr ( sizeof( T ) == 2 ) {
+    return htobe16( val );
+  } else if constexpr ( sizeof( T ) == 4 ) {
+    return htobe32( val );
+  } else {
+    return htobe64( val );
+  }
+}
+
 class Parser
 {
   class BufferList
   {
     uint64_t size_ {};
-    std::deque<Buffer> buffer_ {};
-    uint64_t skip_ {};
+    std::vector<Buffer> buffer_ {};
+    size_t front_ {}; // index of the first unconsumed Buffer
+    size_t skip_ {};  // bytes already consumed from the front Buffer
 
   public:
     // NOLINTNEXTLINE(*-explicit-*)
     BufferList( const std::vector<Buffer>& buffers )
     {
+      buffer_.reserve( buffers.size() );
       for ( const auto& x : buffers ) {
         append( x );
       }
@@ -39,41 +71,36 @@ class Parser
 
     std::string_view peek() const
     {
-      if ( buffer_.empty() ) {
+      if ( front_ == buffer_.size() ) {
         throw std::runtime_error( "peek on empty BufferList" );
       }
-      return std::string_view { buffer_.front() }.substr( skip_ );
+      return std::string_view { buffer_[front_] }.substr( skip_ );
     }
 
     void remove_prefix( uint64_t len )
     {
-      while ( len and not buffer_.empty() ) {
-        const uint64_t to_pop_now = std::min( len, peek().size() );
+      while ( len and front_ < buffer_.size() ) {
+        const uint64_t to_pop_now = std::min( len, buffer_[front_].size() - skip_ );
         skip_ += to_pop_now;
         len -= to_pop_now;
         size_ -= to_pop_now;
-        if ( skip_ == buffer_.front().size() ) {
-          buffer_.pop_front();
+        if ( skip_ == buffer_[front_].size() ) {
+          ++front_;
           skip_ = 0;
         }
       }
     }
 
+    // Hand out the unconsumed bytes as slices of the original Buffers (nothing is copied)
     void dump_all( std::vector<Buffer>& out )
     {
-      out.clear();
-      if ( empty() ) {
-        return;
-      }
-      std::string first_str = std::move( buffer_.front() );
-      if ( skip_ ) {
-        first_str = first_str.substr( skip_ );
-      }
-      out.emplace_back( std::move( first_str ) );
-      buffer_.pop_front();
-      for ( auto&& x : buffer_ ) {
-        out.emplace_back( std::move( x ) );
+      if ( front_ < buffer_.size() ) {
+        buffer_[front_].remove_prefix( skip_ );
       }
+      out.assign( std::make_move_iterator( buffer_.begin() + static_cast<ptrdiff_t>( front_ ) ),
+                  std::make_move_iterator( buffer_.end() ) );
+      buffer_.clear();
+      front_ = skip_ = size_ = 0;
     }
 
     void dump_all( Buffer& out )
@@ -85,14 +112,18 @@ class Parser
         return;
       }
 
-      out.release().clear();
+      std::string str;
       for ( const auto& s : concat ) {
-        out.release().append( s );
+        str.append( s );
       }
+      out = std::move( str );
     }
 
     void append( Buffer str )
     {
+      if ( str.empty() ) {
+        return;
+      }
       size_ += str.size();
       buffer_.push_back( std::move( str ) );
     }
@@ -125,17 +156,22 @@ public:
       return;
     }
 
-    if constexpr ( sizeof( T ) == 1 ) {
-      out = static_cast<uint8_t>( input_.peek().front() );
-      input_.remove_prefix( 1 );
+    const std::string_view front = input_.peek();
+    if ( front.size() >= sizeof( T ) ) {
+      // fast path: the integer lies entirely within the front buffer, so load it in one go
+      T big_endian {};
+      std::memcpy( &big_endian, front.data(), sizeof( T ) );
+      out = big_endian_to_host( big_endian );
+      input_.remove_prefix( sizeof( T ) );
       return;
-    } else {
-      out = static_cast<T>( 0 );
-      for ( size_t i = 0; i < sizeof( T ); i++ ) {
-        out <<= 8;
-        out |= static_cast<uint8_t>( input_.peek().front() );
-        input_.remove_prefix( 1 );
-      }
+    }
+
+    // slow path: the integer straddles buffers
+    out = static_cast<T>( 0 );
+    for ( size_t i = 0; i < sizeof( T ); i++ ) {
+      out <<= 8;
+      out |= static_cast<uint8_t>( input_.peek().front() );
+      input_.remove_prefix( 1 );
     }
   }
 
@@ -154,6 +190,26 @@ public:
     }
   }
 
+  // Consume the next N bytes as one contiguous block. Returns a pointer to them (in place when they
+  // lie in a single buffer, otherwise copied into `scratch`), or nullptr on short input.
+  template<size_t N>
+  const char* contiguous( std::array<char, N>& scratch )
+  {
+    check_size( N );
+    if ( has_error() ) {
+      return nullptr;
+    }
+
+    const std::string_view front = input_.peek();
+    if ( front.size() >= N ) {
+      input_.remove_prefix( N );
+      return front.data();
+    }
+
+    string( scratch );
+    return scratch.data();
+  }
+
   void all_remaining( std::vector<Buffer>& out ) { input_.dump_all( out ); }
   void all_remaining( Buffer& out ) { input_.dump_all( out ); }
 };
@@ -162,24 +218,42 @@ class Serializer
 {
   std::vector<Buffer> output_ {};
   std::string buffer_ {};
+  size_t headroom_ {};
+  bool contiguous_ {};
 
 public:
   Serializer() = default;
   explicit Serializer( std::string&& buffer ) : buffer_( std::move( buffer ) ) {}
 
+  // Contiguous mode: everything, including payload Buffers, is written into one buffer reserved
+  // for `length` bytes and preceded by `headroom` spare bytes (see Buffer::headroom())
+  Serializer( size_t length, size_t headroom ) : headroom_( headroom ), contiguous_( true )
+  {
+    buffer_.reserve( headroom + length );
+    buffer_.resize( headroom );
+  }
+
   template<std::unsigned_integral T>
   void integer( const T& val )
   {
-    constexpr uint64_t len = sizeof( T );
+    const T big_endian = host_to_big_endian( val );
+    buffer_.append( reinterpret_cast<const char*>( &big_endian ), sizeof( T ) ); // NOLINT(*-reinterpret-cast)
+  }
 
-    for ( uint64_t i = 0; i < len; ++i ) {
-      const uint8_t byte_val = val >> ( ( len - i - 1 ) * 8 );
-      buffer_.push_back( byte_val );
-    }
+  // Append `n` zero bytes and return them for the caller to fill in
+  std::span<char> bytes( size_t n )
+  {
+    const size_t pos = buffer_.size();
+    buffer_.resize( pos + n );
+    return { buffer_.data() + pos, n };
   }
 
   void buffer( const Buffer& buf )
   {
+    if ( contiguous_ ) {
+      buffer_.append( buf );
+      return;
+    }
     flush();
     output_.push_back( buf );
   }
@@ -193,15 +267,33 @@ public:
 
   void flush()
   {
+    if ( contiguous_ ) {
+      return;
+    }
     output_.emplace_back( std::move( buffer_ ) );
     buffer_.clear();
   }
 
   std::vector<Buffer> output()
   {
+    if ( contiguous_ ) {
+      return { contiguous_output() };
+    }
     flush();
     return output_;
   }
+
+  // The serialized bytes as one Buffer (contiguous mode only)
+  Buffer contiguous_output()
+  {
+    if ( not contiguous_ ) {
+      throw std::runtime_error( "Serializer: contiguous_output() requires contiguous mode" );
+    }
+    Buffer ret { std::move( buffer_ ), headroom_ };
+    buffer_.clear();
+    buffer_.resize( headroom_ );
+    return ret;
+  }
 };
 
 // Helper to serialize any object (without constructing a Serializer of the caller's own)
@@ -213,6 +305,16 @@ std::vector<Buffer> serialize( const T& obj )
   return s.output();
 }
 
+// Helper to serialize an object into one contiguous Buffer, sized up front from its
+// serialized_length(), leaving `headroom` bytes in front for a lower layer's header
+template<class T>
+Buffer serialize_contiguous( const T& obj, size_t headroom = 0 )
+{
+  Serializer s { obj.serialized_length(), headroom };
+  obj.serialize( s );
+  return s.contiguous_output();
+}
+
 // Helper to parse any object (without constructing a Parser of the caller's own). Returns true if successful.
 template<class T>
 bool parse( T& obj, const std::vector<Buffer>& buffers )
@@ -1,5 +1,7 @@
 #include "socket.hh"
 
+#include "buffer.hh"
+#include "buffer_pool.hh"
 #include "exception.hh"
 
 #include <cstddef>
@@ -118,24 +120,32 @@ void Socket::shutdown( const int how )
 //! \note If payload is too small to hold the received datagram, this method throws a std::runtime_error
 void DatagramSocket::recv( Address& source_address, string& payload )
 {
-  // receive source address and payload
+  // Receive into a pooled buffer and copy out the datagram, rather than zero-filling a whole read
+  // buffer's worth of string on every call
+  thread_local BufferPool pool { kReadBufferSize, 4 };
+  Buffer datagram;
+  recv( source_address, datagram, pool );
+  payload.assign( string_view { datagram } );
+}
+
+void DatagramSocket::recv( Address& source_address, Buffer& payload, BufferPool& pool )
+{
   Address::Raw datagram_source_address;
   socklen_t fromlen = sizeof( datagram_source_address );
 
-  payload.clear();
-  payload.resize( kReadBufferSize );
+  shared_ptr<char> storage = pool.lease();
 
   const ssize_t recv_len = CheckSystemCall(
     "recvfrom",
-    ::recvfrom( fd_num(), payload.data(), payload.size(), MSG_TRUNC, datagram_source_address, &fromlen ) );
+    ::recvfrom( fd_num(), storage.get(), pool.buffer_size(), MSG_TRUNC, datagram_source_address, &fromlen ) );
 
-  if ( recv_len > static_cast<ssize_t>( payload.size() ) ) {
+  if ( recv_len > static_cast<ssize_t>( pool.buffer_size() ) ) {
     throw runtime_error( "recvfrom (oversized datagram)" );
   }
 
   register_read();
   source_address = { datagram_source_address, fromlen };
-  payload.resize( recv_len );
+  payload = { move( storage ), static_cast<size_t>( recv_len ) };
 }
 
 void DatagramSocket::sendto( const Address& destination, const string_view payload )
@@ -66,6 +66,9 @@ public:
   //! Receive a datagram and the Address of its sender
   void recv( Address& source_address, std::string& payload );
 
+  //! Receive a datagram into a buffer leased from `pool`
+  void recv( Address& source_address, Buffer& payload, BufferPool& pool );
+
   //! Send a datagram to specified Address
   void sendto( const Address& destination, std::string_view payload );
 
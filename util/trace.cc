@@ -0,0 +1,113 @@
+#include "trace.hh"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+// A record, as stored in the ring. `sequence` is 2 * position + 1 while the slot is being written for
+// a given position, and 2 * position + 2 once it holds that position's record (0 if never written).
+// The fields are atomics only so that a reader racing with a writer is well-defined; the sequence
+// number tells the reader whether what it read can be trusted.
+struct Slot
+{
+  atomic<uint64_t> sequence {};
+  atomic<uint64_t> time_ns {};
+  atomic<uint64_t> event {};
+  atomic<uint64_t> a {};
+  atomic<uint64_t> b {};
+};
+
+array<Slot, Trace::CAPACITY> slots {};
+alignas( 64 ) atomic<uint64_t> next_position {};
+
+} // namespace
+
+void Trace::record( const Event event, const uint64_t a, const uint64_t b ) noexcept
+{
+  const uint64_t time_ns
+    = chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+
+  const uint64_t position = next_position.fetch_add( 1, memory_order_relaxed );
+  Slot& slot = slots[position % CAPACITY];
+
+  slot.sequence.store( 2 * position + 1, memory_order_relaxed );
+  atomic_thread_fence( memory_order_release );
+  slot.time_ns.store( time_ns, memory_order_relaxed );
+  slot.event.store( static_cast<uint64_t>( event ), memory_order_relaxed );
+  slot.a.store( a, memory_order_relaxed );
+  slot.b.store( b, memory_order_relaxed );
+  slot.sequence.store( 2 * position + 2, memory_order_release );
+}
+
+vector<Trace::Record> Trace::snapshot()
+{
+  const uint64_t end = next_position.load( memory_order_acquire );
+  const uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+
+  vector<Record> records;
+  records.reserve( end - begin );
+  for ( uint64_t position = begin; position < end; ++position ) {
+    const Slot& slot = slots[position % CAPACITY];
+    const uint64_t sequence = slot.sequence.load( memory_order_acquire );
+    if ( sequence != 2 * position + 2 ) {
+      continue; // not written yet, or already overwritten
+    }
+    const Record record { slot.time_ns.load( memory_order_relaxed ),
+                          static_cast<Event>( slot.event.load( memory_order_relaxed ) ),
+                          slot.a.load( memory_order_relaxed ),
+                          slot.b.load( memory_order_relaxed ) };
+    atomic_thread_fence( memory_order_acquire );
+    if ( slot.sequence.load( memory_order_relaxed ) == sequence ) {
+      records.push_back( record );
+    }
+  }
+  return records;
+}
+
+uint64_t Trace::recorded()
+{
+  return next_position.load( memory_order_relaxed );
+}
+
+string_view Trace::name( const Event event )
+{
+  switch ( event ) {
+    case Event::InterfaceCreated:
+      return "InterfaceCreated";
+    case Event::ArpRequestSent:
+      return "ArpRequestSent";
+    case Event::ArpMappingLearned:
+      return "ArpMappingLearned";
+    case Event::ArpMappingExpired:
+      return "ArpMappingExpired";
+    case Event::ArpRequestFailed:
+      return "ArpRequestFailed";
+    case Event::PendingFrameDropped:
+      return "PendingFrameDropped";
+    case Event::DatagramTooBig:
+      return "DatagramTooBig";
+    case Event::DatagramDropped:
+      return "DatagramDropped";
+    case Event::RoutingTableInstalled:
+      return "RoutingTableInstalled";
+    case Event::SegmentRetransmitted:
+      return "SegmentRetransmitted";
+    case Event::PathMTUBlackHole:
+      return "PathMTUBlackHole";
+    case Event::SegmentReceived:
+      return "SegmentReceived";
+    case Event::SegmentIgnored:
+      return "SegmentIgnored";
+  }
+  return "unknown";
+}
+
+string Trace::to_string( const Record& record )
+{
+  return std::to_string( record.time_ns ) + " " + string( name( record.event ) ) + " "
+         + std::to_string( record.a ) + " " + std::to_string( record.b );
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Structured tracing for the network stack.
+//
+// A trace point records an event and two numbers (what they mean depends on the event) into one
+// process-wide ring buffer, which keeps the last Trace::CAPACITY records and can be read back with
+// Trace::snapshot(). Recording takes no lock and makes no system call: a writer claims a slot with
+// one atomic increment and fills it in under a per-slot sequence number, so any number of threads
+// may record at once, and a reader can tell a complete record from one being overwritten.
+//
+// Trace points are written with the MINNOW_TRACE macro, e.g.
+//
+//   MINNOW_TRACE( Debug, ArpRequestSent, target_ip, 0 );
+//
+// Only trace points at or below the level chosen at compile time (MINNOW_TRACE_LEVEL, set with
+// `cmake -DMINNOW_TRACE_LEVEL=...`) are compiled in; the others compile to nothing, and their
+// arguments are not evaluated.
+class Trace
+{
+public:
+  enum class Level : uint8_t
+  {
+    Off,
+    Error,
+    Info,
+    Debug,
+  };
+
+  enum class Event : uint16_t
+  {
+    InterfaceCreated,      // a: IP address, b: Ethernet address
+    ArpRequestSent,        // a: IP address asked for, b: 1 if unicast (a refresh), 0 if broadcast
+    ArpMappingLearned,     // a: IP address, b: Ethernet address
+    ArpMappingExpired,     // a: IP address
+    ArpRequestFailed,      // a: IP address asked for, b: unanswered requests in a row
+    PendingFrameDropped,   // a: next hop's IP address, b: frames waiting for ARP replies in all
+    DatagramTooBig,        // a: destination address, b: datagram length (over the MTU, "don't fragment")
+    DatagramDropped,       // a: destination address, b: TTL
+    RoutingTableInstalled, // a: generation of the new table, b: number of routes
+    SegmentRetransmitted,  // a: sequence number, b: retransmission timeout in milliseconds
+    PathMTUBlackHole,      // a: destination address, b: datagram length of the segment that kept timing out
+    SegmentReceived,       // a: absolute sequence number, b: payload length
+    SegmentIgnored,        // a: sequence number (received before the SYN)
+  };
+
+  struct Record
+  {
+    uint64_t time_ns;
+    Event event;
+    uint64_t a;
+    uint64_t b;
+  };
+
+  static constexpr size_t CAPACITY = 4096;
+
+  // Record an event, overwriting the oldest record if the ring is full
+  static void record( Event event, uint64_t a = 0, uint64_t b = 0 ) noexcept;
+
+  // The records still in the ring, oldest first (skipping any being overwritten while reading, and any
+  // that a writer interrupted in the middle of an older record has since written over)
+  static std::vector<Record> snapshot();
+
+  // Number of records ever made, including those since overwritten
+  static uint64_t recorded();
+
+  static std::string_view name( Event event );
+  static std::string to_string( const Record& record );
+};
+
+#ifndef MINNOW_TRACE_LEVEL
+#define MINNOW_TRACE_LEVEL 0
+#endif
+
+constexpr Trace::Level compiled_trace_level = static_cast<Trace::Level>( MINNOW_TRACE_LEVEL );
+
+// NOLINTNEXTLINE(*-macro-usage)
+#define MINNOW_TRACE( level, event, ... )                                                                        \
+  do {                                                                                                           \
+    if constexpr ( Trace::Level::level <= compiled_trace_level ) {                                               \
+      Trace::record( Trace::Event::event __VA_OPT__(, ) __VA_ARGS__ );                                           \
+    }                                                                                                            \
+  } while ( false )